@@ -16,29 +16,175 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdbool.h>
 #include <time.h>
 #include <stdio.h>
 #include <signal.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <pjsua-lib/pjsua.h>
 
+#include "modem_shm.h"
+#include "modem_agent.h"
+#include "modem_resample.h"
+
 #define SIGNATURE PJMEDIA_SIG_CLASS_PORT_AUD('D','M')
 
+#define FRAME_SAMPLES 192
+#define FRAME_BYTES (FRAME_SAMPLES*2)
+#define MAX_FRAME_SAMPLES (4*FRAME_SAMPLES) /* longest stream ptime, 80ms */
+#define MODEM_RATE 9600
+#define LINE_RATE 8000
+#define MAX_LINE_SAMPLES (MAX_FRAME_SAMPLES*LINE_RATE/MODEM_RATE)
+
+/* drift estimator, see drift_update() */
+#define DRIFT_PERIOD 1000	/* ms between estimates */
+#define DRIFT_MIN_POINTS 30	/* estimates before trusting the slope */
+#define DRIFT_MAX_PPM 1000.0	/* beyond this timestamps are not a clock */
+#define DRIFT_FILL_HORIZON 30	/* sec to bring the jitter buffer back */
+#define DRIFT_FILL_MAX_PPM 50.0
+#define DRIFT_REPORT 60		/* estimates between log lines */
+#define ELASTIC_FRAMES 8 /* bound on the latency either buffer can add */
+#define STATS_PERIOD 30 /* sec */
+#define PTIME_MAX 40 /* ms, longest DMODEM_PTIME, as slmodemd's S93 */
+#define RING_PERIOD 6000 /* ms, slmodemd drops the count after 6.5 sec */
+#define ACCEPT_TIMEOUT 1000 /* ms for a new connection's first request */
+
+/* what to play towards the line when slmodemd is late */
+enum underrun_fill {
+	FILL_ZERO,	/* silence */
+	FILL_REPEAT,	/* repeat the matching part of the last frame */
+};
+
+/* byte buffer between the clock thread and the non-blocking socket */
+struct elastic {
+	unsigned len;
+	char buf[ELASTIC_FRAMES*FRAME_BYTES];
+};
+
+struct dmodem_stats {
+	unsigned long frames;		/* frames sent towards the line */
+	unsigned long underruns;	/* frames short of modem samples */
+	unsigned long underrun_samples;	/* samples made up by the fill */
+	unsigned long overruns;		/* times the tx buffer overflowed */
+	unsigned long overrun_samples;	/* modem samples discarded */
+	unsigned long rx_drops;		/* line frames slmodemd could not take */
+	unsigned long rx_drop_samples;
+};
+
+/* far end sample clock against ours, from RTP timestamps and jitter
+   buffer fill */
+struct drift {
+	unsigned ticks;		/* clock ticks since the last estimate */
+	uint64_t local;		/* line samples of our clock */
+	bool have_ts;
+	uint32_t last_ts;
+	uint64_t rtp;		/* unwrapped rx RTP timestamp */
+	uint64_t local0, rtp0;	/* regression origin */
+	double n, sx, sy, sxx, sxy;
+	double ppm;		/* from timestamps */
+	double level;		/* filtered jitter buffer excess, frames */
+	double applied;		/* trim applied to the resamplers */
+	unsigned reports;
+};
+
 struct dmodem {
 	pjmedia_port base;
 	pj_timestamp timestamp;
 	pj_sock_t sock;
+	struct modem_shm *shm; /* optional shared memory audio rings */
+	int event_fd;
+	enum underrun_fill fill;
+	/* socket samples: 0 linear at MODEM_RATE, or MODEM_AGENT_ULAW/_ALAW
+	   bytes at LINE_RATE, the codec's samples, which slmodemd converts */
+	unsigned law;
+	struct elastic tx;	/* slmodemd -> line */
+	struct elastic rx;	/* line -> slmodemd, what the socket refused */
+	int16_t last_frame[MAX_FRAME_SAMPLES];
+	struct dmodem_stats stats;
+	/* direct mode: our own clock moves audio between the RTP stream at
+	   the line rate and slmodemd, converting instead of the bridge */
+	bool direct;
+	struct modem_resampler *up;	/* line -> modem rate */
+	struct modem_resampler *down;	/* modem -> line rate */
+	pjmedia_clock *clock;
+	pjmedia_stream *strm;
+	pjmedia_port *strm_port;
+	int16_t rx_buf[2*MAX_FRAME_SAMPLES];	/* converted, for slmodemd */
+	unsigned rx_len;
+	int16_t tx_buf[2*MAX_LINE_SAMPLES];	/* converted, for the stream */
+	unsigned tx_len;
+	struct drift drift;
+	/* per call */
+	pj_pool_t *pool;
+	pjsua_call_id call_id;
+	pjsua_conf_port_id conf_slot;
+	bool active;	/* a call owns the port, until the main loop closes it */
+	/* set from the clock and SIP threads, read by the main loop */
+	atomic_bool failed;	/* audio path to slmodemd is gone, hang up */
+	atomic_bool ended;	/* call disconnected, close the port */
+	bool hangup;	/* hangup requested after a failure */
+	/* idle connection from slmodemd, waiting for a call; ports_lock */
+	bool listening;
+	bool ringing;	/* incoming call bound, RING sent, no ANSWER yet */
+	uint64_t next_ring;	/* ms */
+	unsigned long last_used;
+	char caller[MODEM_AGENT_DIAL_MAX];
+	char name[16];
 };
 
-static struct dmodem port;
+/* one per concurrent call; pjsua's limit unless config_site.h raises it */
+#define DMODEM_MAX_CALLS PJSUA_MAX_CALLS
+
+static struct dmodem ports[DMODEM_MAX_CALLS];
+static unsigned max_calls = 1;
+/* bridge clock and modem port frame; without DMODEM_PTIME the bridge
+   ticks every 5 ms and the port takes FRAME_SAMPLES at a time */
+static unsigned ptime = 5;
+static unsigned frame_samples = FRAME_SAMPLES;
 static bool destroying = false;
+static pj_caching_pool cp;
 static pj_pool_t *pool;
+static pjsua_acc_id acc_id;
+static char *sip_domain;
+/* -l: stay up, calls are requested over a unix socket (modem_agent.h) */
+static bool agent;
+static int wake_pipe[2] = {-1, -1};
+/* idle and ringing ports change hands between the SIP thread that picks
+   one for an incoming call and the main loop */
+static pthread_mutex_t ports_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long ports_used;
+/* accepted connections whose first request has not come in yet */
+struct pending {
+	int fd;
+	uint64_t since;	/* ms */
+};
+static struct pending pending[DMODEM_MAX_CALLS];
+static unsigned npending;
+
+static void direct_stop(struct dmodem *sm) {
+	if (sm->clock) {
+		pjmedia_clock_stop(sm->clock);
+	}
+}
 
 static void error_exit(const char *title, pj_status_t status) {
 	pjsua_perror(__FILE__, title, status);
+	for (unsigned i = 0; i < max_calls; i++) {
+		direct_stop(&ports[i]);
+	}
 	if (!destroying) {
 		destroying = true;
 		pjsua_destroy();
@@ -46,14 +192,208 @@ static void error_exit(const char *title, pj_status_t status) {
 	}
 }
 
+/* wake the main loop, from any thread */
+static void agent_wake(void) {
+	char c = 0;
+	if (write(wake_pipe[1], &c, 1) < 0 && errno != EAGAIN) {
+		PJ_LOG(1,(__FILE__, "cannot wake main loop: %s", strerror(errno)));
+	}
+}
+
+/* the audio path to slmodemd broke: a single call process just leaves,
+   the agent stops using the port and hangs the call up from main */
+static void dmodem_fail(struct dmodem *sm, const char *title) {
+	if (!agent) {
+		error_exit(title, 0);
+		return;
+	}
+	if (sm->failed) {
+		return;
+	}
+	sm->failed = true;
+	PJ_LOG(2,(__FILE__, "call %d: %s", sm->call_id, title));
+	agent_wake();
+}
+
+static void dmodem_print_stats(struct dmodem *sm) {
+	struct dmodem_stats *st = &sm->stats;
+	PJ_LOG(3,(__FILE__, "frames %lu: underruns %lu (%lu samples), "
+		"overruns %lu (%lu samples), rx drops %lu (%lu samples)",
+		st->frames, st->underruns, st->underrun_samples,
+		st->overruns, st->overrun_samples,
+		st->rx_drops, st->rx_drop_samples));
+}
+
+static void shm_put_samples(struct dmodem *sm, const void *buf, int count) {
+	uint64_t val = 1;
+	int ret = modem_shm_ring_write(&sm->shm->rx, buf, count);
+	if (ret != count) {
+		sm->stats.rx_drops++;
+		sm->stats.rx_drop_samples += count - ret;
+	}
+	if (write(sm->event_fd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+		dmodem_fail(sm, "error ringing doorbell");
+	}
+}
+
+/* bytes a sample takes on the socket */
+static int sample_bytes(struct dmodem *sm) {
+	return sm->law ? 1 : 2;
+}
+
+static void law_compress(unsigned law, uint8_t *dst, const int16_t *src, int count) {
+	if (law == MODEM_AGENT_ALAW) {
+		while (count--) *dst++ = pjmedia_linear2alaw(*src++);
+	} else {
+		while (count--) *dst++ = pjmedia_linear2ulaw(*src++);
+	}
+}
+
+static void law_expand(unsigned law, int16_t *dst, const uint8_t *src, int count) {
+	if (law == MODEM_AGENT_ALAW) {
+		while (count--) *dst++ = pjmedia_alaw2linear(*src++);
+	} else {
+		while (count--) *dst++ = pjmedia_ulaw2linear(*src++);
+	}
+}
+
+/* push out what the socket refused last time, then as much of buf as fits */
+static void sock_put_samples(struct dmodem *sm, const void *buf, int size) {
+	struct elastic *e = &sm->rx;
+	int ss = sample_bytes(sm);
+	int len;
+
+	if (e->len) {
+		len = write(sm->sock, e->buf, e->len);
+		if (len < 0 && errno != EAGAIN) {
+			dmodem_fail(sm, "error writing frame");
+		}
+		if (len > 0) {
+			e->len -= len;
+			memmove(e->buf, e->buf + len, e->len);
+		}
+	}
+
+	len = 0;
+	if (!e->len) {
+		len = write(sm->sock, buf, size);
+		if (len < 0) {
+			if (errno != EAGAIN) {
+				dmodem_fail(sm, "error writing frame");
+			}
+			len = 0;
+		}
+	}
+	if (len == size) {
+		return;
+	}
+	/* keep the tail, sample aligned with whatever went out already */
+	if (e->len + size - len > sizeof(e->buf)) {
+		if (len % ss) { /* finish the sample that went out half */
+			e->buf[e->len++] = ((const char *)buf)[len++];
+		}
+		sm->stats.rx_drops++;
+		sm->stats.rx_drop_samples += (size - len)/ss;
+		return;
+	}
+	memcpy(e->buf + e->len, (const char *)buf + len, size - len);
+	e->len += size - len;
+}
+
+/* drain the socket; on overflow the oldest samples go */
+static void sock_get_samples(struct dmodem *sm) {
+	struct elastic *e = &sm->tx;
+	char tmp[FRAME_BYTES*2];
+	int ss = sample_bytes(sm);
+	int len, drop;
+
+	while ((len = read(sm->sock, tmp, sizeof(tmp))) > 0) {
+		if (e->len + len > sizeof(e->buf)) {
+			drop = (e->len + len - sizeof(e->buf) + ss - 1)/ss*ss;
+			sm->stats.overruns++;
+			sm->stats.overrun_samples += drop/ss;
+			if (drop >= e->len) {
+				e->len = 0;
+			} else {
+				e->len -= drop;
+				memmove(e->buf, e->buf + drop, e->len);
+			}
+		}
+		memcpy(e->buf + e->len, tmp, len);
+		e->len += len;
+	}
+	if (len == 0) {
+		dmodem_fail(sm, "modem socket closed");
+	} else if (errno != EAGAIN) {
+		dmodem_fail(sm, "error reading frame");
+	}
+}
+
+static void fill_underrun(struct dmodem *sm, int16_t *buf, int have, int count) {
+	sm->stats.underruns++;
+	sm->stats.underrun_samples += count - have;
+	if (sm->fill == FILL_REPEAT) {
+		memcpy(buf + have, sm->last_frame + have, (count - have)*2);
+	} else {
+		memset(buf + have, 0, (count - have)*2);
+	}
+}
+
+/* count is at most a direct mode rx_buf */
+static void dmodem_push(struct dmodem *sm, const int16_t *buf, int count) {
+	uint8_t law[2*MAX_FRAME_SAMPLES];
+
+	if (sm->failed) {
+		return;
+	}
+	if (sm->shm) {
+		shm_put_samples(sm, buf, count);
+	} else if (sm->law) {
+		law_compress(sm->law, law, buf, count);
+		sock_put_samples(sm, law, count);
+	} else {
+		sock_put_samples(sm, buf, count*2);
+	}
+}
+
+/* never blocks: a late slmodemd costs samples, not a clock tick */
+static void dmodem_pull(struct dmodem *sm, int16_t *buf, int count) {
+	int have, ss;
+
+	if (sm->failed) {
+		have = 0;
+	} else if (sm->shm) {
+		have = modem_shm_ring_read(&sm->shm->tx, buf, count);
+	} else {
+		sock_get_samples(sm);
+		ss = sample_bytes(sm);
+		have = sm->tx.len/ss;
+		if (have > count) {
+			have = count;
+		}
+		if (sm->law) {
+			law_expand(sm->law, buf, (uint8_t *)sm->tx.buf, have);
+		} else {
+			memcpy(buf, sm->tx.buf, have*2);
+		}
+		sm->tx.len -= have*ss;
+		memmove(sm->tx.buf, sm->tx.buf + have*ss, sm->tx.len);
+	}
+	if (have < count) {
+		fill_underrun(sm, buf, have, count);
+	}
+	memcpy(sm->last_frame, buf, count*2);
+
+	if (++sm->stats.frames % (STATS_PERIOD*MODEM_RATE/frame_samples) == 0) {
+		dmodem_print_stats(sm);
+	}
+}
+
 static pj_status_t dmodem_put_frame(pjmedia_port *this_port, pjmedia_frame *frame) {
 	struct dmodem *sm = (struct dmodem *)this_port;
-	int len;
 
 	if (frame->type == PJMEDIA_FRAME_TYPE_AUDIO) {
-		if ((len=write(sm->sock, frame->buf, frame->size)) != frame->size) {
-			error_exit("error writing frame",0);
-		}
+		dmodem_push(sm, frame->buf, frame->size/2);
 	}
 
 	return PJ_SUCCESS;
@@ -61,12 +401,10 @@ static pj_status_t dmodem_put_frame(pjmedia_port *this_port, pjmedia_frame *fram
 
 static pj_status_t dmodem_get_frame(pjmedia_port *this_port, pjmedia_frame *frame) {
 	struct dmodem *sm = (struct dmodem *)this_port;
-	frame->size = PJMEDIA_PIA_AVG_FSZ(&this_port->info); // MAX? what is
+	unsigned spf = PJMEDIA_PIA_SPF(&this_port->info);
 
-	int len;
-	if ((len=read(sm->sock, frame->buf, frame->size)) != frame->size) {
-		error_exit("error reading frame",0);
-	}
+	frame->size = spf*2;
+	dmodem_pull(sm, frame->buf, spf);
 
 	frame->timestamp.u64 = sm->timestamp.u64;
 	frame->type = PJMEDIA_FRAME_TYPE_AUDIO;
@@ -80,8 +418,255 @@ static pj_status_t dmodem_on_destroy(pjmedia_port *this_port) {
 	exit(-1);
 }
 
+static void drift_reset(struct drift *d) {
+	d->local0 = d->local;
+	d->rtp0 = d->rtp;
+	d->n = d->sx = d->sy = d->sxx = d->sxy = 0;
+}
+
+static void drift_print(struct dmodem *sm) {
+	struct drift *d = &sm->drift;
+	PJ_LOG(3,(__FILE__, "clock drift %+.2f ppm, applied %+.2f ppm, "
+		"jitter buffer %+.2f frames off target",
+		d->ppm, d->applied, d->level));
+}
+
+/* Once per DRIFT_PERIOD: the slope of rx RTP timestamps against our own
+ * sample count (least squares since the call, or since timestamps last
+ * jumped) gives the far end clock in ppm; a small term proportional to the
+ * jitter buffer's distance from its target takes up whatever the slope
+ * missed. The sum trims both resamplers. */
+static void drift_update(struct dmodem *sm) {
+	struct drift *d = &sm->drift;
+	pjmedia_stream_rtp_sess_info info;
+	pjmedia_jb_state jb;
+	unsigned rate = PJMEDIA_PIA_SRATE(&sm->strm_port->info);
+	unsigned spf = PJMEDIA_PIA_SPF(&sm->strm_port->info);
+	double x, y, fill;
+	uint32_t ts;
+
+	if (pjmedia_stream_get_rtp_session_info(sm->strm, &info) != PJ_SUCCESS ||
+			pjmedia_stream_get_stat_jbuf(sm->strm, &jb) != PJ_SUCCESS) {
+		return;
+	}
+	ts = info.rtcp->rtp_last_ts;
+	if (ts == (uint32_t)-1) { // nothing received yet
+		return;
+	}
+	if (!d->have_ts) {
+		d->have_ts = true;
+		d->last_ts = ts;
+		drift_reset(d);
+	}
+	d->rtp += (int32_t)(ts - d->last_ts);
+	d->last_ts = ts;
+
+	x = (double)(d->local - d->local0) / rate;
+	y = (double)(int64_t)(d->rtp - d->rtp0) / rate;
+	d->n++;
+	d->sx += x;
+	d->sy += y;
+	d->sxx += x*x;
+	d->sxy += x*y;
+	if (d->n >= DRIFT_MIN_POINTS) {
+		double ppm = ((d->n*d->sxy - d->sx*d->sy) /
+				(d->n*d->sxx - d->sx*d->sx) - 1) * 1e6;
+		if (fabs(ppm) > DRIFT_MAX_PPM) {
+			PJ_LOG(3,(__FILE__, "RTP timestamps jumped, "
+				"restarting drift estimate"));
+			drift_reset(d);
+		} else {
+			d->ppm = ppm;
+		}
+	}
+
+	d->level += ((double)jb.size - (jb.prefetch ? jb.prefetch - 1 : 0) -
+			d->level) / 8;
+	fill = d->level * spf * 1e6 / (DRIFT_FILL_HORIZON * rate);
+	if (fill > DRIFT_FILL_MAX_PPM) {
+		fill = DRIFT_FILL_MAX_PPM;
+	} else if (fill < -DRIFT_FILL_MAX_PPM) {
+		fill = -DRIFT_FILL_MAX_PPM;
+	}
+	d->applied = d->ppm + fill;
+	if (fabs(d->applied) > DRIFT_MAX_PPM) {
+		d->applied = d->applied > 0 ? DRIFT_MAX_PPM : -DRIFT_MAX_PPM;
+	}
+	if (sm->law) {
+		d->applied = 0; /* no converters to trim, see direct_law() */
+	} else {
+		modem_resample_set_ppm(sm->up, d->applied);
+		modem_resample_set_ppm(sm->down, -d->applied);
+	}
+
+	if (++d->reports % DRIFT_REPORT == 0) {
+		drift_print(sm);
+	}
+}
+
+/* a stream frame, or silence if there is none */
+static void direct_get_frame(struct dmodem *sm, int16_t *line, unsigned spf) {
+	pjmedia_frame frame;
+
+	frame.buf = line;
+	frame.size = spf*2;
+	frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+	if (pjmedia_port_get_frame(sm->strm_port, &frame) != PJ_SUCCESS ||
+			frame.type != PJMEDIA_FRAME_TYPE_AUDIO ||
+			frame.size != spf*2) {
+		pjmedia_zero_samples(line, spf);
+	}
+}
+
+/* G.711 socket: the stream's samples go both ways as they are. Decoding
+ * and compressing a G.711 sample again gives back the same byte, so the
+ * line audio reaches slmodemd exactly as it came in and the other way
+ * round. Drift is left to the jitter buffer, which slips samples. */
+static void direct_law(struct dmodem *sm, unsigned spf) {
+	int16_t line[MAX_LINE_SAMPLES];
+	pjmedia_frame frame;
+
+	direct_get_frame(sm, line, spf);
+	dmodem_push(sm, line, spf);
+
+	dmodem_pull(sm, line, spf);
+	frame.buf = line;
+	frame.size = spf*2;
+	frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+	frame.timestamp.u64 = sm->timestamp.u64;
+	sm->timestamp.u64 += spf;
+	pjmedia_port_put_frame(sm->strm_port, &frame);
+}
+
+/* A frame of slmodemd audio goes out converted to the line rate, and
+ * enough stream frames are pulled to hand slmodemd a frame at its rate.
+ * With the far end running fast the up converter eats its input quicker,
+ * so more stream frames get pulled. */
+static void direct_convert(struct dmodem *sm, unsigned spf) {
+	unsigned mspf = spf*MODEM_RATE/LINE_RATE;
+	int16_t line[MAX_LINE_SAMPLES];
+	int16_t modem[MAX_FRAME_SAMPLES];
+	pjmedia_frame frame;
+
+	while (sm->rx_len < mspf) {
+		direct_get_frame(sm, line, spf);
+		sm->rx_len += modem_resample_process(sm->up, line, spf,
+				sm->rx_buf + sm->rx_len);
+	}
+	dmodem_push(sm, sm->rx_buf, mspf);
+	sm->rx_len -= mspf;
+	memmove(sm->rx_buf, sm->rx_buf + mspf, sm->rx_len*2);
+
+	dmodem_pull(sm, modem, mspf);
+	sm->tx_len += modem_resample_process(sm->down, modem, mspf,
+			sm->tx_buf + sm->tx_len);
+	while (sm->tx_len >= spf) {
+		frame.buf = sm->tx_buf;
+		frame.size = spf*2;
+		frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+		frame.timestamp.u64 = sm->timestamp.u64;
+		sm->timestamp.u64 += spf;
+		pjmedia_port_put_frame(sm->strm_port, &frame);
+		sm->tx_len -= spf;
+		memmove(sm->tx_buf, sm->tx_buf + spf, sm->tx_len*2);
+	}
+}
+
+/* Direct mode clock, one stream frame per tick */
+static void direct_tick(const pj_timestamp *ts, void *user_data) {
+	struct dmodem *sm = user_data;
+	unsigned spf = PJMEDIA_PIA_SPF(&sm->strm_port->info);
+
+	if (sm->law) {
+		direct_law(sm, spf);
+	} else {
+		direct_convert(sm, spf);
+	}
+
+	sm->drift.local += spf;
+	if (++sm->drift.ticks*spf*1000 >= DRIFT_PERIOD*LINE_RATE) {
+		sm->drift.ticks = 0;
+		drift_update(sm);
+	}
+}
+
+/* Callback called by the library when a stream is created: in direct
+ * mode the stream is driven by our own clock, the bridge gets a null port */
+static void on_stream_created2(pjsua_call_id call_id,
+		pjsua_on_stream_created_param *param) {
+	struct dmodem *sm = pjsua_call_get_user_data(call_id);
+	pjmedia_port *strm_port = param->port;
+	unsigned spf = PJMEDIA_PIA_SPF(&strm_port->info);
+	pjmedia_port *null_port;
+	pj_status_t status;
+
+	if (!sm || !sm->direct) {
+		return;
+	}
+	if (PJMEDIA_PIA_SRATE(&strm_port->info) != LINE_RATE ||
+			PJMEDIA_PIA_CCNT(&strm_port->info) != 1 ||
+			spf*MODEM_RATE % LINE_RATE ||
+			spf > MAX_LINE_SAMPLES) {
+		PJ_LOG(2,(__FILE__, "stream format %u/%u not usable directly, "
+			"using conference bridge",
+			PJMEDIA_PIA_SRATE(&strm_port->info), spf));
+		sm->direct = false;
+		return;
+	}
+
+	sm->strm = param->stream;
+	sm->strm_port = strm_port;
+	sm->rx_len = sm->tx_len = 0;
+	memset(&sm->drift, 0, sizeof(sm->drift));
+	if (!sm->law) {
+		modem_resample_reset(sm->up);
+		modem_resample_reset(sm->down);
+		modem_resample_set_ppm(sm->up, 0);
+		modem_resample_set_ppm(sm->down, 0);
+	}
+
+	status = pjmedia_null_port_create(sm->pool, LINE_RATE, 1, spf, 16, &null_port);
+	if (status != PJ_SUCCESS) error_exit("Error creating null port", status);
+	status = pjmedia_clock_create(sm->pool, LINE_RATE, 1, spf, 0,
+			&direct_tick, sm, &sm->clock);
+	if (status != PJ_SUCCESS) error_exit("Error creating clock", status);
+	status = pjmedia_clock_start(sm->clock);
+	if (status != PJ_SUCCESS) error_exit("Error starting clock", status);
+
+	param->port = null_port;
+	param->destroy_port = PJ_TRUE;
+}
+
+/* the stream is gone by the time the call is disconnected */
+static void print_jb_stats(pjmedia_stream *strm) {
+	pjmedia_jb_state jb;
+
+	if (pjmedia_stream_get_stat_jbuf(strm, &jb) != PJ_SUCCESS) {
+		return;
+	}
+	PJ_LOG(3,(__FILE__, "jitter buffer: delay avg %u max %u ms, "
+		"lost %u, discard %u, empty %u, slip -%u/+%u samples",
+		jb.avg_delay, jb.max_delay, jb.lost,
+		jb.discard, jb.empty,
+		jb.slip_del, jb.slip_ins));
+}
+
+/* Callback called by the library before a stream is destroyed */
+static void on_stream_destroyed(pjsua_call_id call_id,
+		pjmedia_stream *strm, unsigned stream_idx) {
+	struct dmodem *sm = pjsua_call_get_user_data(call_id);
+
+	print_jb_stats(strm);
+	if (sm && sm->clock) {
+		pjmedia_clock_destroy(sm->clock);
+		sm->clock = NULL;
+		drift_print(sm);
+	}
+}
+
 /* Callback called by the library when call's state has changed */
 static void on_call_state(pjsua_call_id call_id, pjsip_event *e) {
+	struct dmodem *sm = pjsua_call_get_user_data(call_id);
 	pjsua_call_info ci;
 
 	PJ_UNUSED_ARG(e);
@@ -91,8 +676,25 @@ static void on_call_state(pjsua_call_id call_id, pjsip_event *e) {
 				(int)ci.state_text.slen,
 				ci.state_text.ptr));
 
-	if (ci.state == PJSIP_INV_STATE_DISCONNECTED) {
-		close(port.sock);
+	if (ci.state == PJSIP_INV_STATE_DISCONNECTED && sm) {
+		direct_stop(sm);
+		dmodem_print_stats(sm);
+		if (sm->clock) {
+			drift_print(sm);
+		}
+		if (agent) {
+			pthread_mutex_lock(&ports_lock);
+			sm->ringing = false; /* caller gave up */
+			pthread_mutex_unlock(&ports_lock);
+			if (sm->conf_slot != PJSUA_INVALID_ID) {
+				pjsua_conf_remove_port(sm->conf_slot);
+				sm->conf_slot = PJSUA_INVALID_ID;
+			}
+			sm->ended = true;
+			agent_wake();
+			return;
+		}
+		close(sm->sock);
 		if (!destroying) {
 			destroying = true;
 			pjsua_destroy();
@@ -103,43 +705,581 @@ static void on_call_state(pjsua_call_id call_id, pjsip_event *e) {
 
 /* Callback called by the library when call's media state has changed */
 static void on_call_media_state(pjsua_call_id call_id) {
+	struct dmodem *sm = pjsua_call_get_user_data(call_id);
 	pjsua_call_info ci;
-	pjsua_conf_port_id port_id;
-	static int done=0;
 
+	if (!sm) {
+		return;
+	}
 	pjsua_call_get_info(call_id, &ci);
 
 //	printf("media_status %d media_cnt %d ci.conf_slot %d aud.conf_slot %d\n",ci.media_status,ci.media_cnt,ci.conf_slot,ci.media[0].stream.aud.conf_slot);
 	if (ci.media_status == PJSUA_CALL_MEDIA_ACTIVE) {
-		if (!done) {
-			pjsua_conf_add_port(pool, &port.base, &port_id);
-			pjsua_conf_connect(ci.conf_slot, port_id);
-			pjsua_conf_connect(port_id, ci.conf_slot);
-			done = 1;
+		if (sm->conf_slot == PJSUA_INVALID_ID && !sm->direct) {
+			pjsua_conf_add_port(sm->pool, &sm->base, &sm->conf_slot);
+			pjsua_conf_connect(ci.conf_slot, sm->conf_slot);
+			pjsua_conf_connect(sm->conf_slot, ci.conf_slot);
+		}
+	} else if (sm->conf_slot != PJSUA_INVALID_ID) {
+		pjsua_conf_remove_port(sm->conf_slot);
+		sm->conf_slot = PJSUA_INVALID_ID;
+	}
+}
+
+static int port_init(struct dmodem *sm, unsigned idx, enum underrun_fill fill,
+		bool direct) {
+	pj_str_t name;
+
+	memset(sm, 0, sizeof(*sm));
+	sm->sock = -1;
+	sm->event_fd = -1;
+	sm->call_id = PJSUA_INVALID_ID;
+	sm->conf_slot = PJSUA_INVALID_ID;
+	sm->fill = fill;
+	if (direct) {
+		sm->up = modem_resample_create(LINE_RATE, MODEM_RATE);
+		sm->down = modem_resample_create(MODEM_RATE, LINE_RATE);
+		if (!sm->up || !sm->down) {
+			return -1;
+		}
+	}
+	snprintf(sm->name, sizeof(sm->name), "dmodem%u", idx);
+	name = pj_str(sm->name);
+	pjmedia_port_info_init(&sm->base.info, &name, SIGNATURE, MODEM_RATE, 1, 16, frame_samples);
+	sm->base.put_frame = dmodem_put_frame;
+	sm->base.get_frame = dmodem_get_frame;
+	sm->base.on_destroy = dmodem_on_destroy;
+	return 0;
+}
+
+static uint64_t now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+/* a free port for a new connection from slmodemd */
+static struct dmodem *port_claim(void) {
+	struct dmodem *sm = NULL;
+
+	pthread_mutex_lock(&ports_lock);
+	for (unsigned i = 0; i < max_calls; i++) {
+		if (!ports[i].active) {
+			sm = &ports[i];
+			sm->active = true;
+			sm->failed = sm->ended = sm->hangup = false;
+			sm->listening = sm->ringing = false;
+			sm->call_id = PJSUA_INVALID_ID;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ports_lock);
+	return sm;
+}
+
+/* take over the audio channel of one call from slmodemd */
+static int port_open(struct dmodem *sm, int sock, int shm_fd, int event_fd,
+		unsigned law) {
+	int16_t buf[FRAME_SAMPLES];
+	unsigned rate = law ? LINE_RATE : MODEM_RATE;
+
+	sm->sock = sock;
+	sm->event_fd = event_fd;
+	sm->law = law;
+	sm->shm = NULL;
+	if (shm_fd >= 0) {
+		sm->shm = mmap(NULL, sizeof(*sm->shm), PROT_READ|PROT_WRITE,
+				MAP_SHARED, shm_fd, 0);
+		close(shm_fd);
+		if (sm->shm == MAP_FAILED || modem_shm_check(sm->shm)) {
+			if (sm->shm != MAP_FAILED) {
+				munmap(sm->shm, sizeof(*sm->shm));
+			}
+			sm->shm = NULL;
+			return -1;
+		}
+	}
+	fcntl(sm->sock, F_SETFL, fcntl(sm->sock, F_GETFL) | O_NONBLOCK);
+
+	sm->pool = pj_pool_create(&cp.factory, "call", 4000, 4000, NULL);
+	sm->conf_slot = PJSUA_INVALID_ID;
+	sm->timestamp.u64 = 0;
+	sm->tx.len = sm->rx.len = 0;
+	memset(&sm->stats, 0, sizeof(sm->stats));
+	memset(sm->last_frame, 0, sizeof(sm->last_frame));
+	/* G.711 needs no converters, and the bridge, where the stream does
+	   not suit direct mode, then sees the modem at the line rate */
+	sm->direct = sm->up != NULL || law;
+	pjmedia_port_info_init(&sm->base.info, &sm->base.info.name, SIGNATURE,
+			rate, 1, 16, frame_samples*rate/MODEM_RATE);
+
+	memset(buf,0,sizeof(buf));
+	dmodem_push(sm, buf, FRAME_SAMPLES*rate/MODEM_RATE);
+	return 0;
+}
+
+static void port_close(struct dmodem *sm) {
+	close(sm->sock);
+	sm->sock = -1;
+	if (sm->shm) {
+		munmap(sm->shm, sizeof(*sm->shm));
+		sm->shm = NULL;
+	}
+	if (sm->event_fd >= 0) {
+		close(sm->event_fd);
+		sm->event_fd = -1;
+	}
+	if (sm->pool) {
+		pj_pool_release(sm->pool);
+		sm->pool = NULL;
+	}
+	pthread_mutex_lock(&ports_lock);
+	sm->listening = sm->ringing = false;
+	sm->call_id = PJSUA_INVALID_ID;
+	sm->active = false;
+	pthread_mutex_unlock(&ports_lock);
+}
+
+static pj_status_t call_start(struct dmodem *sm, const char *dialstr) {
+	char buf[256];
+	pj_str_t uri;
+
+	snprintf(buf,sizeof(buf),"sip:%s@%s",dialstr,sip_domain);
+	printf("calling %s\n",buf);
+	uri = pj_str(buf);
+	return pjsua_call_make_call(acc_id, &uri, 0, sm, NULL, &sm->call_id);
+}
+
+static int agent_listen(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		PJ_LOG(1,(__FILE__, "socket path too long: %s", path));
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	/* slmodemd connects as nobody, the directory decides who else can */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			chmod(path, 0666) < 0 || listen(fd, SOMAXCONN) < 0) {
+		PJ_LOG(1,(__FILE__, "cannot listen on %s: %s", path, strerror(errno)));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void ring_send(struct dmodem *sm) {
+	struct modem_agent_req req;
+
+	modem_agent_req_init(&req, MODEM_AGENT_RING, sm->caller);
+	if (modem_agent_send(sm->sock, &req, NULL, 0) < 0) {
+		PJ_LOG(2,(__FILE__, "%s: cannot send RING: %s", sm->name,
+			strerror(errno)));
+	}
+	sm->next_ring = now_ms() + RING_PERIOD;
+}
+
+/* SIP thread: the least recently used idle modem gets the call, so that
+ * the load spreads over the whole pool */
+static struct dmodem *ring_start(pjsua_call_id call_id, const char *caller) {
+	struct dmodem *sm = NULL;
+
+	pthread_mutex_lock(&ports_lock);
+	for (unsigned i = 0; i < max_calls; i++) {
+		if (ports[i].listening &&
+				(!sm || ports[i].last_used < sm->last_used)) {
+			sm = &ports[i];
+		}
+	}
+	if (sm) {
+		sm->listening = false;
+		sm->ringing = true;
+		sm->call_id = call_id;
+		sm->last_used = ++ports_used;
+		snprintf(sm->caller, sizeof(sm->caller), "%s", caller);
+		pjsua_call_set_user_data(call_id, sm);
+		ring_send(sm);
+	}
+	pthread_mutex_unlock(&ports_lock);
+	return sm;
+}
+
+/* registration results of -l, refreshes included */
+static void on_reg_state2(pjsua_acc_id acc, pjsua_reg_info *info) {
+	struct pjsip_regc_cbparam *rp = info->cbparam;
+
+	if (rp->code/100 == 2) {
+		if (info->renew) {
+			PJ_LOG(3,(__FILE__, "registered"));
 		}
 	} else {
-		done = 0;
+		PJ_LOG(2,(__FILE__, "registration failed: %d %.*s", rp->code,
+			(int)rp->reason.slen, rp->reason.ptr));
+	}
+}
+
+/* Callback called by the library on an incoming INVITE */
+static void on_incoming_call(pjsua_acc_id acc, pjsua_call_id call_id,
+		pjsip_rx_data *rdata) {
+	pjsua_call_info ci;
+	char caller[MODEM_AGENT_DIAL_MAX];
+	struct dmodem *sm;
+
+	PJ_UNUSED_ARG(acc);
+	PJ_UNUSED_ARG(rdata);
+
+	pjsua_call_get_info(call_id, &ci);
+	snprintf(caller, sizeof(caller), "%.*s",
+		(int)ci.remote_info.slen, ci.remote_info.ptr);
+	sm = ring_start(call_id, caller);
+	if (!sm) {
+		PJ_LOG(2,(__FILE__, "no idle modem for call from %s", caller));
+		pjsua_call_answer(call_id, PJSIP_SC_BUSY_HERE, NULL, NULL);
+		return;
+	}
+	PJ_LOG(3,(__FILE__, "call %d from %s ringing %s", call_id, caller,
+		sm->name));
+	pjsua_call_answer(call_id, PJSIP_SC_RINGING, NULL, NULL);
+}
+
+/* the connection failed before it carried audio: give up the port, or
+   if a call was ringing on it, hang that up and let it close the port */
+static void agent_drop(struct dmodem *sm) {
+	pjsua_call_id call_id = PJSUA_INVALID_ID;
+
+	pthread_mutex_lock(&ports_lock);
+	if (sm->ringing) {
+		sm->ringing = false;
+		sm->failed = sm->hangup = true;
+		call_id = sm->call_id;
+	} else if (sm->listening) {
+		sm->listening = false;
+		sm->ended = true;
+	}
+	pthread_mutex_unlock(&ports_lock);
+	if (call_id != PJSUA_INVALID_ID) {
+		pjsua_call_hangup(call_id, PJSIP_SC_TEMPORARILY_UNAVAILABLE,
+				NULL, NULL);
+	}
+}
+
+/* a DIAL or an ANSWER starts the call on the connection it came on */
+static void agent_request(struct dmodem *sm, struct modem_agent_req *req,
+		int *fds, int nfds) {
+	bool answer = false, dial = false;
+	pj_status_t status;
+
+	pthread_mutex_lock(&ports_lock);
+	if (req->cmd == MODEM_AGENT_ANSWER && sm->ringing) {
+		sm->ringing = false;
+		answer = true;
+	} else if (req->cmd == MODEM_AGENT_DIAL && !sm->ringing &&
+			sm->call_id == PJSUA_INVALID_ID) {
+		sm->listening = false;
+		dial = true;
+	}
+	pthread_mutex_unlock(&ports_lock);
+
+	if (!answer && !dial) {
+		PJ_LOG(2,(__FILE__, "%s: unexpected request %u", sm->name, req->cmd));
+		goto fail;
+	}
+	if (port_open(sm, sm->sock, nfds ? fds[0] : -1, nfds ? fds[1] : -1,
+			req->flags & (MODEM_AGENT_ULAW|MODEM_AGENT_ALAW)) < 0) {
+		PJ_LOG(2,(__FILE__, "error mapping shared audio rings"));
+		nfds = 0;
+		goto fail;
+	}
+	if (sm->failed) { /* slmodemd gone before we even started */
+		goto fail;
+	}
+	if (answer) {
+		status = pjsua_call_answer(sm->call_id, PJSIP_SC_OK, NULL, NULL);
+		if (status != PJ_SUCCESS) {
+			pjsua_perror(__FILE__, "Error answering call", status);
+		}
+		return;
+	}
+	status = call_start(sm, req->dial);
+	if (status != PJ_SUCCESS) {
+		pjsua_perror(__FILE__, "Error making call", status);
+		sm->ended = true;
+	}
+	return;
+
+fail:
+	while (nfds > 0) {
+		close(fds[--nfds]);
+	}
+	if (answer) {
+		pthread_mutex_lock(&ports_lock);
+		sm->ringing = true;
+		pthread_mutex_unlock(&ports_lock);
+	} else if (dial) {
+		sm->ended = true;
+		return;
+	}
+	agent_drop(sm);
+}
+
+/* fds as the flags say; G.711 is a socket format, one law, no rings */
+static bool agent_req_valid(const struct modem_agent_req *req, int nfds) {
+	unsigned law = req->flags & (MODEM_AGENT_ULAW|MODEM_AGENT_ALAW);
+
+	if (req->flags & ~(MODEM_AGENT_SHM|MODEM_AGENT_ULAW|MODEM_AGENT_ALAW)) {
+		return false;
+	}
+	if (law == (MODEM_AGENT_ULAW|MODEM_AGENT_ALAW) || (law && nfds)) {
+		return false;
+	}
+	return nfds == (req->flags & MODEM_AGENT_SHM ? 2 : 0);
+}
+
+/* idle or ringing connection: a request, or EOF */
+static void agent_read(struct dmodem *sm) {
+	struct modem_agent_req req;
+	int fds[MODEM_AGENT_MAX_FDS];
+	int nfds;
+
+	if (modem_agent_recv(sm->sock, &req, fds, &nfds) < 0 ||
+			!agent_req_valid(&req, nfds)) {
+		while (nfds > 0) {
+			close(fds[--nfds]);
+		}
+		agent_drop(sm);
+		return;
+	}
+	agent_request(sm, &req, fds, nfds);
+}
+
+/* a new connection from slmodemd: an idle modem, or a call out.  Its
+   request is read when it comes, the loop never waits on one peer */
+static void agent_accept(int lfd) {
+	int fd;
+
+	fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC|SOCK_NONBLOCK);
+	if (fd < 0) {
+		return;
+	}
+	if (npending == DMODEM_MAX_CALLS) {
+		PJ_LOG(2,(__FILE__, "too many connections without a request"));
+		close(fd);
+		return;
+	}
+	pending[npending].fd = fd;
+	pending[npending++].since = now_ms();
+}
+
+/* drop pending connections that said nothing in time; returns the ms
+   to the next one due, or -1 */
+static int pending_timers(void) {
+	uint64_t now = now_ms();
+	int timeout = -1;
+
+	for (unsigned i = 0; i < npending; ) {
+		uint64_t due = pending[i].since + ACCEPT_TIMEOUT;
+		if (now >= due) {
+			PJ_LOG(2,(__FILE__, "no request from slmodemd"));
+			close(pending[i].fd);
+			pending[i] = pending[--npending];
+			continue;
+		}
+		if (timeout < 0 || (int)(due - now) < timeout) {
+			timeout = due - now;
+		}
+		i++;
+	}
+	return timeout;
+}
+
+/* the first request on a pending connection is readable: LISTEN
+   parks it on a free port, DIAL starts the call */
+static void agent_first_request(int fd) {
+	struct modem_agent_req req;
+	int fds[MODEM_AGENT_MAX_FDS];
+	struct dmodem *sm;
+	int nfds;
+
+	for (unsigned i = 0; i < npending; i++) {
+		if (pending[i].fd == fd) {
+			pending[i] = pending[--npending];
+			break;
+		}
+	}
+	if (modem_agent_recv(fd, &req, fds, &nfds) < 0 ||
+			(req.cmd != MODEM_AGENT_DIAL && req.cmd != MODEM_AGENT_LISTEN) ||
+			!agent_req_valid(&req, nfds)) {
+		PJ_LOG(2,(__FILE__, "bad request from slmodemd"));
+		goto reject;
+	}
+	sm = port_claim();
+	if (!sm) {
+		PJ_LOG(2,(__FILE__, "all %u channels busy, refusing %s %s",
+			max_calls, req.cmd == MODEM_AGENT_DIAL ? "call to" :
+			"modem", req.dial));
+		goto reject;
+	}
+	sm->sock = fd;
+	if (req.cmd == MODEM_AGENT_DIAL) {
+		agent_request(sm, &req, fds, nfds);
+		return;
+	}
+	PJ_LOG(4,(__FILE__, "%s: modem %s listening", sm->name, req.dial));
+	pthread_mutex_lock(&ports_lock);
+	sm->listening = true;
+	pthread_mutex_unlock(&ports_lock);
+	return;
+
+reject:
+	while (nfds > 0) {
+		close(fds[--nfds]);
+	}
+	close(fd);
+}
+
+/* RING again on every connection whose call still waits for an answer;
+   returns the ms to the next one due, or -1 */
+static int ring_timers(void) {
+	uint64_t now = now_ms();
+	int timeout = -1;
+
+	pthread_mutex_lock(&ports_lock);
+	for (unsigned i = 0; i < max_calls; i++) {
+		struct dmodem *sm = &ports[i];
+		if (!sm->ringing) {
+			continue;
+		}
+		if (now >= sm->next_ring) {
+			ring_send(sm);
+		}
+		if (timeout < 0 || (int)(sm->next_ring - now) < timeout) {
+			timeout = sm->next_ring - now;
+		}
+	}
+	pthread_mutex_unlock(&ports_lock);
+	return timeout;
+}
+
+/* Everything that touches the calls' descriptors happens here: the clock
+ * and SIP threads only flag a port and wake us. Idle connections are read
+ * for requests; the sockets of calls are watched for the other side going
+ * away, which the shared memory transport would otherwise never notice. */
+static void main_loop(int lfd) {
+	struct pollfd pfd[2 + 2*DMODEM_MAX_CALLS];
+	struct dmodem *pfd_port[2 + 2*DMODEM_MAX_CALLS];
+	char tmp[64];
+	int n, timeout, t;
+
+	for (;;) {
+		timeout = ring_timers();
+		t = pending_timers();
+		if (t >= 0 && (timeout < 0 || t < timeout)) {
+			timeout = t;
+		}
+		n = 0;
+		pfd[n].fd = wake_pipe[0];
+		pfd[n++].events = POLLIN;
+		if (lfd >= 0) {
+			pfd[n].fd = lfd;
+			pfd[n++].events = POLLIN;
+		}
+		for (unsigned i = 0; i < npending; i++) {
+			pfd_port[n] = NULL;
+			pfd[n].fd = pending[i].fd;
+			pfd[n++].events = POLLIN;
+		}
+		for (unsigned i = 0; i < max_calls; i++) {
+			struct dmodem *sm = &ports[i];
+			if (sm->active && !sm->failed && !sm->ended) {
+				pfd_port[n] = sm;
+				pfd[n].fd = sm->sock;
+				pfd[n++].events = sm->listening || sm->ringing ?
+						POLLIN : POLLRDHUP;
+			}
+		}
+		if (poll(pfd, n, timeout) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error_exit("poll", PJ_RETURN_OS_ERROR(errno));
+		}
+		for (int i = 0; i < n; i++) {
+			if (!pfd[i].revents) {
+				continue;
+			}
+			if (pfd[i].fd == wake_pipe[0]) {
+				while (read(wake_pipe[0], tmp, sizeof(tmp)) > 0);
+			} else if (pfd[i].fd == lfd) {
+				agent_accept(lfd);
+			} else if (!pfd_port[i]) {
+				agent_first_request(pfd[i].fd);
+			} else if (pfd[i].events == POLLIN) {
+				agent_read(pfd_port[i]);
+			} else {
+				dmodem_fail(pfd_port[i], "modem socket closed");
+			}
+		}
+		for (unsigned i = 0; i < max_calls; i++) {
+			struct dmodem *sm = &ports[i];
+			if (!sm->active) {
+				continue;
+			}
+			if (sm->ended) {
+				port_close(sm);
+			} else if (sm->failed && !sm->hangup &&
+					sm->call_id != PJSUA_INVALID_ID) {
+				sm->hangup = true;
+				pjsua_call_hangup(sm->call_id, 0, NULL, NULL);
+			}
+		}
 	}
 }
 
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s <dialstr> <sock> [<shm_fd> <event_fd>]\n"
+		"       %s -l <socket path>\n", prog, prog);
+	exit(-1);
+}
 
 int main(int argc, char *argv[]) {
-	pjsua_acc_id acc_id;
 	pj_status_t status;
+	char *dialstr = NULL;
+	int lfd = -1;
 
-	if (argc != 3) {
-		return -1;
+	if (argc == 3 && !strcmp(argv[1], "-l")) {
+		agent = true;
+		max_calls = DMODEM_MAX_CALLS;
+	} else if (argc == 3 || argc == 5) {
+		dialstr = argv[1];
+	} else {
+		usage(argv[0]);
 	}
 
 	signal(SIGPIPE,SIG_IGN);
 
-	char *dialstr = argv[1];
+	/* slmodemd passes its DSP cycle, S93, when it is not the default */
+	char *ptime_env = getenv("DMODEM_PTIME");
+	if (ptime_env) {
+		ptime = atoi(ptime_env);
+		if (ptime < 5 || ptime > PTIME_MAX || ptime % 5) {
+			return -1;
+		}
+		frame_samples = MODEM_RATE*ptime/1000;
+	}
 
 	char *sip_user = getenv("SIP_LOGIN");
 	if (!sip_user) {
 		return -1;
 	}
-	char *sip_domain = strchr(sip_user,'@');
+	sip_domain = strchr(sip_user,'@');
 	if (!sip_domain) {
 		return -1;
 	}
@@ -150,6 +1290,10 @@ int main(int argc, char *argv[]) {
 	}
 	*sip_pass++ = '\0';
 
+	if (pipe2(wake_pipe, O_CLOEXEC|O_NONBLOCK) < 0) {
+		return -1;
+	}
+
 	status = pjsua_create();
 	if (status != PJ_SUCCESS) error_exit("Error in pjsua_create()", status);
 
@@ -162,6 +1306,13 @@ int main(int argc, char *argv[]) {
 		pjsua_config_default(&cfg);
 		cfg.cb.on_call_media_state = &on_call_media_state;
 		cfg.cb.on_call_state = &on_call_state;
+		cfg.cb.on_stream_created2 = &on_stream_created2;
+		cfg.cb.on_stream_destroyed = &on_stream_destroyed;
+		cfg.max_calls = max_calls;
+		if (agent) {
+			cfg.cb.on_incoming_call = &on_incoming_call;
+			cfg.cb.on_reg_state2 = &on_reg_state2;
+		}
 
 		pjsua_logging_config_default(&log_cfg);
 		log_cfg.console_level = 4;
@@ -171,7 +1322,17 @@ int main(int argc, char *argv[]) {
 		med_cfg.ec_tail_len = 0;
 		med_cfg.jb_max = 2000;
 //		med_cfg.jb_init = 200;
-		med_cfg.audio_frame_ptime = 5;
+		/* fixed delay, no discard, no PLC */
+		med_cfg.jb_modem = PJ_TRUE;
+		char *jb_delay = getenv("DMODEM_JB_DELAY");
+		if (jb_delay) {
+			med_cfg.jb_init = atoi(jb_delay);
+		}
+		med_cfg.audio_frame_ptime = ptime;
+		/* a stream and a modem port per call, and the master port */
+		if (med_cfg.max_media_ports < 2*max_calls + 1) {
+			med_cfg.max_media_ports = 2*max_calls + 1;
+		}
 
 		status = pjsua_init(&cfg, &log_cfg, &med_cfg);
 		if (status != PJ_SUCCESS) error_exit("Error in pjsua_init()", status);
@@ -205,35 +1366,59 @@ int main(int argc, char *argv[]) {
 		if (status != PJ_SUCCESS) error_exit("Error creating transport", status);
 	}
 
-	pj_caching_pool cp;
 	pj_caching_pool_init(&cp, NULL, 1024*1024);
 	pool = pj_pool_create(&cp.factory, "pool1", 4000, 4000, NULL);
 
-	pj_str_t name = pj_str("dmodem");
-	
-	memset(&port,0,sizeof(port));
-	port.sock = atoi(argv[2]); // inherited from parent
-	pjmedia_port_info_init(&port.base.info, &name, SIGNATURE, 9600, 1, 16, 192);
-	port.base.put_frame = dmodem_put_frame;
-	port.base.get_frame = dmodem_get_frame;
-	port.base.on_destroy = dmodem_on_destroy;
-
-	char buf[384];
-	memset(buf,0,sizeof(buf));
-	write(port.sock, buf, sizeof(buf));
+	enum underrun_fill fill = FILL_ZERO;
+	char *fill_env = getenv("DMODEM_UNDERRUN");
+	if (fill_env && !strcmp(fill_env, "repeat")) {
+		fill = FILL_REPEAT;
+	} else if (fill_env && strcmp(fill_env, "zero") && strcmp(fill_env, "silence")) {
+		return -1;
+	}
+	/* exec mode: slmodemd --law, see agent_req_valid() for -l */
+	unsigned law = 0;
+	char *law_env = getenv("DMODEM_LAW");
+	if (law_env && !strcmp(law_env, "ulaw")) {
+		law = MODEM_AGENT_ULAW;
+	} else if (law_env && !strcmp(law_env, "alaw")) {
+		law = MODEM_AGENT_ALAW;
+	} else if (law_env) {
+		return -1;
+	}
+	for (unsigned i = 0; i < max_calls; i++) {
+		if (port_init(&ports[i], i, fill, getenv("DMODEM_DIRECT") != NULL) < 0) {
+			return -1;
+		}
+	}
+
+	if (agent) {
+		lfd = agent_listen(argv[2]);
+		if (lfd < 0) {
+			error_exit("Error creating control socket", 0);
+		}
+	} else if (port_open(port_claim(), atoi(argv[2]), // inherited from parent
+			argc == 5 ? atoi(argv[3]) : -1, // shared memory rings
+			argc == 5 ? atoi(argv[4]) : -1, // and doorbell
+			law) < 0) {
+		error_exit("error mapping shared audio rings",0);
+	}
 
 	/* Initialization is done, now start pjsua */
 	status = pjsua_start();
 	if (status != PJ_SUCCESS) error_exit("Error starting pjsua", status);
 
 	{
+		char buf[256];
 		pjsua_acc_config cfg;
 		pjsua_acc_config_default(&cfg);
 		snprintf(buf,sizeof(buf),"sip:%s@%s",sip_user,sip_domain);
 		pj_strdup2(pool,&cfg.id,buf);
 		snprintf(buf,sizeof(buf),"sip:%s",sip_domain);
 		pj_strdup2(pool,&cfg.reg_uri,buf);
-		cfg.register_on_acc_add = false;
+		/* -l takes incoming calls: registered for as long as it runs,
+		   pjsua refreshes it and retries after failures */
+		cfg.register_on_acc_add = agent;
 		cfg.cred_count = 1;
 		cfg.cred_info[0].realm = pj_str("*");
 		cfg.cred_info[0].scheme = pj_str("digest");
@@ -245,18 +1430,12 @@ int main(int argc, char *argv[]) {
 		if (status != PJ_SUCCESS) error_exit("Error adding account", status);
 	}
 
-	snprintf(buf,sizeof(buf),"sip:%s@%s",dialstr,sip_domain);
-	printf("calling %s\n",buf);
-	pj_str_t uri = pj_str(buf);
-	
-	pjsua_call_id callid;
-	status = pjsua_call_make_call(acc_id, &uri, 0, NULL, NULL, &callid);
-	if (status != PJ_SUCCESS) error_exit("Error making call", status);
-
-	struct timespec ts = {100, 0};
-	while(1) {
-		nanosleep(&ts,NULL);
+	if (!agent) {
+		status = call_start(&ports[0], dialstr);
+		if (status != PJ_SUCCESS) error_exit("Error making call", status);
 	}
 
+	main_loop(lfd);
+
 	return 0;
 }
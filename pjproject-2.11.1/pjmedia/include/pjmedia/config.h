@@ -1493,6 +1493,31 @@
 #endif
 
 
+/**
+ * Default target delay of the jitter buffer in modem passthrough mode
+ * (see #pjmedia_jbuf_set_modem()), in milliseconds. Used when the stream
+ * does not specify an initial delay.
+ *
+ * Default: 60 ms
+ */
+#ifndef PJMEDIA_JBUF_MODEM_INIT_DELAY
+#   define PJMEDIA_JBUF_MODEM_INIT_DELAY	    60
+#endif
+
+
+/**
+ * Interval between two sample slips of the jitter buffer in modem
+ * passthrough mode, in milliseconds. This limits the clock skew that can
+ * be absorbed to one sample per interval, e.g: 250 ppm at 8 kHz with the
+ * default value.
+ *
+ * Default: 500 ms
+ */
+#ifndef PJMEDIA_JBUF_MODEM_SLIP_PERIOD
+#   define PJMEDIA_JBUF_MODEM_SLIP_PERIOD	    500
+#endif
+
+
 /**
  * Reset jitter buffer and return silent audio on stream playback start
  * (first get_frame()). This is useful to avoid possible noise that may be
@@ -118,6 +118,8 @@ typedef struct pjmedia_jb_state
     unsigned	lost;		    /**< Number of lost frames.		    */
     unsigned	discard;	    /**< Number of discarded frames.	    */
     unsigned	empty;		    /**< Number of empty on GET events.	    */
+    unsigned	slip_del;	    /**< Samples deleted by modem mode slip.*/
+    unsigned	slip_ins;	    /**< Samples inserted by modem mode slip*/
 } pjmedia_jb_state;
 
 
@@ -193,6 +195,40 @@ PJ_DECL(pj_status_t) pjmedia_jbuf_set_fixed( pjmedia_jbuf *jb,
 					     unsigned prefetch);
 
 
+/**
+ * Set the jitter buffer to modem/fax passthrough mode. Like the fixed
+ * mode, the jitter buffer keeps a constant target delay and never
+ * discards frames to adjust its latency. In addition it watches the
+ * average fill level, and when it drifts away from the target by a frame,
+ * asks the consumer to slip a single sample once every
+ * PJMEDIA_JBUF_MODEM_SLIP_PERIOD msec (see #pjmedia_jbuf_get_slip()).
+ * The consumer should also disable packet loss concealment, as any
+ * synthesized audio is noise to a modem.
+ *
+ * @param jb		The jitter buffer
+ * @param prefetch	The target delay value, in number of frames.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_jbuf_set_modem( pjmedia_jbuf *jb,
+					     unsigned prefetch);
+
+
+/**
+ * Get the pending sample slip of a jitter buffer in modem passthrough
+ * mode, and account it as done. The consumer should apply it to the
+ * decoded audio of the next frame.
+ *
+ * @param jb		The jitter buffer.
+ *
+ * @return		Positive value when the consumer should delete that
+ *			many samples (the buffer is filling up), negative
+ *			when it should insert samples, zero otherwise or
+ *			when the jitter buffer is not in modem mode.
+ */
+PJ_DECL(int) pjmedia_jbuf_get_slip(pjmedia_jbuf *jb);
+
+
 /**
  * Set the jitter buffer to adaptive mode.
  *
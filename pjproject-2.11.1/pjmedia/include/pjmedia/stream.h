@@ -140,6 +140,9 @@ typedef struct pjmedia_stream_info
     int			jb_max;	    /**< Jitter buffer max delay in msec.   */
     pjmedia_jb_discard_algo jb_discard_algo;
                                     /**< Jitter buffer discard algorithm.   */
+    pj_bool_t		jb_modem;   /**< Modem/fax passthrough jitter buffer
+					 (see #pjmedia_jbuf_set_modem()),
+					 also disables PLC.		    */
 
 #if defined(PJMEDIA_STREAM_ENABLE_KA) && PJMEDIA_STREAM_ENABLE_KA!=0
     pj_bool_t		use_ka;	    /**< Stream keep-alive and NAT hole punch
@@ -138,6 +138,12 @@ struct pjmedia_jbuf
     int		    jb_init_cycle_cnt;	/**< status is 'init' until the	first
 					     'put' operation		    */
 
+    pj_bool_t	    jb_modem;		/**< Modem passthrough mode	    */
+    unsigned	    jb_slip_period;	/**< GETs between slip decisions    */
+    unsigned	    jb_slip_cnt;	/**< GETs in the current period	    */
+    unsigned	    jb_slip_sum;	/**< Sum of levels in the period    */
+    int		    jb_slip;		/**< Pending slip, >0 delete	    */
+
     int		    jb_discard_ref;	/**< Seq # of last frame deleted or
 					     discarded			    */
     unsigned	    jb_discard_dist;	/**< Distance from jb_discard_ref
@@ -151,6 +157,8 @@ struct pjmedia_jbuf
     unsigned	    jb_discard;		/**< Number of discarded frames.    */
     unsigned	    jb_empty;		/**< Number of empty/prefetching frame
 					     returned by GET. */
+    unsigned	    jb_slip_del;	/**< Number of samples deleted.	    */
+    unsigned	    jb_slip_ins;	/**< Number of samples inserted.    */
 };
 
 
@@ -636,6 +644,7 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_set_ptime( pjmedia_jbuf *jb,
     jb->jb_min_shrink_gap = PJMEDIA_JBUF_DISC_MIN_GAP / ptime;
     jb->jb_max_burst	  = PJ_MAX(MAX_BURST_MSEC / ptime,
     				   jb->jb_max_count*3/4);
+    jb->jb_slip_period	  = PJ_MAX(PJMEDIA_JBUF_MODEM_SLIP_PERIOD / ptime, 1);
 
     return PJ_SUCCESS;
 }
@@ -660,6 +669,44 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_set_fixed( pjmedia_jbuf *jb,
 }
 
 
+/*
+ * Set the jitter buffer to modem passthrough mode: fixed delay, no
+ * discard, clock skew absorbed by slow sample slip.
+ */
+PJ_DEF(pj_status_t) pjmedia_jbuf_set_modem( pjmedia_jbuf *jb,
+					    unsigned prefetch)
+{
+    pj_status_t status;
+
+    status = pjmedia_jbuf_set_fixed(jb, prefetch);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    jb->jb_modem = PJ_TRUE;
+    jb->jb_slip_period = PJ_MAX(PJMEDIA_JBUF_MODEM_SLIP_PERIOD /
+				jb->jb_frame_ptime, 1);
+    jb->jb_slip_cnt = jb->jb_slip_sum = 0;
+    jb->jb_slip = 0;
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(int) pjmedia_jbuf_get_slip(pjmedia_jbuf *jb)
+{
+    int slip;
+
+    PJ_ASSERT_RETURN(jb, 0);
+
+    slip = jb->jb_slip;
+    jb->jb_slip = 0;
+    if (slip > 0)
+	jb->jb_slip_del += slip;
+    else
+	jb->jb_slip_ins += -slip;
+    return slip;
+}
+
+
 /*
  * Set the jitter buffer to adaptive mode.
  */
@@ -716,6 +763,9 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_reset(pjmedia_jbuf *jb)
     jb->jb_max_hist_level= 0;
     jb->jb_prefetching   = (jb->jb_prefetch != 0);
     jb->jb_discard_dist  = 0;
+    jb->jb_slip_cnt	 = 0;
+    jb->jb_slip_sum	 = 0;
+    jb->jb_slip		 = 0;
 
     jb_framelist_reset(&jb->jb_framelist);
 
@@ -730,7 +780,7 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_destroy(pjmedia_jbuf *jb)
 	       "  size=%d/eff=%d prefetch=%d level=%d\n"
 	       "  delay (min/max/avg/dev)=%d/%d/%d/%d ms\n"
 	       "  burst (min/max/avg/dev)=%d/%d/%d/%d frames\n"
-	       "  lost=%d discard=%d empty=%d",
+	       "  lost=%d discard=%d empty=%d slip=-%d/+%d",
 	       jb_framelist_size(&jb->jb_framelist),
 	       jb_framelist_eff_size(&jb->jb_framelist),
 	       jb->jb_prefetch, jb->jb_eff_level,
@@ -738,7 +788,8 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_destroy(pjmedia_jbuf *jb)
 	       pj_math_stat_get_stddev(&jb->jb_delay),
 	       jb->jb_burst.min, jb->jb_burst.max, jb->jb_burst.mean,
 	       pj_math_stat_get_stddev(&jb->jb_burst),
-	       jb->jb_lost, jb->jb_discard, jb->jb_empty));
+	       jb->jb_lost, jb->jb_discard, jb->jb_empty,
+	       jb->jb_slip_del, jb->jb_slip_ins));
 
     return jb_framelist_destroy(&jb->jb_framelist);
 }
@@ -955,6 +1006,32 @@ static void jbuf_discard_progressive(pjmedia_jbuf *jb)
 }
 
 
+/* Modem mode: average the level seen by GET over a slip period and ask
+ * for one sample of slip when it is a frame off the target. Right after
+ * a GET the level of a buffer on target is prefetch-1.
+ */
+static void jbuf_modem_slip(pjmedia_jbuf *jb)
+{
+    int avg4, target4;
+
+    jb->jb_slip_sum += jb_framelist_eff_size(&jb->jb_framelist);
+    if (++jb->jb_slip_cnt < jb->jb_slip_period)
+	return;
+
+    avg4 = jb->jb_slip_sum * 4 / jb->jb_slip_cnt;
+    target4 = (jb->jb_prefetch - 1) * 4;
+    if (avg4 >= target4 + 4)
+	jb->jb_slip = 1;
+    else if (jb->jb_prefetch > 1 && avg4 <= target4 - 4)
+	jb->jb_slip = -1;
+
+    TRACE__((jb->jb_name.ptr, "Modem slip: level=%d.%02d target=%d slip=%d",
+	     avg4 / 4, avg4 % 4 * 25, jb->jb_prefetch - 1, jb->jb_slip));
+
+    jb->jb_slip_cnt = jb->jb_slip_sum = 0;
+}
+
+
 PJ_INLINE(void) jbuf_update(pjmedia_jbuf *jb, int oper)
 {
     if(jb->jb_last_op != oper) {
@@ -1148,6 +1225,8 @@ PJ_DEF(void) pjmedia_jbuf_get_frame3(pjmedia_jbuf *jb,
 	     */
 	    if (ftype == PJMEDIA_JB_NORMAL_FRAME) {
 		*p_frame_type = PJMEDIA_JB_NORMAL_FRAME;
+		if (jb->jb_modem)
+		    jbuf_modem_slip(jb);
 	    } else {
 		*p_frame_type = PJMEDIA_JB_MISSING_FRAME;
 		jb->jb_lost++;
@@ -1206,6 +1285,8 @@ PJ_DEF(pj_status_t) pjmedia_jbuf_get_state( const pjmedia_jbuf *jb,
     state->empty = jb->jb_empty;
     state->discard = jb->jb_discard;
     state->lost = jb->jb_lost;
+    state->slip_del = jb->jb_slip_del;
+    state->slip_ins = jb->jb_slip_ins;
 
     return PJ_SUCCESS;
 }
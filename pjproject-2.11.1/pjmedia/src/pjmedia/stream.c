@@ -509,6 +509,32 @@ static void send_keep_alive_packet(pjmedia_stream *stream)
 }
 #endif	/* defined(PJMEDIA_STREAM_ENABLE_KA) */
 
+/* Apply the jitter buffer's pending sample slip to the frame just decoded
+ * into dec_buf (modem passthrough mode). The slipped sample is replaced by
+ * the mean of its neighbours to keep the waveform continuous.
+ */
+static void apply_modem_slip(pjmedia_stream *stream)
+{
+    pj_int16_t *buf = stream->dec_buf;
+    unsigned count = stream->dec_buf_count;
+    unsigned mid = count / 2;
+    int slip;
+
+    if (count < 2)
+	return;
+
+    slip = pjmedia_jbuf_get_slip(stream->jb);
+    if (slip > 0) {
+	buf[mid-1] = (pj_int16_t)((buf[mid-1] + buf[mid]) / 2);
+	pjmedia_move_samples(buf + mid, buf + mid + 1, count - mid - 1);
+	stream->dec_buf_count--;
+    } else if (slip < 0 && count < stream->dec_buf_size) {
+	pjmedia_move_samples(buf + mid + 1, buf + mid, count - mid);
+	buf[mid] = (pj_int16_t)((buf[mid-1] + buf[mid+1]) / 2);
+	stream->dec_buf_count++;
+    }
+}
+
 /*
  * play_callback()
  *
@@ -586,8 +612,17 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
 
 	if (frame_type == PJMEDIA_JB_MISSING_FRAME) {
 
-	    /* Activate PLC */
-	    if (stream->codec->op->recover &&
+	    /* Modem passthrough: the lost frame is a whole frame of
+	     * silence in dec_buf, so its time is kept; what does not fit
+	     * behind a slipped frame's rest carries over to the next
+	     * get_frame(), as with a decoded frame. Otherwise activate PLC.
+	     */
+	    if (stream->si.jb_modem) {
+		stream->dec_buf_pos = 0;
+		stream->dec_buf_count = samples_per_frame;
+		pjmedia_zero_samples(stream->dec_buf, samples_per_frame);
+		status = -1;
+	    } else if (stream->codec->op->recover &&
 		stream->codec_param.setting.plc &&
 		stream->plc_cnt < stream->max_plc_cnt)
 	    {
@@ -605,7 +640,7 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
 		status = -1;
 	    }
 
-	    if (status != PJ_SUCCESS) {
+	    if (status != PJ_SUCCESS && !stream->si.jb_modem) {
 		/* Either PLC failed or PLC not supported/enabled */
 		pjmedia_zero_samples(p_out_samp + samples_count,
 				     samples_required - samples_count);
@@ -622,7 +657,8 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
 		stream->jb_last_frm_cnt++;
 	    }
 
-	    samples_count += samples_per_frame;
+	    if (!stream->si.jb_modem)
+		samples_count += samples_per_frame;
 	} else if (frame_type == PJMEDIA_JB_ZERO_EMPTY_FRAME) {
 
 	    const char *with_plc = "";
@@ -752,7 +788,15 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
 
 	    frame_out.buf = p_out_samp + samples_count;
 	    frame_out.size = frame->size - samples_count*BYTES_PER_SAMPLE;
-	    if (stream->dec_buf &&
+	    if (stream->si.jb_modem) {
+		/* Decode via dec_buf, where the frame can be slipped */
+	    	stream->dec_buf_pos = 0;
+	    	stream->dec_buf_count = samples_per_frame;
+
+	    	use_dec_buf = PJ_TRUE;
+	    	frame_out.buf = stream->dec_buf;
+	    	frame_out.size = stream->dec_buf_size * BYTES_PER_SAMPLE;
+	    } else if (stream->dec_buf &&
 	    	bit_info * sizeof(pj_int16_t) > frame_out.size)
 	    {
 	    	stream->dec_buf_pos = 0;
@@ -771,14 +815,16 @@ static pj_status_t get_frame( pjmedia_port *port, pjmedia_frame *frame)
 			 "codec decode() error"));
 
 		if (use_dec_buf) {
-		    pjmedia_zero_samples(p_out_samp + samples_count,
-				     	 samples_per_frame);
-		} else {
 		    pjmedia_zero_samples(stream->dec_buf,
 				     	 stream->dec_buf_count);
+		} else {
+		    pjmedia_zero_samples(p_out_samp + samples_count,
+				     	 samples_per_frame);
 		}
 	    } else if (use_dec_buf) {
 	    	stream->dec_buf_count = frame_out.size / sizeof(pj_int16_t);
+		if (stream->si.jb_modem)
+		    apply_modem_slip(stream);
 	    }
 
 	    if (stream->jb_last_frm != frame_type) {
@@ -2522,6 +2568,21 @@ PJ_DEF(pj_status_t) pjmedia_stream_create( pjmedia_endpt *endpt,
 			    	      		     sizeof(pj_int16_t));
     }
 
+    /* Modem passthrough: synthesized audio is garbage to a modem, so no
+     * PLC, and decode through dec_buf, which absorbs the sample slips.
+     */
+    if (info->jb_modem) {
+	stream->codec_param.setting.plc = 0;
+	if (!stream->dec_buf) {
+	    stream->dec_buf_size = stream->codec_param.info.clock_rate *
+				   stream->codec_param.info.channel_cnt *
+				   120 / 1000;
+	    stream->dec_buf = (pj_int16_t*)pj_pool_alloc(pool,
+						 stream->dec_buf_size *
+						 sizeof(pj_int16_t));
+	}
+    }
+
     status = pjmedia_codec_open(stream->codec, &stream->codec_param);
     if (status != PJ_SUCCESS)
 	goto err_cleanup;
@@ -2697,8 +2758,18 @@ PJ_DEF(pj_status_t) pjmedia_stream_create( pjmedia_endpt *endpt,
 
 
     /* Set up jitter buffer */
-    pjmedia_jbuf_set_adaptive( stream->jb, jb_init, jb_min_pre, jb_max_pre);
-    pjmedia_jbuf_set_discard(stream->jb, info->jb_discard_algo);
+    if (info->jb_modem) {
+	if (jb_init == 0)
+	    jb_init = PJ_MAX(PJMEDIA_JBUF_MODEM_INIT_DELAY /
+			     stream->codec_param.info.frm_ptime, 1);
+	if (jb_init > jb_max)
+	    jb_init = jb_max;
+	pjmedia_jbuf_set_modem(stream->jb, jb_init);
+    } else {
+	pjmedia_jbuf_set_adaptive( stream->jb, jb_init, jb_min_pre,
+				   jb_max_pre);
+	pjmedia_jbuf_set_discard(stream->jb, info->jb_discard_algo);
+    }
 
     /* Create decoder channel: */
 
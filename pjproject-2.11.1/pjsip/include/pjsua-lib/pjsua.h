@@ -6813,6 +6813,17 @@ struct pjsua_media_config
      */
     pjmedia_jb_discard_algo jb_discard_algo;
 
+    /**
+     * Use the modem/fax passthrough jitter buffer policy for audio streams:
+     * fixed delay of jb_init msec (or PJMEDIA_JBUF_MODEM_INIT_DELAY), no
+     * frame discard, clock skew absorbed by slow sample slip, and no
+     * packet loss concealment. jb_min_pre, jb_max_pre and jb_discard_algo
+     * are ignored. See #pjmedia_jbuf_set_modem().
+     *
+     * Default: PJ_FALSE
+     */
+    pj_bool_t		jb_modem;
+
     /**
      * Enable ICE
      */
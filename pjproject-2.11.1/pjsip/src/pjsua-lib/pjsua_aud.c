@@ -653,6 +653,7 @@ pj_status_t pjsua_aud_channel_update(pjsua_call_media *call_med,
 	si->jb_max_pre = pjsua_var.media_cfg.jb_max_pre;
 	si->jb_max = pjsua_var.media_cfg.jb_max;
         si->jb_discard_algo = pjsua_var.media_cfg.jb_discard_algo;
+	si->jb_modem = pjsua_var.media_cfg.jb_modem;
 
 	/* Set SSRC and CNAME */
 	si->ssrc = call_med->ssrc;
@@ -687,6 +688,7 @@ pj_status_t pjsua_aud_channel_update(pjsua_call_media *call_med,
             si->jb_max_pre = prm.stream_info.info.aud.jb_max_pre;
             si->jb_max = prm.stream_info.info.aud.jb_max;
             si->jb_discard_algo = prm.stream_info.info.aud.jb_discard_algo;
+            si->jb_modem = prm.stream_info.info.aud.jb_modem;
 #if defined(PJMEDIA_STREAM_ENABLE_KA) && (PJMEDIA_STREAM_ENABLE_KA != 0)
             si->use_ka = prm.stream_info.info.aud.use_ka;
 #endif
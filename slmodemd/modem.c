@@ -47,6 +47,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <termios.h>
 #include <sys/ioctl.h>
 
@@ -55,6 +56,7 @@
 
 
 #define XMIT_SIZE 4096
+#define RECV_SIZE 4096
 
 #define MODEM_AUTHOR "Smart Link Ltd."
 #define MODEM_NAME "SmartLink Soft Modem"
@@ -120,6 +122,7 @@ static int modem_fax_start(struct modem *m);
 
 /* global config data */
 const char *modem_default_country = NULL;
+unsigned int modem_cycle_time = MODEM_CYCLE_TIME;
 
 
 /* data definitions */
@@ -155,6 +158,7 @@ const char modem_date[]   = MODEM_DATE;
 #define MODEM_EC_ENABLE(m)    ((m)->sregs[SREG_EC])
 #define MODEM_EC_DETECTOR(m)  ((m)->sregs[SREG_EC])
 #define MODEM_COMP_ENABLE(m)  ((m)->sregs[SREG_COMP]&&MODEM_EC_ENABLE(m))
+#define MODEM_COMP_SLZ(m)     ((m)->sregs[SREG_COMP_SLZ])
 #define ESCAPE_TIMEOUT(m)     (MODEM_HZ/2)
 #define ANSWER_DELAY(m)       ((m)->sregs[SREG_ANS_DELAY])
 #define SPEAKER_CONTROL(m)    ((m)->sregs[SREG_SPEAKER_CONTROL])
@@ -294,7 +298,8 @@ static void modem_report_result(struct modem *m, enum MODEM_RESULT code)
 			}
 			if((msg_mask&3) == 3) {
 				modem_put_chars(m,"Compression: ",13);
-				msg = (m->cfg.ec && m->cfg.comp)? "V42bis" : none_str;
+				msg = !(m->cfg.ec && m->cfg.comp) ? none_str :
+					m->cfg.comp_slz ? "SLZ" : "V42bis";
 				modem_put_chars(m,msg,strlen(msg));
 				modem_put_chars(m,CRLF_CHARS(m),2);
 			}
@@ -482,6 +487,8 @@ void modem_update_status(struct modem *m, unsigned status)
 		break;
 	case STATUS_DP_LINK:
 		MODEM_DBG("--> DP LINK\n");
+		m->stats.dp_id = m->dp->id;
+		m->stats.links++;
 		if(NONEC_DP(m->dp->id))
 			m->cfg.ec = 0;
 		modem_set_state(m,STATE_EC_ESTAB);
@@ -524,6 +531,7 @@ void modem_update_status(struct modem *m, unsigned status)
 	case STATUS_EC_RELEASE:
 	case STATUS_EC_ERROR:
 		MODEM_DBG("--> EC UNLINK\n");
+		m->stats.last_status = status;
 		m->result_code = RESULT_NOCARRIER;
 		modem_hup(m,(m->state == STATE_EC_DISC));
 		break;
@@ -535,6 +543,7 @@ void modem_update_status(struct modem *m, unsigned status)
 	case STATUS_NOANSWER:
 	default:
 		MODEM_DBG("--> FINISH.\n");
+		m->stats.last_status = status;
 		if(status == STATUS_NODIALTONE)
 			m->result_code = RESULT_NODIALTONE;
 		else if(status == STATUS_BUSY)
@@ -561,14 +570,30 @@ void modem_update_config(struct modem *m, struct modem_config *cfg)
 	PRINT_CONFIG(ec_rx_win_size);
 	PRINT_CONFIG(ec_tx_info_size);
 	PRINT_CONFIG(ec_rx_info_size);
+	PRINT_CONFIG(ec_srej);
 	PRINT_CONFIG(comp);
 	PRINT_CONFIG(comp_dict_size);
 	PRINT_CONFIG(comp_max_string);
+	PRINT_CONFIG(comp_slz);
+	PRINT_CONFIG(slz_dict_size);
+	PRINT_CONFIG(slz_max_string);
+	PRINT_CONFIG(slz_hist_size);
 #endif
 	// FIXME, FIXME, FIXME !!!
 #if 0	
 	if(cfg->ec) ; /* TBD: now ec reconfig is handled internally in EC */
 #endif
+	/* SLZ when both sides offer it, V42bis otherwise */
+	if(cfg->comp_slz && m->cfg.comp && m->cfg.comp_slz &&
+	   !modem_comp_config_slz(m,cfg->slz_dict_size,
+				  cfg->slz_max_string,cfg->slz_hist_size)) {
+		m->cfg.comp = cfg->comp_slz;
+		m->cfg.slz_dict_size  = cfg->slz_dict_size;
+		m->cfg.slz_max_string = cfg->slz_max_string;
+		m->cfg.slz_hist_size  = cfg->slz_hist_size;
+		return;
+	}
+	m->cfg.comp_slz = 0;
 	if(cfg->comp && m->cfg.comp) {
 		m->cfg.comp = cfg->comp;
 		if(!modem_comp_config(m,cfg->comp_dict_size,
@@ -673,9 +698,11 @@ static void modem_dp_process(struct modem *m,void *in,void *out,int count)
 
 void modem_process(struct modem *m,void *in,void *out,int count)
 {
+	m->recv.defer = 1;
+	/* logged as received: modem_replay feeds it back through here */
+	modem_debug_log_data(m,MODEM_DBG_RX_SAMPLES,in,count<<MFMT_SHIFT(m->format));
 	/* clean DC */
 	dcr_process(m->dcr,in,count);
-	modem_debug_log_data(m,MODEM_DBG_RX_SAMPLES,in,count<<MFMT_SHIFT(m->format));
 	if(m->process)
 		m->process(m,in,out,count);
 	else  /* mute output */
@@ -688,6 +715,8 @@ void modem_process(struct modem *m,void *in,void *out,int count)
 		m->sample_timer_func = NULL;
 		if(f) f(m);
 	}
+	m->recv.defer = 0;
+	modem_flush_chars(m);
 }
 
 
@@ -744,25 +773,7 @@ void modem_event(struct modem *m)
 		}
 		else {
 			MODEM_DBG("ring valid.\n");
-			m->ring_count = 0;
-			TOTAL_RINGS_COUNT(m)++;
-			if(TOTAL_RINGS_COUNT(m) == 1)
-				modem_put_chars(m,CRLF_CHARS(m),2);
-			modem_report_result(m,RESULT_RING);
-			if (ANSWER_AFTER_RINGS(m) &&
-#ifdef MODEM_CONFIG_RING_DETECTOR
-			    (!m->started || m->rd_obj) &&
-#else
-			    !m->started &&
-#endif
-			    TOTAL_RINGS_COUNT(m) >= ANSWER_AFTER_RINGS(m)) {
-				TOTAL_RINGS_COUNT(m) = 0;
-				modem_answer(m);
-			}
-			else {
-				schedule_event(m,MDMEVENT_RING_CHECK,
-					       RING_OFF_MAX(m) + 1);
-			}
+			modem_ring_valid(m);
 		}
 	}
 	if(event&MDMEVENT_ESCAPE) {
@@ -778,6 +789,35 @@ void modem_event(struct modem *m)
 	}
 }
 
+/* one whole ring: report it, answer after S0 of them. Called with
+   rings already known to be real (SIP INVITE), without the cadence check
+   modem_ring() does on the raw indications. */
+void modem_ring_valid(struct modem *m)
+{
+	if (m->state != STATE_MODEM_IDLE)
+		return;
+	m->ring_count = 0;
+	TOTAL_RINGS_COUNT(m)++;
+	if(TOTAL_RINGS_COUNT(m) == 1)
+		modem_put_chars(m,CRLF_CHARS(m),2);
+	modem_report_result(m,RESULT_RING);
+	if (ANSWER_AFTER_RINGS(m) &&
+#ifdef MODEM_CONFIG_RING_DETECTOR
+	    (!m->started || m->rd_obj) &&
+#else
+	    !m->started &&
+#endif
+	    TOTAL_RINGS_COUNT(m) >= ANSWER_AFTER_RINGS(m)) {
+		TOTAL_RINGS_COUNT(m) = 0;
+		modem_answer(m);
+	}
+	else {
+		/* no further ring by then cancels the count */
+		schedule_event(m,MDMEVENT_RING_CHECK,
+			       RING_OFF_MAX(m) + 1);
+	}
+}
+
 void modem_ring(struct modem *m)
 {
 	unsigned long now = get_time();
@@ -920,14 +960,42 @@ static int modem_get_chars(struct modem *m, char *buf, int n)
 	return ret;
 }
 
-/* put chars */
-static int modem_put_chars(struct modem *m, const char *buf, int n)
+/* write queued data to the pty: once per modem_process() cycle, or
+   at once for data produced outside of it (AT responses, etc) */
+void modem_flush_chars(struct modem *m)
 {
-	int ret = write(m->pty,buf,n);
+	int ret;
+	if(!m->recv.count)
+		return;
+	ret = write(m->pty,m->recv.buf,m->recv.count);
 	if(ret < 0) {
-		/* perror("write"); */
-		ret = 0;
+		if(errno == EAGAIN || errno == EINTR)
+			return;
+		/* nobody to read it: drop */
+		ret = m->recv.count;
+	}
+	else
+		m->stats.pty_out += ret;
+	m->recv.count -= ret;
+	if(m->recv.count)
+		memmove(m->recv.buf,m->recv.buf + ret,m->recv.count);
+}
+
+/* put chars: a short count means the pty is full, which makes LAPM
+   enter busy state and send RNR until it drains */
+static int modem_put_chars(struct modem *m, const char *buf, int n)
+{
+	int ret = m->recv.size - m->recv.count;
+	if(ret < n && !m->recv.defer) {
+		modem_flush_chars(m);
+		ret = m->recv.size - m->recv.count;
 	}
+	if(ret > n)
+		ret = n;
+	memcpy(m->recv.buf + m->recv.count,buf,ret);
+	m->recv.count += ret;
+	if(!m->recv.defer)
+		modem_flush_chars(m);
 #if 0
 	if(ret>0) {
 		//MODEM_DBG("modem_comp_put_chars: %d...\n",i);
@@ -938,29 +1006,36 @@ static int modem_put_chars(struct modem *m, const char *buf, int n)
 }
 
 /* compressor get/put chars */
-/* fixme: unify interfaces: modem tx -> comp -> ec -> hdlc -->
-                            modem tx -> ec -> hdlc         -->
-                            modem tx -> async              -->
-			    modem tx --> raw output
+/* data moves in spans at every stage: modem tx -> comp -> ec -> hdlc -->
+                                       modem tx -> ec -> hdlc         -->
+                                       modem tx -> async              -->
+                                       modem tx --> raw output
 */
 static int modem_comp_get_chars(struct modem *m, char *buf, int n)
 {
-	int ret = 0, cnt;
-	char ch;
+	int ret = 0, cnt, len;
 	while(ret < n) {
-		cnt = modem_get_chars(m,&ch,1);
-		if(cnt <= 0)
+		/* encode straight from the xmit queue */
+		cnt = m->xmit.count;
+		if (cnt > m->xmit.size - m->xmit.tail)
+			cnt = m->xmit.size - m->xmit.tail;
+		len = n - ret;
+		cnt = modem_comp_encode(m,m->xmit.buf + m->xmit.tail,cnt,
+					buf + ret,&len);
+		if(cnt < 0)
 			break;
-		cnt = modem_comp_encode(m,ch,buf+ret,n-ret);
-		if(cnt < 0) {
+		m->xmit.count -= cnt;
+		m->xmit.tail = (m->xmit.tail + cnt)%m->xmit.size;
+		m->stats.comp_tx_raw += cnt;
+		ret += len;
+		if(!len && !cnt)
 			break;
-		}
-		ret += cnt;
 	}
 	if(ret < n) {
 		cnt =  modem_comp_flush_encoder(m,buf+ret,n-ret);
 		ret += cnt;
 	}
+	m->stats.comp_tx_line += ret;
 	if(ret > 0) {
 		//MODEM_DBG("modem_comp_get_chars: %d(%d)...\n",ret,count);
 		modem_debug_log_data(m,MODEM_DBG_TX_DATA,buf,ret);
@@ -968,47 +1043,38 @@ static int modem_comp_get_chars(struct modem *m, char *buf, int n)
 	return ret;
 }
 
-static int comp_send_output(struct modem *m)
-{
-	int cnt;
-	if(m->comp.count > 0) {
-		cnt = modem_put_chars(m,m->comp.buf+m->comp.head,m->comp.count);
-		m->comp.count -= cnt;
-		m->comp.head += cnt;
-		if(m->comp.count > 0)
-			return 0;
-		else
-			m->comp.head = 0;
-	}
-	return 1;
-}
-
+/* decode straight into the recv queue: a short count (queue full)
+   puts LAPM into busy state */
 static int modem_comp_put_chars(struct modem *m, const char *buf, int n)
 {
-	int i=0, cnt;
-	if(!comp_send_output(m))
-		return 0;
-	while(i<n) {
-		cnt = modem_comp_decode(m,buf[i++],m->comp.buf,sizeof(m->comp.buf));
-		if(cnt < 0) {
-			MODEM_DBG("decoder error. %d(%d)\n",i,n);
-			modem_update_status(m,STATUS_ERROR);
-			break;
-		}
-		m->comp.count += cnt;
-		if(!comp_send_output(m))
-			break;
+	int cnt, len;
+	if(m->recv.count == m->recv.size && !m->recv.defer)
+		modem_flush_chars(m);
+	len = m->recv.size - m->recv.count;
+	cnt = modem_comp_decode(m,(const u8 *)buf,n,
+				(char *)m->recv.buf + m->recv.count,&len);
+	if(cnt < 0) {
+		MODEM_DBG("decoder error. (%d)\n",n);
+		modem_update_status(m,STATUS_ERROR);
+		return n; /* dropped: the connection goes down */
 	}
-	if(i==n) {
-		cnt = modem_comp_flush_decoder(m,m->comp.buf,sizeof(m->comp.buf));
-		m->comp.count += cnt;
-		comp_send_output(m);
+	m->recv.count += len;
+	m->stats.comp_rx_raw += len;
+	if(cnt == n) {
+		len = modem_comp_flush_decoder(m,
+				(char *)m->recv.buf + m->recv.count,
+				m->recv.size - m->recv.count);
+		m->recv.count += len;
+		m->stats.comp_rx_raw += len;
 	}
-	if(i>0) {
-		//MODEM_DBG("modem_comp_put_chars: %d...\n",i);
-		modem_debug_log_data(m,MODEM_DBG_RX_DATA,buf,i);
+	m->stats.comp_rx_line += cnt;
+	if(!m->recv.defer)
+		modem_flush_chars(m);
+	if(cnt>0) {
+		//MODEM_DBG("modem_comp_put_chars: %d...\n",cnt);
+		modem_debug_log_data(m,MODEM_DBG_RX_DATA,buf,cnt);
 	}
-	return i;
+	return cnt;
 }
 
 
@@ -1027,6 +1093,8 @@ static void do_modem_change_dp (struct modem *m)
         struct dp *old;
 
 	old = m->dp;
+	if (m->modem_info&TIOCM_CD)
+		m->stats.retrains++;
 
 	if (m->mode == MODEM_MODE_FAX) {
 		modem_fax_start(m);
@@ -1088,21 +1156,37 @@ static void modem_setup_config(struct modem *m)
 	m->cfg.ec_rx_win_size  = LAPM_MAX_WIN_SIZE;
 	m->cfg.ec_tx_info_size = LAPM_MAX_INFO_SIZE;
 	m->cfg.ec_rx_info_size = LAPM_MAX_INFO_SIZE;
+	m->cfg.ec_srej = 1;
 	if(m->cfg.ec && MODEM_COMP_ENABLE(m))
 		m->cfg.comp = 0x3; /* bi-directional v42bis */
 	else
 		m->cfg.comp = 0;
 	m->cfg.comp_dict_size  = COMP_MAX_CODEWORDS;
 	m->cfg.comp_max_string = COMP_MAX_STRING;
+	m->cfg.comp_slz = m->cfg.comp && MODEM_COMP_SLZ(m);
+	m->cfg.slz_dict_size  = SLZ_MAX_CODEWORDS;
+	m->cfg.slz_max_string = SLZ_MAX_STRING;
+	m->cfg.slz_hist_size  = SLZ_HISTORY_SIZE;
 
 	/* setup dsp data */
 	m->dsp_info.qc_lapm = m->cfg.ec && m->cfg.ec_detector ;
 }
 
 
+/* S93 is read when a call starts: all dps of a call share the frag.
+   It must be a whole number of samples, anything else gets the default */
+static unsigned modem_cycle_frag(struct modem *m, unsigned ms)
+{
+	if (ms < MODEM_CYCLE_TIME || ms > MODEM_CYCLE_TIME_MAX ||
+	    m->srate * ms % 1000)
+		return MODEM_FRAG;
+	return m->srate * ms / 1000;
+}
+
 static int do_modem_start(struct modem *m)
 {
 	int ret;
+	m->frag = modem_cycle_frag(m, m->sregs[SREG_DP_CYCLE_TIME]);
         ret = m->driver.ioctl(m, MDMCTL_SPEED, m->srate);
         ret = m->driver.ioctl(m, MDMCTL_SETFRAG, m->frag);
         m->count = 0;
@@ -1227,6 +1311,8 @@ static int modem_stop (struct modem *m)
 #endif
         modem_set_state(m, STATE_MODEM_IDLE);
 	if (m->result_code) {
+		m->stats.disconnects++;
+		m->stats.last_result = m->result_code;
 		modem_report_result(m, m->result_code);
 		m->result_code = 0;
 	}
@@ -1594,6 +1680,7 @@ static int modem_dial_start(struct modem *m)
 	if (m->started)
 		modem_stop(m);
 	m->caller = 1;
+	m->frag = modem_cycle_frag(m, m->sregs[SREG_DP_CYCLE_TIME]);
 	op = get_dp_operations(DP_CALLPROG);
 	char save = m->dial_string[0]; // hide the dial string so no DTMF is generated
 	m->dial_string[0] = 0;
@@ -1754,6 +1841,7 @@ static int sregs_init(unsigned char sregs[])
         sregs[SREG_DP]              =  DP_V92;
 
         sregs[SREG_ANS_DELAY]       =  2; /* seconds */
+        sregs[SREG_DP_CYCLE_TIME]   =  modem_cycle_time; /* ms */
 
         sregs[SREG_LINE_QUALITY_CONTROL]   = 0;
         sregs[SREG_CD]                     = 0;
@@ -1764,6 +1852,7 @@ static int sregs_init(unsigned char sregs[])
 	/* new sregs */
 	sregs[SREG_EC]   = 1;
 	sregs[SREG_COMP] = 0x3;
+	sregs[SREG_COMP_SLZ] = 0;
 
         return 0;
 }
@@ -1865,12 +1954,93 @@ int modem_write(struct modem *m, const char *buffer, int count)
 		buffer += cnt;
 		count -= cnt;
 	}
+	m->stats.pty_in += ret;
 	if(m->command)
 		modem_at_process(m);
 	return ret;
 }
 
 
+/*
+ *    run time statistics
+ *
+ */
+
+static const char *modem_state_name(unsigned state)
+{
+	switch(state) {
+	case STATE_MODEM_IDLE:     return "idle";
+	case STATE_DP_ESTAB:       return "dp_estab";
+	case STATE_EC_ESTAB:       return "ec_estab";
+	case STATE_MODEM_ONLINE:   return "online";
+	case STATE_COMMAND_ONLINE: return "command_online";
+	case STATE_EC_DISC:        return "ec_disc";
+	case STATE_DP_DISC:        return "dp_disc";
+	default:                   return "unknown";
+	}
+}
+
+static const char *modem_status_name(unsigned status)
+{
+	switch(status) {
+	case STATUS_OK:         return "none";
+	case STATUS_NOCARRIER:  return "nocarrier";
+	case STATUS_NODIALTONE: return "nodialtone";
+	case STATUS_BUSY:       return "busy";
+	case STATUS_NOANSWER:   return "noanswer";
+	case STATUS_DP_ERROR:   return "dp_error";
+	case STATUS_PACK_ERROR: return "pack_error";
+	case STATUS_EC_RELEASE: return "ec_release";
+	case STATUS_EC_ERROR:   return "ec_error";
+	default:                return "error";
+	}
+}
+
+static unsigned modem_stats_ratio(unsigned long raw, unsigned long line)
+{
+	return line ? (unsigned)((unsigned long long)raw*100/line) : 0;
+}
+
+/* one line of 'key=value' pairs; counters are totals since the modem
+   was created, rates, ec and compressor fields are of the current (or
+   last) connection. period_ms is the time since the previous call,
+   used for the modem_process() load */
+void modem_stats_print(struct modem *m, FILE *f, unsigned long period_ms)
+{
+	struct modem_stats *s = &m->stats;
+	struct lapm_state *l = &m->ec.lapm;
+	struct dp_driver *dp_drv = get_dp_driver(s->dp_id);
+	unsigned long long busy = s->process_ns - s->last_process_ns;
+
+	s->last_process_ns = s->process_ns;
+	fprintf(f, "name=%s state=%s dp=%s rx_rate=%u tx_rate=%u",
+		m->name, modem_state_name(m->state),
+		dp_drv ? dp_drv->name : "none", m->rx_rate, m->tx_rate);
+	fprintf(f, " links=%u retrains=%u disconnects=%u last_status=%s"
+		" last_result=%u",
+		s->links, s->retrains, s->disconnects,
+		modem_status_name(s->last_status), s->last_result);
+	fprintf(f, " ec=%u rtx_frames=%u rej_tx=%u rej_rx=%u srej_tx=%u"
+		" srej_rx=%u win_stalls=%u t401=%u tx_count=%d sent_count=%d",
+		m->cfg.ec, l->stats.rtx_frames, l->stats.rej_tx,
+		l->stats.rej_rx, l->stats.srej_tx, l->stats.srej_rx,
+		l->stats.win_stalls, l->stats.t401, l->tx_count, l->sent_count);
+	fprintf(f, " comp=%s comp_tx_raw=%lu comp_tx_line=%lu"
+		" comp_rx_line=%lu comp_rx_raw=%lu"
+		" comp_tx_ratio=%u comp_rx_ratio=%u"
+		" enc_cmp_bits=%u enc_raw_bits=%u",
+		!(m->cfg.ec && m->cfg.comp) ? "none" :
+		m->cfg.comp_slz ? "slz" : "v42bis",
+		s->comp_tx_raw, s->comp_tx_line, s->comp_rx_line,
+		s->comp_rx_raw,
+		modem_stats_ratio(s->comp_tx_raw, s->comp_tx_line),
+		modem_stats_ratio(s->comp_rx_raw, s->comp_rx_line),
+		m->comp.encoder.cmp_bits, m->comp.encoder.raw_bits);
+	fprintf(f, " pty_in=%lu pty_out=%lu process_us_per_s=%llu\n",
+		s->pty_in, s->pty_out, period_ms ? busy/period_ms : 0);
+}
+
+
 
 void modem_print_version()
 {
@@ -1939,6 +2109,14 @@ struct modem *modem_create(struct modem_driver *drv, const char *name)
 	}
 	m->xmit.size = XMIT_SIZE;
 	m->xmit.head = m->xmit.tail = m->xmit.count = 0;
+	m->recv.buf = malloc(RECV_SIZE);
+	if ( !m->recv.buf ) {
+		free(m->xmit.buf);
+		free(m);
+		return NULL;
+	}
+	m->recv.size = RECV_SIZE;
+	m->recv.count = 0;
 	m->modem_info |= TIOCM_DTR|TIOCM_RTS;
 	// TODO: update speed,DTR according to termios
 #ifdef MODEM_CONFIG_VOICE
@@ -1963,6 +2141,9 @@ void modem_delete(struct modem *m)
 	m->xmit.count = m->xmit.tail = m->xmit.head = 0;
 	free(m->xmit.buf);
 	m->xmit.buf = 0;
+	modem_flush_chars(m);
+	free(m->recv.buf);
+	m->recv.buf = 0;
 
 	timer_del(&m->event_timer);
 	free(m);
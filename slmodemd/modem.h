@@ -41,6 +41,7 @@
 #ifndef __MODEM_H__
 #define __MODEM_H__
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -84,6 +85,9 @@ enum MODEM_MODE {
 #define MODEM_FORMAT MFMT_S16_LE
 #define MODEM_RATE   9600 /* 8000 */
 #define MODEM_FRAG   (MODEM_RATE/200)
+/* DSP cycle, samples per dp->op->process(), in ms: S93 */
+#define MODEM_CYCLE_TIME     (MODEM_FRAG*1000/MODEM_RATE)
+#define MODEM_CYCLE_TIME_MAX 40
 
 
 #define MODEM_MIN_RATE 300
@@ -91,6 +95,8 @@ enum MODEM_MODE {
 
 #define MODEM_DEFAULT_COUNTRY_CODE 0xb5 /* USA */
 
+#define MODEM_MAX_INSTANCES 256 /* modems per slmodemd process */
+
 #define MODEM_CONFIG_CID   1
 #define MODEM_CONFIG_VOICE 1
 #define MODEM_CONFIG_FAX   1
@@ -127,7 +133,7 @@ struct dp_driver {
  *
  */
 
-#define COMP_MAX_CODEWORDS 2048  /* dictionary size   */
+#define COMP_MAX_CODEWORDS 8192  /* dictionary size   */
 #define COMP_MAX_STRING    34    /* max string length */
 
 /* encoder and decoder states */
@@ -140,16 +146,18 @@ struct comp_state {
 	u16 last_matched;  /* last matched dict entry */
 	u16 last_added;    /* last added dict entry */
 	u16 cw_size;       /* cw size */
-	u16 threshold;     /* cw size threshold */
+	u32 threshold;     /* cw size threshold */
 	u8  escape_char;   /* escape char value */
 	int max_string;    /* max string length */
 	int dict_size;     /* dictionary size */
 	struct dict {
 		u8  ch;
 		u16 parent;
-		u16 child;
-		u16 next;
+		u16 children;
 	} *dict;           /* dictionary */
+	u16 *hash;         /* (parent,ch) -> entry, open addressing */
+	unsigned hash_mask;
+	u32 *leaf;         /* bitmap of entries without children */
 	/* fixme: union may be used? */
 	int bit_len;
 	u32 bit_data;
@@ -160,19 +168,102 @@ struct comp_state {
 	u16 cmp_last; /* compressed bits per last TEST_SLICE chars */
 	u32 cmp_bits; /* total compressed bits */
 	u32 raw_bits; /* total non-compressed bits */
-	/* temporary */
+	/* output buffer of the current call, and what did not fit in it */
+	u8  *out;
 	int  olen;
-	int  ohead;
-	char obuf[1024];
+	int  osize;
+	int  shead;
+	int  slen;
+	u8   spill[1024];
+	/* SLZ string state, NULL when running V42bis */
+	struct slz_state *slz;
+};
+
+static inline void comp_out_byte(struct comp_state *c, u8 b)
+{
+	if (c->olen < c->osize)
+		c->out[c->olen++] = b;
+	else
+		c->spill[c->slen++] = b;
+}
+
+static inline void comp_out_bytes(struct comp_state *c, const u8 *p, int n)
+{
+	int cnt = c->osize - c->olen;
+	if (cnt > n)
+		cnt = n;
+	if (cnt > 0) {
+		memcpy(c->out + c->olen, p, cnt);
+		c->olen += cnt;
+		p += cnt;
+		n -= cnt;
+	}
+	if (n > 0) {
+		memcpy(c->spill + c->slen, p, n);
+		c->slen += n;
+	}
+}
+
+#define SLZ_MAX_CODEWORDS  8192  /* dictionary size (P1) */
+#define SLZ_MAX_STRING     255   /* max string length (P2) */
+#define SLZ_HISTORY_SIZE   32768 /* history size (P3) */
+#define SLZ_MIN_CODEWORDS  256   /* smallest values SLZ runs with */
+#define SLZ_MIN_STRING     32
+#define SLZ_MIN_HISTORY    1024
+
+/* SLZ string state: every string is a reference into the
+   history, entries only keep what the tree walk needs */
+struct slz_state {
+	struct slz_entry {
+		u32 base;  /* history position of the string */
+		u16 slen;  /* string length */
+		u8  len;   /* length of its last segment */
+		u8  ch;    /* first char of the last segment */
+		u8  first; /* first char of the string */
+		u16 parent;
+		u16 child; /* first child */
+		u16 next;  /* next sibling */
+	} *dict;
+	u16 root[256];     /* children of the ordinals */
+	int dict_size;     /* codewords (P1) */
+	int max_string;    /* max string length (P2) */
+	int hist_size;     /* history size (P3) */
+	int dict_alloc;
+	u8  *hist;         /* history, power of 2 >= hist_size */
+	unsigned hist_mask;
+	u32 hist_limit;    /* max age of a usable string */
+	u32 hpos;          /* chars put into history */
+	u32 str_start;     /* current string */
+	u32 scan;          /* encoder: next char to match */
+	u16 next_free;     /* next dictionary entry (C1) */
+	u8  full;          /* entries are being reused */
+	u8  cw_size;       /* codeword size (C2) */
+	u8  ord_size;      /* ordinal size (C5) */
+	u8  state;         /* string state */
+	u8  has_prev;      /* last string waits for the next first char */
+	u16 prev;          /* its entry, 0 for an ordinal */
+	u32 prev_start;
+	u16 cur;           /* matched entry, 0 for an ordinal */
+	u16 cur_len;
+	u16 seg;           /* encoder: entry being matched */
+	u8  seg_off;
+	u16 ext;           /* string extension length */
+	int bits;          /* encoder: bits sent for the string */
+	int probe;         /* encoder: chars sent transparent */
+	int dirty;         /* encoder: sent since the last FLUSH */
 };
 
 
 extern int  modem_comp_init(struct modem *m);
 extern int  modem_comp_config(struct modem *m, int dict_size, int max_str);
+extern int  modem_comp_config_slz(struct modem *m, int dict_size,
+				  int max_str, int hist_size);
 extern void modem_comp_exit(struct modem *m);
 
-extern int  modem_comp_encode(struct modem *m, u8 ch, char *buf, int n);
-extern int  modem_comp_decode(struct modem *m, u8 ch, char *buf, int n);
+extern int  modem_comp_encode(struct modem *m, const u8 *in, int n,
+			      char *buf, int *len);
+extern int  modem_comp_decode(struct modem *m, const u8 *in, int n,
+			      char *buf, int *len);
 extern int  modem_comp_flush_encoder(struct modem *m, char *buf, int n);
 extern int  modem_comp_flush_decoder(struct modem *m, char *buf, int n);
 
@@ -188,7 +279,7 @@ typedef struct hdlc_frame {
 	int size;
 	//u16 addr;
 	//u16 ctrl;
-	u16 fcs;
+	u32 fcs;
 	u8 *buf;
 } frame_t;
 
@@ -199,11 +290,23 @@ typedef struct hdlc_frame {
  *
  */
 
-#define LAPM_MAX_WIN_SIZE    15  /* max supported winsize  */
-#define LAPM_MAX_INFO_SIZE  128  /* max supported infosize */
-
-#define LAPM_INFO_FRAMES    LAPM_MAX_WIN_SIZE + 1 /* number of info frames */
-#define LAPM_CTRL_FRAMES      8  /* number of ctrl frames */
+#define LAPM_MAX_WIN_SIZE   127  /* max supported winsize  */
+#define LAPM_MAX_INFO_SIZE  512  /* max supported infosize */
+
+#define LAPM_CTRL_FRAMES     16  /* number of ctrl frames */
+#define LAPM_CTRL_SIZE       96  /* ctrl frame buffer (XID fits) */
+
+/* per link counters */
+struct lapm_stats {
+	unsigned win_stalls;  /* data waiting, window full */
+	unsigned rtx_frames;  /* I frames sent again */
+	unsigned rej_rx;      /* REJ received */
+	unsigned rej_tx;      /* REJ sent */
+	unsigned t401;        /* T401 expired */
+	unsigned srej_rx;     /* SREJ received */
+	unsigned srej_tx;     /* SREJ sent */
+	unsigned srej_saved;  /* info bytes go-back-N would have resent */
+};
 
 /* lapm state */
 struct lapm_state {
@@ -236,17 +339,32 @@ struct lapm_state {
         int rx_count;
         int rx_head;
         u8  rx_buf[LAPM_MAX_INFO_SIZE];
-        /* temporary: frames bufs */
+        /* info frames pool: tx_win_size + 1 frames, sized at link reset */
+        u8  *info_pool;
+        int info_frames;
+        int info_stride;
+        /* SLZ requested by the peer with values we cannot run: the
+           XID response says so with P0 = 0 */
+        int slz_refused;
+        /* selective reject: out of order rx store, pending tx resends */
+        int srej;
+        int srej_settled; /* an XID from the peer decided srej */
+        u8  *store_pool;
+        int store_frames;
+        int store_stride;
+        frame_t *store_free;
+        frame_t *rx_store[128];
+        u32 srej_sent[4];
+        u32 srej_rtx[4];
+        int srej_pending;
+        u8  gbn_end;
         struct {
                 frame_t frame;
                 u8 ctrl[4];
-                u8 info[LAPM_MAX_INFO_SIZE];
-        } info_buf[LAPM_INFO_FRAMES];
-        struct {
-                frame_t frame;
-                u8 ctrl[4];
-                u8 info[LAPM_MAX_INFO_SIZE];
+                u8 info[LAPM_CTRL_SIZE];
         } ctrl_buf[LAPM_CTRL_FRAMES];
+        int stalled;
+        struct lapm_stats stats;
         /* temporary: debug counters: remove it */
         int info_count; // debug
         int tx_count;   // debug
@@ -274,6 +392,7 @@ struct modem {
         unsigned caller;
 	unsigned rx_rate;
 	unsigned tx_rate;
+	unsigned rate_updates; /* (re)trains, as rx rate reports from dp */
 	enum MODEM_MODE mode; /* data,fax,voice */
         /* modem events (ring,escape,waiting for connect,etc) */
 	unsigned event;
@@ -313,6 +432,13 @@ struct modem {
 		unsigned int size;
 		unsigned char *buf;
 	} xmit;
+	/* recv queue: pty data, written out once per modem_process() */
+	struct recv_queue {
+		unsigned int count;
+		unsigned int size;
+		unsigned int defer; /* inside modem_process() */
+		unsigned char *buf;
+	} recv;
 	/* run time configuration */
 	struct modem_config {
 		/* ec params */
@@ -322,10 +448,15 @@ struct modem {
 		u8  ec_rx_win_size;
 		u16 ec_tx_info_size;
 		u16 ec_rx_info_size;
+		u8  ec_srej;
 		/* compressor params */
 		u8  comp;
 		int comp_dict_size;
 		int comp_max_string;
+		u8  comp_slz;
+		int slz_dict_size;
+		int slz_max_string;
+		int slz_hist_size;
 	} cfg;
         /* modem packer */
         int (*get_chars)(struct modem *m, char *buf, int n);
@@ -360,7 +491,12 @@ struct modem {
 			struct hdlc_frame *tx_frame;
 			struct hdlc_frame *rx_frame;
 			int rx_error;
-			int rx_ones,tx_ones;
+			int rx_state,tx_ones;
+			u32 rx_bits;     /* data bits not a char yet */
+			int rx_nbits;
+			unsigned rx_hunt;/* raw bits while in rx_error */
+			int tx_fcs;      /* fcs bytes left to send */
+			int fcs32;       /* 32-bit FCS */
 			/* framer interface */
 			struct hdlc_frame *(*get_tx_frame)(void *framer);
 			void (*tx_complete)(void *framer, frame_t *fr);
@@ -368,7 +504,7 @@ struct modem {
 			void *framer;
 			/* temporary: internal bufs */
 			struct hdlc_frame _rx_frame;
-			u8 _rx_buf[512];
+			u8 _rx_buf[LAPM_MAX_INFO_SIZE+3+4];
 		} hdlc;
 	} packer;
 	/* error corrector */
@@ -377,11 +513,10 @@ struct modem {
 	} ec;
 	/* compressor */
 	struct comp_struct {
-		// fixme: redo interface
-		int head,count;
-		char buf[256];
 		struct comp_state encoder;
 		struct comp_state decoder;
+		struct slz_state slz_encoder;
+		struct slz_state slz_decoder;
 	} comp;
         /* modem data pump interface */
         unsigned srate;
@@ -411,6 +546,23 @@ struct modem {
 #ifdef MODEM_CONFIG_FAX
 	void *fax_obj;
 #endif
+	/* run time statistics, dumped by modem_stats_print() */
+	struct modem_stats {
+		unsigned dp_id;           /* dp of the current/last link */
+		unsigned links;           /* dp links established */
+		unsigned retrains;        /* rate changes and dp changes on link */
+		unsigned disconnects;     /* calls ended with a result code */
+		unsigned last_status;     /* status that ended the last link */
+		unsigned last_result;     /* its result code */
+		unsigned long pty_in;     /* bytes read from the pty */
+		unsigned long pty_out;    /* bytes written to the pty */
+		unsigned long comp_tx_raw;  /* compressor: pty side bytes in */
+		unsigned long comp_tx_line; /* compressor: line side bytes out */
+		unsigned long comp_rx_line; /* decompressor: line side bytes in */
+		unsigned long comp_rx_raw;  /* decompressor: pty side bytes out */
+		unsigned long long process_ns; /* time in modem_process() */
+		unsigned long long last_process_ns; /* at the last dump */
+	} stats;
 };
 
 
@@ -428,8 +580,11 @@ extern void modem_hangup(struct modem *m);
 extern void modem_update_termios(struct modem *m, struct termios *tios);
 extern void modem_error  (struct modem *m);
 extern void modem_ring   (struct modem *m);
+extern void modem_ring_valid(struct modem *m);
 extern void modem_event  (struct modem *m);
 extern void modem_process(struct modem *m,void *in,void *out,int cnt);
+extern void modem_flush_chars(struct modem *m);
+extern void modem_stats_print(struct modem *m, FILE *f, unsigned long period_ms);
 
 /* packers && EC */ // FIXME: improve interface
 extern void modem_async_start(struct modem *m);
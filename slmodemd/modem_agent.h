@@ -0,0 +1,178 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_agent.h  --  call requests from slmodemd to a long running
+ *                       audio application (d-modem -l).
+ *
+ *    slmodemd keeps one connection to the agent's unix socket open
+ *    per idle modem (LISTEN).  The agent picks one of them for each
+ *    incoming call and sends RING, with the caller in dial[], every
+ *    few seconds until slmodemd answers (ANSWER) or the caller gives
+ *    up, in which case the agent closes the connection.  To call out
+ *    slmodemd sends DIAL, on the idle connection or on a new one.
+ *    With the shared memory transport the memfd and the doorbell
+ *    eventfd go along with ANSWER or DIAL as SCM_RIGHTS.  From then on
+ *    the connection carries the audio, exactly like the socketpair of
+ *    the fork+exec path, and closing it from either side ends the call.
+ *    Like modem_shm.h this is shared by the 32-bit slmodemd and the
+ *    native d-modem: fixed size types only.
+ *
+ */
+
+#ifndef __MODEM_AGENT_H__
+#define __MODEM_AGENT_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define MODEM_AGENT_MAGIC    0x4d414754 /* 'MAGT' */
+#define MODEM_AGENT_VERSION  1
+#define MODEM_AGENT_DIAL_MAX 128
+#define MODEM_AGENT_MAX_FDS  2
+
+/* commands, slmodemd -> agent */
+#define MODEM_AGENT_DIAL     1
+#define MODEM_AGENT_LISTEN   2
+#define MODEM_AGENT_ANSWER   3
+/* agent -> slmodemd */
+#define MODEM_AGENT_RING     4
+
+/* flags */
+#define MODEM_AGENT_SHM      0x1 /* fds: shm memfd, eventfd */
+#define MODEM_AGENT_ULAW     0x2 /* socket samples are 8 kHz G.711 bytes */
+#define MODEM_AGENT_ALAW     0x4
+
+struct modem_agent_req {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t cmd;
+	uint32_t flags;
+	char     dial[MODEM_AGENT_DIAL_MAX]; /* number, or caller with RING */
+};
+
+
+static inline void modem_agent_req_init(struct modem_agent_req *req,
+					unsigned cmd, const char *dial)
+{
+	memset(req, 0, sizeof(*req));
+	req->magic = MODEM_AGENT_MAGIC;
+	req->version = MODEM_AGENT_VERSION;
+	req->cmd = cmd;
+	if (dial)
+		strncpy(req->dial, dial, sizeof(req->dial) - 1);
+}
+
+static inline int modem_agent_send(int sock, const struct modem_agent_req *req,
+				   const int *fds, int nfds)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(MODEM_AGENT_MAX_FDS*sizeof(int))];
+	} cmsg;
+	struct iovec iov;
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (void *)req;
+	iov.iov_len = sizeof(*req);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (nfds > 0) {
+		memset(&cmsg, 0, sizeof(cmsg));
+		msg.msg_control = cmsg.buf;
+		msg.msg_controllen = CMSG_SPACE(nfds*sizeof(int));
+		cmsg.hdr.cmsg_level = SOL_SOCKET;
+		cmsg.hdr.cmsg_type = SCM_RIGHTS;
+		cmsg.hdr.cmsg_len = CMSG_LEN(nfds*sizeof(int));
+		memcpy(CMSG_DATA(&cmsg.hdr), fds, nfds*sizeof(int));
+	}
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) == sizeof(*req) ? 0 : -1;
+}
+
+/* returns 0 and the fds received (*nfds), or -1 on a short or bad
+   request; received fds are closed on error */
+static inline int modem_agent_recv(int sock, struct modem_agent_req *req,
+				   int *fds, int *nfds)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(MODEM_AGENT_MAX_FDS*sizeof(int))];
+	} cmsg;
+	struct cmsghdr *c;
+	struct iovec iov;
+	struct msghdr msg;
+	ssize_t len;
+	int i, n = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = req;
+	iov.iov_len = sizeof(*req);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsg.buf;
+	msg.msg_controllen = sizeof(cmsg.buf);
+	len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	for (c = len > 0 ? CMSG_FIRSTHDR(&msg) : NULL; c;
+	     c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+			continue;
+		for (i = 0; i < (c->cmsg_len - CMSG_LEN(0))/sizeof(int); i++) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(c) + i*sizeof(int), sizeof(fd));
+			if (n < MODEM_AGENT_MAX_FDS)
+				fds[n++] = fd;
+			else
+				close(fd);
+		}
+	}
+	*nfds = n;
+	if (len != sizeof(*req) || req->magic != MODEM_AGENT_MAGIC ||
+	    req->version != MODEM_AGENT_VERSION ||
+	    (msg.msg_flags & MSG_CTRUNC)) {
+		for (i = 0; i < n; i++)
+			close(fds[i]);
+		*nfds = 0;
+		return -1;
+	}
+	req->dial[sizeof(req->dial) - 1] = '\0';
+	return 0;
+}
+
+#endif /* __MODEM_AGENT_H__ */
@@ -0,0 +1,837 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_bench.c  --  headless DSP benchmark.
+ *
+ *    Two modems are wired back to back like in modem_test, but nothing
+ *    waits on file descriptors: both are clocked through modem_process()
+ *    in lock step as fast as the CPU allows, with the timer code running
+ *    on simulated time.  For each requested modulation the caller dials
+ *    (AT+MS selects the modulation on both ends), then a deterministic
+ *    byte stream is pushed through modem_write() in both directions and
+ *    checked on arrival.
+ *
+ *    Reported per modulation: time to CONNECT (simulated), DSP samples
+ *    per CPU second (both modems counted) and CPU seconds per simulated
+ *    second.  The exit status is non zero if any run failed.
+ *
+ *    -c sets the DSP cycle (S93) on both modems, and unless -b says
+ *    otherwise feeds modem_process() one cycle at a time, so runs at
+ *    5, 10 and 20 ms show the per call cost of each frame size.
+ *
+ *    With any of the line options the two directions go through a VoIP
+ *    line model (modem_line.c): G.711, 8 kHz resampling, packet loss,
+ *    jitter, clock skew, gain and noise.  -M sweeps one of these over a
+ *    list of values and prints a matrix of achieved throughput and
+ *    retrain counts per modulation.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <modem.h>
+#include <modem_debug.h>
+#include <modem_line.h>
+
+#define INFO(fmt,args...) fprintf(stderr, fmt , ##args );
+#define ERR(fmt,args...) fprintf(stderr, "error: " fmt , ##args );
+
+#define DBG(fmt,args...) if(modem_debug_level) \
+                             fprintf(stderr, "bench: " fmt , ##args );
+
+
+/* modem init externals : FIXME remove it */
+extern int  dp_dummy_init(void);
+extern void dp_dummy_exit(void);
+extern int  dp_sinus_init(void);
+extern void dp_sinus_exit(void);
+extern int  prop_dp_init(void);
+extern void prop_dp_exit(void);
+
+
+#define BENCH_RATE        9600
+#define BENCH_BLOCK       96	/* samples per modem_process() call */
+#define BENCH_LINE_DELAY  128	/* driver start delay, samples */
+#define BENCH_LINE_SIZE   (1<<15)
+#define BENCH_DATA_SECS   10	/* payload size in seconds of nominal rate */
+#define BENCH_TIMEOUT     300	/* simulated seconds per run */
+
+struct bench_mod {
+	const char *name;
+	unsigned dp_id;
+	unsigned bps;		/* nominal rate, sizes the payload */
+};
+
+static const struct bench_mod bench_mods[] = {
+	{ "V.21",    DP_V21,     300 },
+	{ "V.22bis", DP_V22BIS, 2400 },
+	{ "V.32bis", DP_V32BIS, 14400 },
+	{ "V.34",    DP_V34,    33600 },
+	{}
+};
+
+/* one direction of the line: a plain sample fifo */
+struct bench_line {
+	short buf[BENCH_LINE_SIZE];
+	unsigned head, count;
+};
+
+enum { BENCH_CMD, BENCH_ONLINE, BENCH_FAILED };
+
+struct bench_end {
+	struct modem *modem;
+	struct bench_line *rx;		/* samples from the far end */
+	struct bench_line *tx;
+	struct modem_line *line;	/* impairments on tx, if any */
+	int data_fd;			/* our side of the modem's 'pty' */
+	unsigned started;
+	unsigned delay;			/* samples, reported via IODELAY */
+	unsigned state;
+	char result[128];		/* result code being collected */
+	unsigned result_len;
+	unsigned long connect_time;	/* samples since dial */
+	unsigned long done_time;	/* all payload received */
+	unsigned rate;
+	unsigned rate_updates;		/* modem's count at CONNECT */
+	unsigned tx_seed, rx_seed;
+	unsigned total;			/* payload size each way */
+	unsigned tx_bytes, rx_bytes;
+	unsigned errors;
+	long first_error;
+};
+
+static unsigned bench_block = BENCH_BLOCK;
+static unsigned bench_cycle;	/* S93, ms; 0 keeps the modem default */
+static unsigned bench_data_secs = BENCH_DATA_SECS;
+static unsigned bench_timeout = BENCH_TIMEOUT;
+static struct modem_line_params bench_line_params;
+static int bench_impair;
+
+struct bench_result {
+	int connected;
+	int ok;
+	unsigned rate;
+	double connect_time;		/* simulated seconds */
+	unsigned throughput;		/* payload bps, slower direction */
+	unsigned retrains;
+	double sim, cpu;		/* seconds */
+};
+
+
+/* line */
+
+static void line_put(struct bench_line *l, const short *s, unsigned n)
+{
+	unsigned i, pos;
+	if(n > BENCH_LINE_SIZE - l->count) {
+		DBG("line overflow: %u samples dropped\n",
+		    n - (BENCH_LINE_SIZE - l->count));
+		n = BENCH_LINE_SIZE - l->count;
+	}
+	pos = (l->head + l->count)%BENCH_LINE_SIZE;
+	for(i = 0 ; i < n ; i++) {
+		l->buf[pos] = s[i];
+		pos = (pos + 1)%BENCH_LINE_SIZE;
+	}
+	l->count += n;
+}
+
+static void line_put_zeros(struct bench_line *l, unsigned n)
+{
+	static const short zeros[BENCH_BLOCK*4];
+	unsigned cnt;
+	while(n) {
+		cnt = n > BENCH_BLOCK*4 ? BENCH_BLOCK*4 : n;
+		line_put(l,zeros,cnt);
+		n -= cnt;
+	}
+}
+
+/* short reads are padded with silence */
+static void line_get(struct bench_line *l, short *s, unsigned n)
+{
+	unsigned i;
+	for(i = 0 ; i < n && l->count ; i++) {
+		s[i] = l->buf[l->head];
+		l->head = (l->head + 1)%BENCH_LINE_SIZE;
+		l->count--;
+	}
+	for( ; i < n ; i++)
+		s[i] = 0;
+}
+
+static unsigned line_drop(struct bench_line *l, unsigned n)
+{
+	if(n > l->count)
+		n = l->count;
+	l->head = (l->head + n)%BENCH_LINE_SIZE;
+	l->count -= n;
+	return n;
+}
+
+
+/* 'driver' simulation */
+
+static int bench_start(struct modem *m)
+{
+	struct bench_end *e = m->dev_data;
+	DBG("%s: start...\n",m->name);
+	e->delay = BENCH_LINE_DELAY;
+	e->started = 1;
+	line_put_zeros(e->tx,e->delay);
+	return 0;
+}
+
+static int bench_stop(struct modem *m)
+{
+	struct bench_end *e = m->dev_data;
+	DBG("%s: stop...\n",m->name);
+	e->started = 0;
+	e->delay = 0;
+	return 0;
+}
+
+static int bench_ioctl(struct modem *m, unsigned int cmd, unsigned long arg)
+{
+	struct bench_end *e = m->dev_data;
+        switch (cmd) {
+        case MDMCTL_CAPABILITIES:
+                return -1;
+        case MDMCTL_HOOKSTATE:
+        case MDMCTL_SPEED:
+        case MDMCTL_GETFMTS:
+        case MDMCTL_SETFMT:
+        case MDMCTL_SETFRAGMENT:
+        case MDMCTL_SPEAKERVOL:
+		return 0;
+        case MDMCTL_CODECTYPE:
+                return CODEC_UNKNOWN;
+        case MDMCTL_IODELAY:
+		return e->delay;
+        default:
+                break;
+        }
+	return -2;
+}
+
+static struct modem_driver bench_driver = {
+        .name = "modem_bench driver",
+        .start = bench_start,
+        .stop = bench_stop,
+        .ioctl = bench_ioctl,
+};
+
+
+/* payload: xorshift stream, '+' is skipped so that no escape sequence
+   can be formed by a short write */
+
+static unsigned char bench_byte(unsigned *seed)
+{
+	unsigned x;
+	do {
+		x = *seed;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		*seed = x;
+	} while((unsigned char)x == '+');
+	return (unsigned char)x;
+}
+
+
+/* one block of line time for one end */
+
+static void bench_clock(struct bench_end *e, short *in, short *out)
+{
+	struct modem *m = e->modem;
+	unsigned n = bench_block;
+	short buf[BENCH_BLOCK*4 + 8];
+
+	if(m->update_delay < 0) {
+		unsigned drop = -m->update_delay;
+		DBG("%s: change delay -%u...\n",m->name,drop);
+		drop = line_drop(e->rx,drop);
+		e->delay -= drop;
+		m->update_delay = 0;
+	}
+	line_get(e->rx,in,n);
+	if(e->started)
+		modem_process(m,in,out,n);
+	else
+		memset(out,0,n*sizeof(*out));
+	if(e->line)
+		line_put(e->tx,buf,modem_line_process(e->line,out,n,buf));
+	else
+		line_put(e->tx,out,n);
+	if(m->update_delay > 0) {
+		DBG("%s: change delay %d...\n",m->name,m->update_delay);
+		line_put_zeros(e->tx,m->update_delay);
+		e->delay += m->update_delay;
+		m->update_delay = 0;
+	}
+}
+
+static void bench_result_line(struct bench_end *e, unsigned long now)
+{
+	char *p = e->result;
+	while(isspace(*p))
+		p++;
+	if(!*p)
+		return;
+	DBG("%s: `%s'\n",e->modem->name,p);
+	if(!strncmp(p,"CONNECT",7)) {
+		e->state = BENCH_ONLINE;
+		e->connect_time = now;
+		e->rate = strtoul(p+7,NULL,10);
+		e->rate_updates = e->modem->rate_updates;
+	}
+	else if(!strcmp(p,"NO CARRIER") || !strcmp(p,"ERROR") ||
+		!strcmp(p,"BUSY") || !strcmp(p,"NO DIALTONE") ||
+		!strcmp(p,"NO ANSWER")) {
+		if(e->state == BENCH_ONLINE)
+			ERR("%s: carrier lost\n",e->modem->name);
+		e->state = BENCH_FAILED;
+	}
+}
+
+/* drain what the modem wrote to its 'pty' */
+static void bench_read_data(struct bench_end *e, unsigned long now)
+{
+	unsigned char buf[4096];
+	int i, n;
+	while((n = read(e->data_fd,buf,sizeof(buf))) > 0) {
+		for(i = 0 ; i < n ; i++) {
+			if(e->state == BENCH_ONLINE) {
+				if(buf[i] != bench_byte(&e->rx_seed)) {
+					if(!e->errors)
+						e->first_error = e->rx_bytes;
+					e->errors++;
+				}
+				if(++e->rx_bytes == e->total)
+					e->done_time = now;
+				continue;
+			}
+			if(buf[i] == '\r' || buf[i] == '\n') {
+				e->result[e->result_len] = '\0';
+				bench_result_line(e,now);
+				e->result_len = 0;
+			}
+			else if(e->result_len < sizeof(e->result) - 1)
+				e->result[e->result_len++] = buf[i];
+		}
+	}
+}
+
+static void bench_write_data(struct bench_end *e)
+{
+	unsigned total = e->total;
+	struct modem *m = e->modem;
+	unsigned char buf[1024];
+	unsigned i, n;
+	if(e->state != BENCH_ONLINE || m->command)
+		return;
+	n = m->xmit.size - m->xmit.count;
+	if(n > sizeof(buf))
+		n = sizeof(buf);
+	if(n > total - e->tx_bytes)
+		n = total - e->tx_bytes;
+	if(!n || (n < 4 && n < total - e->tx_bytes))
+		return;
+	for(i = 0 ; i < n ; i++)
+		buf[i] = bench_byte(&e->tx_seed);
+	e->tx_bytes += modem_write(m,(char *)buf,n);
+}
+
+static void bench_at(struct bench_end *e, const char *cmd)
+{
+	DBG("%s: %s\n",e->modem->name,cmd);
+	modem_write(e->modem,cmd,strlen(cmd));
+}
+
+
+static int bench_end_init(struct bench_end *e, const char *name,
+			  struct bench_line *rx, struct bench_line *tx,
+			  unsigned seed)
+{
+	struct termios termios;
+	int sv[2];
+
+	memset(e,0,sizeof(*e));
+	e->rx = rx;
+	e->tx = tx;
+	e->first_error = -1;
+
+	if(socketpair(AF_UNIX,SOCK_STREAM,0,sv) < 0) {
+		ERR("socketpair: %s\n",strerror(errno));
+		return -1;
+	}
+	fcntl(sv[0],F_SETFL,O_NONBLOCK);
+	fcntl(sv[1],F_SETFL,O_NONBLOCK);
+
+	if(bench_impair) {
+		struct modem_line_params params = bench_line_params;
+		params.seed ^= seed;
+		e->line = modem_line_create(&params,BENCH_RATE);
+		if(!e->line) {
+			ERR("cannot create line model\n");
+			close(sv[0]);
+			close(sv[1]);
+			return -1;
+		}
+	}
+
+	e->modem = modem_create(&bench_driver,name);
+	if(!e->modem) {
+		if(e->line)
+			modem_line_delete(e->line);
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	e->modem->name = name;
+	e->modem->dev_name = name;
+	e->modem->pty_name = name;
+	e->modem->pty = sv[0];
+	e->data_fd = sv[1];
+	e->modem->dev_data = e;
+
+	memset(&termios,0,sizeof(termios));
+	cfmakeraw(&termios);
+	cfsetispeed(&termios,B115200);
+	cfsetospeed(&termios,B115200);
+	modem_update_termios(e->modem,&termios);
+	return 0;
+}
+
+static void bench_end_free(struct bench_end *e)
+{
+	int pty = e->modem->pty;
+	modem_delete(e->modem);
+	close(pty);
+	close(e->data_fd);
+	if(e->line)
+		modem_line_delete(e->line);
+}
+
+/* payload bps received by e */
+static unsigned bench_throughput(struct bench_end *e, unsigned long now)
+{
+	unsigned long end = e->done_time ? e->done_time : now;
+	if(e->state != BENCH_ONLINE || end <= e->connect_time)
+		return 0;
+	return (double)e->rx_bytes*8*BENCH_RATE/(end - e->connect_time);
+}
+
+static double cpu_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+static int bench_run(const struct bench_mod *mod, struct bench_result *res)
+{
+	static struct bench_line line_ab, line_ba;
+	struct bench_end a, b;
+	short in[BENCH_BLOCK*4], out[BENCH_BLOCK*4];
+	unsigned long now = 0, limit;
+	unsigned total, ta, tb;
+	char cmd[64];
+	double cpu;
+	int ret = -1;
+
+	memset(res,0,sizeof(*res));
+	memset(&line_ab,0,sizeof(line_ab));
+	memset(&line_ba,0,sizeof(line_ba));
+	if(bench_end_init(&a,"modemA",&line_ba,&line_ab,0) < 0)
+		return -1;
+	if(bench_end_init(&b,"modemB",&line_ab,&line_ba,0x5a5a5a5a) < 0) {
+		bench_end_free(&a);
+		return -1;
+	}
+	a.tx_seed = b.rx_seed = 0x12345678 ^ mod->dp_id;
+	b.tx_seed = a.rx_seed = 0x87654321 ^ mod->dp_id;
+	total = bench_data_secs*mod->bps/10;
+	a.total = b.total = total;
+	limit = (unsigned long)bench_timeout*BENCH_RATE;
+
+	modem_timer_simulate(0);
+	if(bench_cycle)
+		snprintf(cmd,sizeof(cmd),"ATE0X3S93=%u+MS=%u,0\r",
+			 bench_cycle,mod->dp_id);
+	else
+		snprintf(cmd,sizeof(cmd),"ATE0X3+MS=%u,0\r",mod->dp_id);
+	bench_at(&a,cmd);
+	bench_at(&b,cmd);
+	bench_at(&a,"ATDT1\r");
+	bench_at(&b,"ATA\r");
+
+	cpu = cpu_time();
+	while(now < limit) {
+		bench_clock(&a,in,out);
+		bench_clock(&b,in,out);
+		now += bench_block;
+
+		modem_timer_simulate(now*MODEM_HZ/BENCH_RATE);
+		modem_timer_run();
+		if(a.modem->event)
+			modem_event(a.modem);
+		if(b.modem->event)
+			modem_event(b.modem);
+
+		bench_read_data(&a,now);
+		bench_read_data(&b,now);
+		if(a.state == BENCH_FAILED || b.state == BENCH_FAILED)
+			break;
+		bench_write_data(&a);
+		bench_write_data(&b);
+		if(a.rx_bytes >= total && b.rx_bytes >= total) {
+			ret = 0;
+			break;
+		}
+	}
+	cpu = cpu_time() - cpu;
+
+	res->sim = (double)now/BENCH_RATE;
+	res->cpu = cpu;
+	if(a.connect_time && b.connect_time) {
+		res->connected = 1;
+		res->rate = a.rate;
+		res->connect_time = (double)(a.connect_time > b.connect_time ?
+					     a.connect_time : b.connect_time)/BENCH_RATE;
+		ta = bench_throughput(&a,now);
+		tb = bench_throughput(&b,now);
+		res->throughput = ta < tb ? ta : tb;
+		ta = a.modem->rate_updates - a.rate_updates;
+		tb = b.modem->rate_updates - b.rate_updates;
+		res->retrains = ta > tb ? ta : tb;
+	}
+	if(a.errors || b.errors) {
+		INFO("%-8s data errors: A %u (first at %ld), B %u (first at %ld)\n",
+		     mod->name, a.errors, a.first_error,
+		     b.errors, b.first_error);
+		ret = -1;
+	}
+	res->ok = !ret;
+
+	if(!res->connected) {
+		INFO("%-8s no connect (%s%s)\n", mod->name,
+		     a.connect_time ? "" : "A",
+		     b.connect_time ? "" : "B");
+	}
+	else {
+		INFO("%-8s %5u bps  connect %6.2f s  data %5u/%5u %5u/%5u  "
+		     "%5u bps  retrains %u  %s\n",
+		     mod->name, res->rate, res->connect_time,
+		     a.rx_bytes, total, b.rx_bytes, total,
+		     res->throughput, res->retrains,
+		     ret ? "FAILED" : "ok");
+	}
+	INFO("%-8s sim %7.2f s  cpu %7.3f s  cpu/sim %.4f  %.3f Msamples/s\n",
+	     mod->name, res->sim, cpu,
+	     cpu/res->sim, cpu > 0 ? 2.0*now/cpu/1e6 : 0.0);
+	if(a.line) {
+		struct modem_line_stats sa, sb;
+		modem_line_get_stats(a.line,&sa);
+		modem_line_get_stats(b.line,&sb);
+		INFO("%-8s packets A->B %lu lost %lu late %lu, "
+		     "B->A %lu lost %lu late %lu\n", mod->name,
+		     sa.packets, sa.lost, sa.late,
+		     sb.packets, sb.lost, sb.late);
+	}
+
+	bench_end_free(&a);
+	bench_end_free(&b);
+	return ret;
+}
+
+
+/* line parameters that can be set and swept */
+
+static int set_line_param(const char *name, double val)
+{
+	struct modem_line_params *p = &bench_line_params;
+	if(!strcmp(name,"loss"))
+		p->loss = val;
+	else if(!strcmp(name,"burst"))
+		p->burst = val;
+	else if(!strcmp(name,"jitter"))
+		p->jitter = val;
+	else if(!strcmp(name,"jb"))
+		p->jb_delay = val;
+	else if(!strcmp(name,"ptime"))
+		p->ptime = val;
+	else if(!strcmp(name,"skew"))
+		p->skew = val;
+	else if(!strcmp(name,"gain"))
+		p->gain = val;
+	else if(!strcmp(name,"noise"))
+		p->noise = val;
+	else
+		return -1;
+	bench_impair = 1;
+	return 0;
+}
+
+#define MAX_LEVELS 32
+#define MAX_MODS   8
+
+static int bench_matrix(const char *sweep, const struct bench_mod **mods,
+			unsigned nmods)
+{
+	static struct bench_result res[MAX_LEVELS][MAX_MODS];
+	double levels[MAX_LEVELS];
+	unsigned nlevels = 0, i, j;
+	char name[32];
+	const char *p;
+	char *end;
+
+	p = strchr(sweep,'=');
+	if(!p || p - sweep >= sizeof(name))
+		return -1;
+	memcpy(name,sweep,p - sweep);
+	name[p - sweep] = '\0';
+	do {
+		p++;
+		if(nlevels == MAX_LEVELS)
+			return -1;
+		levels[nlevels++] = strtod(p,&end);
+		if(end == p)
+			return -1;
+		p = end;
+	} while(*p == ',');
+	if(*p || set_line_param(name,levels[0]) < 0)
+		return -1;
+
+	for(i = 0 ; i < nlevels ; i++) {
+		set_line_param(name,levels[i]);
+		INFO("--- %s = %g\n",name,levels[i]);
+		/* failed runs are results here, not errors */
+		for(j = 0 ; j < nmods ; j++)
+			bench_run(mods[j],&res[i][j]);
+	}
+
+	/* throughput in bps / retrains, NC: no connect, !: data incomplete */
+	printf("%-10s",name);
+	for(j = 0 ; j < nmods ; j++)
+		printf(" %13s",mods[j]->name);
+	printf("\n");
+	for(i = 0 ; i < nlevels ; i++) {
+		printf("%-10g",levels[i]);
+		for(j = 0 ; j < nmods ; j++) {
+			struct bench_result *r = &res[i][j];
+			char cell[32];
+			if(!r->connected)
+				snprintf(cell,sizeof(cell),"NC");
+			else
+				snprintf(cell,sizeof(cell),"%s%u/%u",
+					 r->ok ? "" : "!",
+					 r->throughput,r->retrains);
+			printf(" %13s",cell);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [modulation ...]\n"
+		"  -b <samples>   samples per modem_process() call (default %u)\n"
+		"  -c <ms>        DSP cycle, S93: 5 to 40 in steps of 5\n"
+		"  -t <seconds>   payload size in seconds at nominal rate (default %u)\n"
+		"  -T <seconds>   simulated time limit per run (default %u)\n"
+		"  -d             increase debug level\n"
+		"line model (enabled by any of these):\n"
+		"  -L u|a|none    G.711 law (default u)\n"
+		"  -l <percent>   packet loss\n"
+		"  -B <packets>   mean loss burst length (default 1)\n"
+		"  -j <ms>        mean extra packet delay\n"
+		"  -J <ms>        receiver playout delay (default 60)\n"
+		"  -p <ms>        packet time (default 20)\n"
+		"  -s <ppm>       clock skew\n"
+		"  -g <dB>        gain\n"
+		"  -n <dBm0>      noise level\n"
+		"  -S <seed>      random seed\n"
+		"  -M <param>=<v1>,<v2>,...\n"
+		"                 sweep loss, burst, jitter, jb, ptime, skew, gain\n"
+		"                 or noise and print a throughput/retrains matrix\n"
+		"modulations: V21 V22bis V32bis V34 (default all)\n",
+		prog, BENCH_BLOCK, BENCH_DATA_SECS, BENCH_TIMEOUT);
+	exit(2);
+}
+
+static const struct bench_mod *find_mod(const char *name)
+{
+	const struct bench_mod *mod;
+	char buf[16];
+	unsigned i, j;
+	for(mod = bench_mods ; mod->name ; mod++) {
+		/* compare ignoring '.' and case */
+		for(i = j = 0 ; mod->name[i] && j < sizeof(buf)-1 ; i++)
+			if(mod->name[i] != '.')
+				buf[j++] = mod->name[i];
+		buf[j] = '\0';
+		if(!strcasecmp(buf,name) || !strcasecmp(mod->name,name))
+			return mod;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct bench_mod *mods[MAX_MODS];
+	struct bench_result res;
+	const char *sweep = NULL;
+	unsigned nmods = 0;
+	int opt, i, failed = 0, block_set = 0;
+
+	modem_line_defaults(&bench_line_params);
+	while((opt = getopt(argc,argv,"b:c:t:T:dL:l:B:j:J:p:s:g:n:S:M:h")) != -1) {
+		switch(opt) {
+		case 'b':
+			bench_block = strtoul(optarg,NULL,0);
+			if(!bench_block || bench_block > BENCH_BLOCK*4)
+				usage(argv[0]);
+			block_set = 1;
+			break;
+		case 'c':
+			bench_cycle = strtoul(optarg,NULL,0);
+			if(bench_cycle < MODEM_CYCLE_TIME ||
+			   bench_cycle > MODEM_CYCLE_TIME_MAX ||
+			   bench_cycle % MODEM_CYCLE_TIME)
+				usage(argv[0]);
+			break;
+		case 't':
+			bench_data_secs = strtoul(optarg,NULL,0);
+			break;
+		case 'T':
+			bench_timeout = strtoul(optarg,NULL,0);
+			break;
+		case 'd':
+			modem_debug_level++;
+			break;
+		case 'L':
+			if(!strcasecmp(optarg,"u"))
+				bench_line_params.law = MODEM_LINE_ULAW;
+			else if(!strcasecmp(optarg,"a"))
+				bench_line_params.law = MODEM_LINE_ALAW;
+			else if(!strcasecmp(optarg,"none"))
+				bench_line_params.law = MODEM_LINE_LINEAR;
+			else
+				usage(argv[0]);
+			bench_impair = 1;
+			break;
+		case 'l': set_line_param("loss",atof(optarg)); break;
+		case 'B': set_line_param("burst",atof(optarg)); break;
+		case 'j': set_line_param("jitter",atof(optarg)); break;
+		case 'J': set_line_param("jb",atof(optarg)); break;
+		case 'p': set_line_param("ptime",atof(optarg)); break;
+		case 's': set_line_param("skew",atof(optarg)); break;
+		case 'g': set_line_param("gain",atof(optarg)); break;
+		case 'n': set_line_param("noise",atof(optarg)); break;
+		case 'S':
+			bench_line_params.seed = strtoul(optarg,NULL,0);
+			bench_impair = 1;
+			break;
+		case 'M':
+			sweep = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if(bench_cycle && !block_set)
+		bench_block = BENCH_RATE*bench_cycle/1000;
+	if(optind == argc) {
+		const struct bench_mod *mod;
+		for(mod = bench_mods ; mod->name ; mod++)
+			mods[nmods++] = mod;
+	}
+	for(i = optind ; i < argc ; i++) {
+		if(nmods == MAX_MODS)
+			usage(argv[0]);
+		mods[nmods] = find_mod(argv[i]);
+		if(!mods[nmods]) {
+			ERR("unknown modulation `%s'\n",argv[i]);
+			usage(argv[0]);
+		}
+		nmods++;
+	}
+
+	modem_debug_init("bench");
+	dp_dummy_init();
+	dp_sinus_init();
+	prop_dp_init();
+	if(modem_timer_init() < 0) {
+		ERR("cannot create timer: %s\n",strerror(errno));
+		exit(-1);
+	}
+
+	if(sweep) {
+		failed = bench_matrix(sweep,mods,nmods);
+		if(failed < 0) {
+			ERR("bad sweep `%s'\n",sweep);
+			usage(argv[0]);
+		}
+	}
+	else {
+		for(i = 0 ; i < nmods ; i++)
+			if(bench_run(mods[i],&res))
+				failed++;
+	}
+
+	dp_dummy_exit();
+	dp_sinus_exit();
+	prop_dp_exit();
+	modem_timer_exit();
+	modem_debug_exit();
+
+	return failed ? 1 : 0;
+}
@@ -53,6 +53,7 @@
 #include <modem.h>
 #include <modem_homolog.h>
 #include <modem_debug.h>
+#include <modem_g711.h>
 
 #define PR_INFO(fmt...) fprintf(stderr, fmt )
 
@@ -61,6 +62,7 @@
 
 /* modem.c */
 extern const char *modem_default_country;
+extern unsigned int modem_cycle_time;
 
 /* modem_debug.c */
 extern unsigned int modem_debug_level;
@@ -79,6 +81,11 @@ unsigned int use_alsa = 0;
 const char *modem_group = "dialout";
 unsigned int use_short_buffer = 0;
 mode_t modem_perm  = 0660;
+unsigned int modem_count = 1;
+unsigned int use_shm = 0;
+const char *modem_stats_file = NULL;
+const char *modem_agent = NULL;
+unsigned int modem_g711 = MODEM_G711_NONE;
 
 
 enum {
@@ -98,6 +105,12 @@ enum {
 	OPT_DEBUG,
 	OPT_LOG,
 	OPT_EXEC,
+	OPT_MODEMS,
+	OPT_SHM,
+	OPT_STATS,
+	OPT_AGENT,
+	OPT_LAW,
+	OPT_CYCLE,
 	OPT_LAST
 };
 
@@ -126,6 +139,12 @@ static struct opt {
 	{'d',"debug","debug level (developers only, for ./sl...)",OPTIONAL,INTEGER,"0"},
 	{'l',"log","logging mode",OPTIONAL,INTEGER,"5"},
 	{'e',"exec","path to external application that transmits audio over the socket (required)"},
+	{'m',"modems","number of modems (ttySL0..ttySL<n-1>) served by this process",MANDATORY,INTEGER,"1"},
+	{ 0 ,"shm","pass audio through shared memory rings (socket is kept for control)"},
+	{ 0 ,"stats","file rewritten every second with per modem statistics",MANDATORY,STRING,"none"},
+	{ 0 ,"agent","control socket of a running `d-modem -l', used instead of --exec",MANDATORY,STRING,"none"},
+	{ 0 ,"law","socket audio as 8 kHz G.711 bytes, `ulaw' or `alaw' (not with --shm)",MANDATORY,STRING,"none"},
+	{ 0 ,"cycle","DSP cycle in ms, 5 to 40 in steps of 5: default of S93",MANDATORY,INTEGER,"5"},
 	{}
 };
 
@@ -284,9 +303,45 @@ void modem_cmdline(int argc, char *argv[])
 		   (val= strtol(opt_list[OPT_LOG].arg_val,NULL,0)) > 0 )
 			modem_debug_logging = val;
 	}
+	if(opt_list[OPT_MODEMS].found) {
+		val = strtol(opt_list[OPT_MODEMS].arg_val,NULL,0);
+		if (val <= 0 || val > MODEM_MAX_INSTANCES)
+			usage(prog_name);
+		if (val > 1 && use_alsa) {
+			PR_INFO("ALSA mode supports only one modem.\n");
+			exit(1);
+		}
+		modem_count = val;
+	}
+	if(opt_list[OPT_SHM].found) {
+		if(use_alsa)
+			usage(prog_name);
+		use_shm = 1;
+	}
+	if(opt_list[OPT_STATS].found)
+		modem_stats_file = opt_list[OPT_STATS].arg_val;
+	if(opt_list[OPT_AGENT].found)
+		modem_agent = opt_list[OPT_AGENT].arg_val;
+	if(opt_list[OPT_CYCLE].found) {
+		val = strtol(opt_list[OPT_CYCLE].arg_val,NULL,0);
+		if (val < MODEM_CYCLE_TIME || val > MODEM_CYCLE_TIME_MAX ||
+		    val % MODEM_CYCLE_TIME)
+			usage(prog_name);
+		modem_cycle_time = val;
+	}
+	if(opt_list[OPT_LAW].found) {
+		if(!strcmp(opt_list[OPT_LAW].arg_val,"ulaw"))
+			modem_g711 = MODEM_G711_ULAW;
+		else if(!strcmp(opt_list[OPT_LAW].arg_val,"alaw"))
+			modem_g711 = MODEM_G711_ALAW;
+		else
+			usage(prog_name);
+		if(use_alsa || use_shm)
+			usage(prog_name);
+	}
 	if(opt_list[OPT_EXEC].found) {
 		modem_exec = opt_list[OPT_EXEC].arg_val;
-	} else {
+	} else if(!modem_agent) {
 		usage(prog_name);
 	}
 	if(!modem_dev_name) {
@@ -62,6 +62,7 @@
 
 /* V42bis parameters limitation */
 #define MIN_DICT_SIZE 512   /* min dictionary size enabled by protocol */
+#define MAX_DICT_SIZE 65535 /* max dictionary size enabled by protocol */
 #define MIN_STR_SIZE    6   /* min string size enabled by protocol     */
 #define MAX_STR_SIZE  250   /* max string size enabled by protocol     */
 
@@ -119,20 +120,109 @@ static char *show_string(struct comp_state *c, u16 cw)
 #define COMP_ERR(fmt,arg...) eprintf("err: " fmt , ##arg)
 
 
+/*
+ *  output: goes straight to the caller's buffer, what does not fit is
+ *  kept in spill[] and handed out first on the next call (comp_out_byte()
+ *  and comp_out_bytes() in modem.h, shared with the SLZ engine)
+ *
+ */
+
+/* set output buffer, returns 0 if spilled data still does not fit */
+static int out_begin(struct comp_state *c, u8 *out, int size)
+{
+	int cnt = c->slen - c->shead;
+	c->out = out;
+	c->osize = size;
+	c->olen = 0;
+	if (cnt > 0) {
+		if (cnt > size)
+			cnt = size;
+		memcpy(out, c->spill + c->shead, cnt);
+		c->olen = cnt;
+		c->shead += cnt;
+		if (c->shead < c->slen)
+			return 0;
+		c->shead = c->slen = 0;
+	}
+	return 1;
+}
+
+
 /*
  *  common procedures
  *
  */
 
+/*
+ *  dictionary: entries keep parent, char and number of children.
+ *  Children are found through an open addressed (parent,char) hash
+ *  with linear probing, childless entries through the leaf bitmap,
+ *  so entry recycling follows the V42bis order without list walks.
+ *
+ */
+
+#define LEAF_SET(c,e)  ((c)->leaf[(e)>>5] |=  (1U<<((e)&31)))
+#define LEAF_CLR(c,e)  ((c)->leaf[(e)>>5] &= ~(1U<<((e)&31)))
+
+static inline unsigned dict_hash(struct comp_state *c, u16 parent, u8 ch)
+{
+	return (((u32)parent<<8|ch)*2654435761U>>12)&c->hash_mask;
+}
+
+static inline void hash_insert(struct comp_state *c, u16 e)
+{
+	unsigned h = dict_hash(c,c->dict[e].parent,c->dict[e].ch);
+	while (c->hash[h])
+		h = (h+1)&c->hash_mask;
+	c->hash[h] = e;
+}
+
+static inline void hash_remove(struct comp_state *c, u16 e)
+{
+	unsigned h = dict_hash(c,c->dict[e].parent,c->dict[e].ch);
+	unsigned i, k;
+	while (c->hash[h] != e)
+		h = (h+1)&c->hash_mask;
+	/* shift back followers which probed past the hole */
+	for (i = h; ; ) {
+		c->hash[i] = 0;
+		do {
+			h = (h+1)&c->hash_mask;
+			if (!c->hash[h])
+				return;
+			k = dict_hash(c,c->dict[c->hash[h]].parent,
+				      c->dict[c->hash[h]].ch);
+		} while (((i-k)&c->hash_mask) >= ((h-k)&c->hash_mask));
+		c->hash[i] = c->hash[h];
+		i = h;
+	}
+}
+
+/* first leaf in [from,to), 0 if none */
+static inline u16 find_leaf(struct comp_state *c, unsigned from, unsigned to)
+{
+	u32 w;
+	while (from < to) {
+		w = c->leaf[from>>5]>>(from&31);
+		if (w) {
+			from += __builtin_ctz(w);
+			return from < to ? from : 0;
+		}
+		from = (from|31) + 1;
+	}
+	return 0;
+}
+
 /* initialize dictionary and params */
 static void dict_init(struct comp_state *c)
 {
 	int i;
 	for(i=0;i<c->dict_size;i++) {
-		c->dict[i].parent = 0;
-		c->dict[i].child  = 0;
-		c->dict[i].next   = 0;
+		c->dict[i].parent   = 0;
+		c->dict[i].children = 0;
 	}
+	memset(c->hash,0,(c->hash_mask+1)*sizeof(*c->hash));
+	memset(c->leaf,0xff,((c->dict_size+31)>>5)*sizeof(*c->leaf));
 	c->next_free    = FIRST_FREE;
 	c->last_matched = 0;
 	c->update_at	= 0;
@@ -151,15 +241,15 @@ static void dict_init(struct comp_state *c)
 /* match one char */
 INLINE_FUNC u16 match_char(struct comp_state *c, u16 at, u8 ch)
 {
+	register unsigned h;
 	register u16 e;
 	if (!at)
 		return ch + FIRST_ENTRY;
-	e = c->dict[at].child;
-	while(e) {
-		if (c->dict[e].ch == ch)
+	if (!c->dict[at].children)
+		return 0;
+	for (h = dict_hash(c,at,ch); (e = c->hash[h]); h = (h+1)&c->hash_mask)
+		if (c->dict[e].parent == at && c->dict[e].ch == ch)
 			return e;
-		e = c->dict[e].next;
-	}
 	return 0;
 }
 
@@ -171,25 +261,19 @@ INLINE_FUNC u16 add_char(struct comp_state *c, u16 at, u8 ch)
 	/* add */
 	c->dict[new].ch = ch;
 	c->dict[new].parent = at;
-	c->dict[new].child = 0;
-	c->dict[new].next = c->dict[at].child;
-	c->dict[at].child = new;
-	/* update next free */;
-	next = new;
-	do {
-		if (++next == c->dict_size)
-			next = FIRST_FREE;
-	} while(c->dict[next].child);
+	hash_insert(c,new);
+	if (!c->dict[at].children++)
+		LEAF_CLR(c,at);
+	/* update next free: the next leaf after new, cyclic */
+	next = find_leaf(c,new+1,c->dict_size);
+	if (!next)
+		next = find_leaf(c,FIRST_FREE,new+1);
 	if (c->dict[next].parent) {
 		u16 e = c->dict[next].parent;
-		if(c->dict[e].child == next)
-			c->dict[e].child = c->dict[next].next;
-		else {
-			e = c->dict[e].child;
-			while(c->dict[e].next != next)
-				e = c->dict[e].next;
-			c->dict[e].next = c->dict[next].next;
-		}
+		hash_remove(c,next);
+		if (!--c->dict[e].children)
+			LEAF_SET(c,e);
+		c->dict[next].parent = 0;
 	}
 	c->next_free = next;
 	return new;
@@ -211,9 +295,8 @@ INLINE_FUNC int send_string(struct comp_state *c)
 	c->str_data[c->str_len] = 0;
 	COMP_DBG("out string %d: '%s'\n",c->last_matched,c->str_data);
 #endif
-	memcpy(c->obuf+c->olen,c->str_data,c->str_len);
+	comp_out_bytes(c,c->str_data,c->str_len);
 	ret = c->str_len;
-	c->olen += ret;
 	c->str_len = 0;
 	c->flushed_len = 0;
 	return ret;
@@ -251,13 +334,15 @@ int comp_flush_decoder(struct comp_state *c)
 	return ret;
 }
 
-/* decoder */
-int comp_decode(struct comp_state *c, u8 *in, int n)
+/* decoder: returns number of input bytes consumed, stops early when
+   the output buffer is full */
+int comp_decode(struct comp_state *c, const u8 *in, int n)
 {
 	register int i, ret = 0;
 	register u16 cw, p;
+	int eid = -1; /* value of an escaped char not consumed yet */
 	u8 ch;
-	for (i = 0 ; i<n ;) {
+	for (i = 0 ; i<n && (c->olen < c->osize || eid >= 0) ;) {
 		switch (c->mode) {
 		case COMPRESSED:
 			/* get cw from input */
@@ -341,6 +426,7 @@ int comp_decode(struct comp_state *c, u8 *in, int n)
 			}
 			break;
 		case TRANSPARENT:
+			ch = eid >= 0 ? eid : *in;
 			if (c->escape) { /* command */
 				c->escape = 0;
 				switch(*in) {
@@ -355,8 +441,7 @@ int comp_decode(struct comp_state *c, u8 *in, int n)
 					//break;
 				case CC_EID: /* escape symbol */
 					COMP_DBG("T decoder: EID\n");
-					// fixme: don't rewrite in buf
-					*in = c->escape_char;
+					ch = eid = c->escape_char;
 					c->escape_char += ESCAPE_STEP;
 					break;
 				case CC_RESET: /* reset dict */
@@ -372,26 +457,26 @@ int comp_decode(struct comp_state *c, u8 *in, int n)
 					return -1;
 				}
 			}
-			else if (*in == c->escape_char) {
-				COMP_DBG("T dec ESCAPE %d\n", *in);
+			else if (eid < 0 && ch == c->escape_char) {
+				COMP_DBG("T dec ESCAPE %d\n", ch);
 				c->escape = 1;
 				in++; i++;
 				break;
 			}
 
-			//COMP_DBG1("dec rcv: %d(%c)\n", *in, *in);
+			//COMP_DBG1("dec rcv: %d(%c)\n", ch, ch);
 
 			if (c->update_at) {
-				if(!match_char(c,c->update_at,*in)) {
-					c->last_added = add_char(c,c->update_at,*in);
+				if(!match_char(c,c->update_at,ch)) {
+					c->last_added = add_char(c,c->update_at,ch);
 					COMP_DBG1("T dec add %d at %d: %d(%c) '%s'\n",
 						 c->last_added,c->update_at,
-						 *in,*in,show_string(c,c->last_added));
+						 ch,ch,show_string(c,c->last_added));
 				}
 				c->update_at = 0;
 			}
 
-			cw = match_char(c,c->last_matched,*in);
+			cw = match_char(c,c->last_matched,ch);
 			if(!cw) {
 				c->update_at = c->last_matched;
 				/* out  string */
@@ -406,20 +491,21 @@ int comp_decode(struct comp_state *c, u8 *in, int n)
 			}
 			else {
 				c->last_matched = cw;
-				c->str_data[c->str_len++] = *in++;
+				c->str_data[c->str_len++] = ch;
+				in++; i++;
+				eid = -1;
 				if (c->str_len + c->flushed_len == c->max_string) {
 					/* out string */
 					ret += send_string(c);
 					c->last_matched = 0;
 				}
-				i++;
 			}
 			break;
 		default:
 			return -1;
 		}
 	}
-	return ret;
+	return i;
 }
 
 
@@ -433,7 +519,7 @@ int comp_decode(struct comp_state *c, u8 *in, int n)
 #define ALIGN_BITS(c)	{ if((c)->bit_len%8) \
 				(c)->bit_len += 8 - (c)->bit_len%8; }
 #define SEND_BITS(c)	{ while((c)->bit_len >= 8) { \
-				(c)->obuf[c->olen++]=(c)->bit_data&0xff; \
+				comp_out_byte((c),(c)->bit_data&0xff); \
 				(c)->bit_data >>= 8; \
 				(c)->bit_len -= 8; ret++; \
 			  } }
@@ -453,11 +539,11 @@ static int send_data(struct comp_state *c, u16 cw)
 	switch(c->mode) {
 	case TRANSPARENT:
 		for (i = 0;i<c->str_len;i++) {
-			c->obuf[c->olen++] = c->str_data[i];
+			comp_out_byte(c,c->str_data[i]);
 			ret++;
 			if (c->str_data[i] == c->escape_char) {
 				COMP_DBG("T enc ESCAPE %d\n", c->escape_char);
-				c->obuf[c->olen++] = CC_EID;
+				comp_out_byte(c,CC_EID);
 				ret++;
 				c->escape_char += ESCAPE_STEP;
 			}
@@ -507,8 +593,8 @@ static int test_mode(struct comp_state *c)
 				ret += send_data(c,c->last_matched);
 				c->last_matched = 0;
 			}
-			c->obuf[c->olen++] = c->escape_char;
-			c->obuf[c->olen++] = CC_ECM;
+			comp_out_byte(c,c->escape_char);
+			comp_out_byte(c,CC_ECM);
 			ret += 2;
 			c->bit_data = 0;
 			c->mode = COMPRESSED;
@@ -573,14 +659,23 @@ int comp_flush_encoder(struct comp_state *c)
 }
 
 
-/* encoder */
+/* encoder: returns number of input chars consumed, stops early when
+   the output buffer is full */
 #define NEW_ENCODER 1
-int comp_encode(struct comp_state *c, u8 *in, int n)
+int comp_encode(struct comp_state *c, const u8 *in, int n)
 {
 	register int i, ret=0;
 	register u16 cw = 0;
+	int last = -1;
 
 	for(i=0;i<n;) {
+		/* out full: stop before starting on a new char, a char once
+		   looked at is finished (its output may spill) */
+		if (i != last) {
+			if (c->olen >= c->osize)
+				break;
+			last = i;
+		}
 		if (c->update_at) {
 			if (!match_char(c,c->update_at,*in)) {
 				c->last_added = add_char(c,c->update_at,*in);
@@ -593,6 +688,11 @@ int comp_encode(struct comp_state *c, u8 *in, int n)
 #if NEW_ENCODER
 		/* match string */
 		while(i<n) {
+			if (i != last) {
+				if (c->olen >= c->osize)
+					break;
+				last = i;
+			}
 			cw = match_char(c,c->last_matched,*in);
 			if (!cw) {
 				c->update_at = c->last_matched;
@@ -614,6 +714,14 @@ int comp_encode(struct comp_state *c, u8 *in, int n)
 				c->last_matched = 0;
 				break;
 			}
+			/* test after every char, as a flush may have moved
+			   cmp_last since the last test */
+			{
+				enum COMP_MODE mode = c->mode;
+				ret += test_mode(c);
+				if (c->mode != mode)
+					break;
+			}
 		}
 		ret += test_mode(c);
 	}
@@ -647,7 +755,7 @@ int comp_encode(struct comp_state *c, u8 *in, int n)
 	}
 	ret += test_mode(c);
 #endif
-	return ret;
+	return i;
 }
 
 
@@ -668,8 +776,8 @@ int comp_force_reset(struct comp_state *c)
 		ret = send_data(c,c->last_matched);
 		c->last_matched = 0;
 	}
-	c->obuf[c->olen++] = c->escape_char;
-	c->obuf[c->olen++] = CC_RESET;
+	comp_out_byte(c,c->escape_char);
+	comp_out_byte(c,CC_RESET);
 	ret += 2;
 	c->bit_data = 0;
 	dict_init(c);
@@ -692,8 +800,8 @@ int comp_force_change_mode(struct comp_state *c, enum COMP_MODE mode)
 	if (c->mode == TRANSPARENT) {
 		COMP_DBG("encoder %ld/%ld %d: switch to COMPRESSED mode.\n",
 			 c->cmp_bits,c->raw_bits,c->cmp_last);
-		c->obuf[c->olen++] = c->escape_char;
-		c->obuf[c->olen++] = CCW_ECM;
+		comp_out_byte(c,c->escape_char);
+		comp_out_byte(c,CCW_ECM);
 		ret += 2;
 		c->bit_data = 0;
 		c->mode = COMPRESSED;
@@ -721,28 +829,42 @@ int comp_force_change_mode(struct comp_state *c, enum COMP_MODE mode)
 int comp_init(struct comp_state *c,int dict_size,int max_str)
 {
 	struct dict *d;
+	unsigned hash_size;
 	int i;
 	memset(c,0,sizeof(*c));
-	if (dict_size < MIN_DICT_SIZE ||
+	if (dict_size < MIN_DICT_SIZE || dict_size > MAX_DICT_SIZE ||
 	    max_str < MIN_STR_SIZE || max_str > MAX_STR_SIZE)
 		return -1;
+	/* keep the hash at most a quarter full, probe runs stay short */
+	for (hash_size = 1; hash_size < 4*dict_size; hash_size <<= 1)
+		;
 	/* alloc dict */
 	d = COMP_ALLOC(dict_size*sizeof(*d));
-	if (!d)
+	c->hash = COMP_ALLOC(hash_size*sizeof(*c->hash));
+	c->leaf = COMP_ALLOC(((dict_size+31)>>5)*sizeof(*c->leaf));
+	if (!d || !c->hash || !c->leaf) {
+		if (d)
+			COMP_FREE(d);
+		if (c->hash)
+			COMP_FREE(c->hash);
+		if (c->leaf)
+			COMP_FREE(c->leaf);
+		c->hash = NULL;
+		c->leaf = NULL;
 		return -1;
+	}
 	COMP_DBG("comp_init: dict size %d, max str %d (dict %d bytes).\n",
 			dict_size,max_str,dict_size*sizeof(*d));
 	memset(d,0,dict_size*sizeof(*d));
 	c->max_string= max_str;
 	c->dict_size = dict_size;
 	c->dict = d;
+	c->hash_mask = hash_size - 1;
 	/* init dict */
 	for(i=0;i<TOTAL_CHARS;i++) {
 		c->dict[i+FIRST_ENTRY].ch = i;
 	}
 	dict_init(c);
-	/* temporary */
-	c->olen = 0;
 	return 0;
 }
 
@@ -756,8 +878,6 @@ int comp_config(struct comp_state *c,int dict_size,int max_str)
 	c->max_string= max_str;
 	c->dict_size = dict_size;
 	//dict_init(c);
-	/* temporary */
-	//c->olen = 0;
 	return 0;
 }
 
@@ -770,6 +890,14 @@ int comp_exit(struct comp_state *c)
 		COMP_FREE(c->dict);
 		c->dict = NULL;
 	}
+	if(c->hash) {
+		COMP_FREE(c->hash);
+		c->hash = NULL;
+	}
+	if(c->leaf) {
+		COMP_FREE(c->leaf);
+		c->leaf = NULL;
+	}
 	return 0;
 }
 
@@ -783,11 +911,21 @@ int comp_exit(struct comp_state *c)
 extern int comp_init(struct comp_state *c,int dict_size,int max_str);
 extern int comp_config(struct comp_state *c,int dict_size,int max_str);
 extern int comp_exit(struct comp_state *c);
-extern int comp_encode(struct comp_state *c, u8 *in, int n);
-extern int comp_decode(struct comp_state *c, u8 *in, int n);
+extern int comp_encode(struct comp_state *c, const u8 *in, int n);
+extern int comp_decode(struct comp_state *c, const u8 *in, int n);
 extern int comp_flush_encoder(struct comp_state *c);
 extern int comp_flush_decoder(struct comp_state *c);
 
+extern int  slz_init(struct slz_state *v,int dict_size,int max_str,
+		     int hist_size);
+extern int  slz_config(struct comp_state *c, struct slz_state *v,
+		       int dict_size, int max_str, int hist_size);
+extern void slz_exit(struct slz_state *v);
+extern int  slz_encode(struct comp_state *c, const u8 *in, int n);
+extern int  slz_decode(struct comp_state *c, const u8 *in, int n);
+extern int  slz_flush_encoder(struct comp_state *c);
+extern int  slz_flush_decoder(struct comp_state *c);
+
 
 int modem_comp_init(struct modem *m)
 {
@@ -802,6 +940,18 @@ int modem_comp_init(struct modem *m)
 		comp_exit(&m->comp.encoder);
 		return ret;
 	}
+	/* SLZ is set up next to V42bis, XID picks one of them */
+	if (m->cfg.comp_slz &&
+	    (slz_init(&m->comp.slz_encoder,m->cfg.slz_dict_size,
+		      m->cfg.slz_max_string,m->cfg.slz_hist_size) ||
+	     slz_init(&m->comp.slz_decoder,m->cfg.slz_dict_size,
+		      m->cfg.slz_max_string,m->cfg.slz_hist_size))) {
+		COMP_ERR("modem_comp_init: no SLZ (%d/%d/%d).\n",
+			 m->cfg.slz_dict_size,m->cfg.slz_max_string,
+			 m->cfg.slz_hist_size);
+		slz_exit(&m->comp.slz_encoder);
+		m->cfg.comp_slz = 0;
+	}
 	return 0;
 }
 
@@ -816,72 +966,75 @@ int modem_comp_config(struct modem *m,int dict_size,int max_str)
 }
 
 
-void modem_comp_exit(struct modem *m)
+int modem_comp_config_slz(struct modem *m,int dict_size,int max_str,
+			  int hist_size)
 {
-	comp_exit(&m->comp.encoder);
-	comp_exit(&m->comp.decoder);
-	// temproary
-	m->comp.head = m->comp.count = 0;
+	int ret = 0;
+	if ((ret = slz_config(&m->comp.encoder,&m->comp.slz_encoder,
+			      dict_size,max_str,hist_size)) ||
+	    (ret = slz_config(&m->comp.decoder,&m->comp.slz_decoder,
+			      dict_size,max_str,hist_size)) ) {
+		COMP_ERR("modem_comp_config_slz: setup failed (%d/%d/%d).\n",
+			 dict_size,max_str,hist_size);
+		m->comp.encoder.slz = m->comp.decoder.slz = NULL;
+	}
+	return ret;
 }
 
 
-// FIXME: remove this stupest things
-static int get_odata(struct comp_state *c, char *buf, int n)
+void modem_comp_exit(struct modem *m)
 {
-        int ret = 0;
-        if(c->olen > 0) {
-                ret = c->olen - c->ohead < n ?
-                        c->olen - c->ohead : n;
-                memcpy(buf,c->obuf+c->ohead,ret);
-                c->ohead += ret;
-                if (c->ohead == c->olen) {
-                        c->ohead = 0;
-                        c->olen = 0;
-                }
-        }
-        return ret;
+	comp_exit(&m->comp.encoder);
+	comp_exit(&m->comp.decoder);
+	slz_exit(&m->comp.slz_encoder);
+	slz_exit(&m->comp.slz_decoder);
+	m->comp.encoder.slz = m->comp.decoder.slz = NULL;
 }
 
-int  modem_comp_encode(struct modem *m, u8 ch, char *buf, int n)
+
+/* encode up to n chars into buf: returns chars consumed, *len is the
+   room in buf on entry and the number of bytes written on return */
+int  modem_comp_encode(struct modem *m, const u8 *in, int n, char *buf, int *len)
 {
-	int ret;
-	ret = get_odata(&m->comp.encoder,buf,n);
-	if (ret == n) return ret;
-	if(comp_encode(&m->comp.encoder,&ch,1)<0)
-		return -1;
-	ret += get_odata(&m->comp.encoder,buf+ret,n-ret);
+	struct comp_state *c = &m->comp.encoder;
+	int ret = 0;
+	if (out_begin(c,(u8 *)buf,*len))
+		ret = c->slz ? slz_encode(c,in,n) : comp_encode(c,in,n);
+	*len = c->olen;
 	return ret;
 }
 
-int  modem_comp_decode(struct modem *m, u8 ch, char *buf, int n)
+int  modem_comp_decode(struct modem *m, const u8 *in, int n, char *buf, int *len)
 {
-	int ret;
-	ret = get_odata(&m->comp.decoder,buf,n);
-	if(ret == n) return ret;
-	if(comp_decode(&m->comp.decoder,&ch,1)<0)
-		return -1;
-	ret += get_odata(&m->comp.decoder,buf+ret,n-ret);
+	struct comp_state *c = &m->comp.decoder;
+	int ret = 0;
+	if (out_begin(c,(u8 *)buf,*len))
+		ret = c->slz ? slz_decode(c,in,n) : comp_decode(c,in,n);
+	*len = c->olen;
 	return ret;
 }
 
+/* returns number of bytes written to buf */
 int  modem_comp_flush_encoder(struct modem *m, char *buf, int n)
 {
-	int ret;
-	ret = get_odata(&m->comp.encoder,buf,n);
-	if (ret == n) return ret;
-	if(comp_flush_encoder(&m->comp.encoder) < 0)
-		return -1;
-	ret += get_odata(&m->comp.encoder,buf+ret,n-ret);
-	return ret;
+	struct comp_state *c = &m->comp.encoder;
+	if (out_begin(c,(u8 *)buf,n) && c->olen < n) {
+		if (c->slz)
+			slz_flush_encoder(c);
+		else
+			comp_flush_encoder(c);
+	}
+	return c->olen;
 }
 
 int  modem_comp_flush_decoder(struct modem *m, char *buf, int n)
 {
-	int ret;
-	ret = get_odata(&m->comp.decoder,buf,n);
-	if (ret == n) return ret;
-	if(comp_flush_decoder(&m->comp.decoder) < 0)
-		return -1;
-	ret += get_odata(&m->comp.decoder,buf+ret,n-ret);
-	return ret;
+	struct comp_state *c = &m->comp.decoder;
+	if (out_begin(c,(u8 *)buf,n) && c->olen < n) {
+		if (c->slz)
+			slz_flush_decoder(c);
+		else
+			comp_flush_decoder(c);
+	}
+	return c->olen;
 }
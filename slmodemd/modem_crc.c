@@ -0,0 +1,115 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_crc.c  --  HDLC frame check sequences (CRC-16 and CRC-32).
+ *
+ *    Both are the bit reversed ISO HDLC polynomials (V.42 8.1.1.6),
+ *    computed slice-by-8: eight table lookups per eight bytes with no
+ *    dependency between them, instead of eight dependent ones.
+ *
+ */
+
+#include <modem_crc.h>
+
+#define POLY16 0x8408
+#define POLY32 0xedb88320
+
+static u16 crc16_tab[8][256];
+static u32 crc32_tab[8][256];
+
+void modem_crc_init(void)
+{
+	static int done;
+	u16 c16;
+	u32 c32;
+	int i, j;
+	if (done)
+		return;
+	for (i = 0 ; i < 256 ; i++) {
+		c16 = i;
+		c32 = i;
+		for (j = 0 ; j < 8 ; j++) {
+			c16 = c16&1 ? (c16>>1)^POLY16 : c16>>1;
+			c32 = c32&1 ? (c32>>1)^POLY32 : c32>>1;
+		}
+		crc16_tab[0][i] = c16;
+		crc32_tab[0][i] = c32;
+	}
+	for (i = 0 ; i < 256 ; i++) {
+		for (j = 1 ; j < 8 ; j++) {
+			c16 = crc16_tab[j-1][i];
+			crc16_tab[j][i] = (c16>>8) ^ crc16_tab[0][c16&0xff];
+			c32 = crc32_tab[j-1][i];
+			crc32_tab[j][i] = (c32>>8) ^ crc32_tab[0][c32&0xff];
+		}
+	}
+	done = 1;
+}
+
+u16 modem_crc16(u16 fcs, const u8 *buf, int n)
+{
+	register u32 c = fcs;
+	while (n >= 8) {
+		c ^= buf[0] | buf[1]<<8;
+		c = crc16_tab[7][c&0xff] ^ crc16_tab[6][c>>8] ^
+			crc16_tab[5][buf[2]] ^ crc16_tab[4][buf[3]] ^
+			crc16_tab[3][buf[4]] ^ crc16_tab[2][buf[5]] ^
+			crc16_tab[1][buf[6]] ^ crc16_tab[0][buf[7]];
+		buf += 8;
+		n -= 8;
+	}
+	while (n-- > 0)
+		c = (c>>8) ^ crc16_tab[0][(c^*buf++)&0xff];
+	return c;
+}
+
+u32 modem_crc32(u32 fcs, const u8 *buf, int n)
+{
+	register u32 c = fcs, d;
+	while (n >= 8) {
+		c ^= buf[0] | buf[1]<<8 | buf[2]<<16 | (u32)buf[3]<<24;
+		d  = buf[4] | buf[5]<<8 | buf[6]<<16 | (u32)buf[7]<<24;
+		c = crc32_tab[7][c&0xff] ^ crc32_tab[6][(c>>8)&0xff] ^
+			crc32_tab[5][(c>>16)&0xff] ^ crc32_tab[4][c>>24] ^
+			crc32_tab[3][d&0xff] ^ crc32_tab[2][(d>>8)&0xff] ^
+			crc32_tab[1][(d>>16)&0xff] ^ crc32_tab[0][d>>24];
+		buf += 8;
+		n -= 8;
+	}
+	while (n-- > 0)
+		c = (c>>8) ^ crc32_tab[0][(c^*buf++)&0xff];
+	return c;
+}
@@ -0,0 +1,55 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_crc.h  --  HDLC frame check sequences (CRC-16 and CRC-32).
+ *
+ */
+
+#ifndef __MODEM_CRC_H__
+#define __MODEM_CRC_H__
+
+#include <modem_defs.h>
+
+#define INIT_FCS16    0xffff      /* Initial FCS16 value */
+#define GOOD_FCS16    0xf0b8      /* Good final FCS16 value */
+#define INIT_FCS32    0xffffffff  /* Initial FCS32 value */
+#define GOOD_FCS32    0xdebb20e3  /* Good final FCS32 value */
+
+extern void modem_crc_init(void);
+extern u16  modem_crc16(u16 fcs, const u8 *buf, int n);
+extern u32  modem_crc32(u32 fcs, const u8 *buf, int n);
+
+#endif /* __MODEM_CRC_H__ */
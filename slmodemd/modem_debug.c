@@ -50,9 +50,11 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/time.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <modem.h>
 #include <modem_debug.h>
@@ -63,32 +65,390 @@ unsigned int dsplibs_debug_level=0;
 
 static const char *modem_debug_logfile = "slmodem.log";
 
-static int modem_log_fd;
-
 /* logging */
 
+/* Records are put into an in-memory ring by the modem thread and copied
+   to the log file by a writer thread, so modem_process() never waits on
+   the disk. There is one producer (the modem thread) and one consumer:
+   the producer owns 'head', the writer owns 'tail', no lock is needed.
+   When the ring is full records are dropped and counted, the count goes
+   out as a MODEM_DBG_OVERFLOW record once there is room again.
+   The log file is written through a mapped window and rotated at a
+   record boundary: slmodem.log -> slmodem.log.1 -> ...
+   The writer also takes whole files from the modem thread, one at a
+   time (see modem_debug_put_file()), so that the stats file costs the
+   modem thread no file system calls either. */
+
+#define LOG_RING_SIZE  (2*1024*1024)   /* power of 2 */
+#define LOG_MAP_SIZE   (1024*1024)     /* file window mapped at once */
+#define LOG_FILE_SIZE  (128*1024*1024) /* rotate when it would get bigger */
+#define LOG_FILES      4               /* slmodem.log and 3 old ones */
+#define LOG_IDLE_USEC  20000           /* writer poll period when idle */
+
+static struct log_ring {
+	u8 *buf;
+	unsigned head;       /* producer: next byte to write */
+	unsigned tail;       /* writer: next byte to copy out */
+	unsigned lost;       /* records dropped, not yet reported */
+	unsigned lost_bytes; /* and their data bytes */
+	int stop;
+	int running;         /* writer started */
+	pthread_t writer;
+} log_ring;
+
+/* a file handed to the writer: set by the modem thread when empty,
+   cleared by the writer once it is written */
+static struct log_put {
+	const char *name;
+	char *data;
+	size_t len;
+	int err;             /* errno of the last write, for the modem thread */
+} log_put;
+
+static struct log_file {
+	char name[PATH_MAX];
+	int fd;
+	u8 *map;             /* window at map_off, NULL on error */
+	off_t map_off;
+	unsigned map_len;    /* bytes used in the window */
+	off_t size;          /* bytes in the file */
+} log_file;
+
+static void log_ring_put(unsigned pos, const void *data, unsigned len)
+{
+	unsigned off = pos & (LOG_RING_SIZE - 1);
+	unsigned n = LOG_RING_SIZE - off;
+	if (n > len)
+		n = len;
+	memcpy(log_ring.buf + off, data, n);
+	memcpy(log_ring.buf, (const u8 *)data + n, len - n);
+}
+
+static void log_ring_get(unsigned pos, void *data, unsigned len)
+{
+	unsigned off = pos & (LOG_RING_SIZE - 1);
+	unsigned n = LOG_RING_SIZE - off;
+	if (n > len)
+		n = len;
+	memcpy(data, log_ring.buf + off, n);
+	memcpy((u8 *)data + n, log_ring.buf, len - n);
+}
+
+static unsigned log_ring_space(void)
+{
+	return LOG_RING_SIZE - (log_ring.head -
+		__atomic_load_n(&log_ring.tail, __ATOMIC_ACQUIRE));
+}
+
+/* overflow record, at head: space is checked by the caller */
+static unsigned log_put_lost(unsigned head, struct sllog_header *hdr)
+{
+	unsigned lost[2];
+	hdr->modem_id = 0;
+	hdr->id = MODEM_DBG_OVERFLOW;
+	hdr->length = sizeof(lost);
+	lost[0] = log_ring.lost;
+	lost[1] = log_ring.lost_bytes;
+	log_ring_put(head, hdr, sizeof(*hdr));
+	log_ring_put(head + sizeof(*hdr), lost, sizeof(lost));
+	log_ring.lost = log_ring.lost_bytes = 0;
+	return head + sizeof(*hdr) + sizeof(lost);
+}
+
 int modem_debug_log_data(struct modem *m, unsigned id, const void *data, int count)
 {
 	struct sllog_header hdr;
-	int ret = 0;
-	if(id <= modem_debug_logging && modem_log_fd > 0) {
-		hdr.modem_id = (unsigned)m ;
-                hdr.id = id;
-                hdr.length = count;
-		ret = write(modem_log_fd,&hdr,sizeof(hdr));
-		if(ret < 0) {
-			fprintf(stderr,"log_data: cannot write header: %s\n",
-				strerror(errno));
-			return ret;
+	struct timespec ts;
+	unsigned head, need;
+
+	if(id > modem_debug_logging || !log_ring.buf)
+		return 0;
+
+	head = log_ring.head;
+	need = sizeof(hdr) + count;
+	if(log_ring.lost)
+		need += sizeof(hdr) + 2*sizeof(unsigned);
+	if(need > log_ring_space()) {
+		log_ring.lost++;
+		log_ring.lost_bytes += count;
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	hdr.sec  = ts.tv_sec;
+	hdr.nsec = ts.tv_nsec;
+	if(log_ring.lost)
+		head = log_put_lost(head, &hdr);
+	hdr.modem_id = (unsigned)(unsigned long)m;
+	hdr.id = id;
+	hdr.length = count;
+	log_ring_put(head, &hdr, sizeof(hdr));
+	log_ring_put(head + sizeof(hdr), data, count);
+	__atomic_store_n(&log_ring.head, head + sizeof(hdr) + count,
+			 __ATOMIC_RELEASE);
+	return count;
+}
+
+static void log_file_map(void)
+{
+	if(ftruncate(log_file.fd, log_file.map_off + LOG_MAP_SIZE) < 0) {
+		fprintf(stderr,"log: cannot extend `%s': %s\n",
+			log_file.name,strerror(errno));
+		return;
+	}
+	log_file.map = mmap(NULL, LOG_MAP_SIZE, PROT_READ|PROT_WRITE,
+			    MAP_SHARED, log_file.fd, log_file.map_off);
+	if(log_file.map == MAP_FAILED) {
+		fprintf(stderr,"log: cannot map `%s': %s\n",
+			log_file.name,strerror(errno));
+		log_file.map = NULL;
+	}
+}
+
+static int log_file_open(void)
+{
+	log_file.fd = open(log_file.name, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,
+			   S_IREAD|S_IWRITE);
+	if(log_file.fd < 0) {
+		fprintf(stderr,"cannot create `%s': %s\n",
+			log_file.name,strerror(errno));
+		return -1;
+	}
+	log_file.map_off = 0;
+	log_file.map_len = 0;
+	log_file.size = 0;
+	log_file_map();
+	return 0;
+}
+
+static void log_file_close(void)
+{
+	if(log_file.fd < 0)
+		return;
+	if(log_file.map)
+		munmap(log_file.map, LOG_MAP_SIZE);
+	log_file.map = NULL;
+	if(ftruncate(log_file.fd, log_file.size) < 0)
+		fprintf(stderr,"log: cannot truncate `%s': %s\n",
+			log_file.name,strerror(errno));
+	close(log_file.fd);
+	log_file.fd = -1;
+}
+
+static void log_file_rotate(void)
+{
+	char from[PATH_MAX+8], to[PATH_MAX+8];
+	int i;
+	log_file_close();
+	for(i = LOG_FILES - 1 ; i > 0 ; i--) {
+		if(i > 1)
+			snprintf(from,sizeof(from),"%s.%d",log_file.name,i-1);
+		else
+			snprintf(from,sizeof(from),"%s",log_file.name);
+		snprintf(to,sizeof(to),"%s.%d",log_file.name,i);
+		rename(from,to);
+	}
+	log_file_open();
+}
+
+/* a broken log file (disk full, etc) drops the data */
+static void log_file_write(unsigned pos, unsigned len)
+{
+	unsigned n;
+	while(len && log_file.map) {
+		if(log_file.map_len == LOG_MAP_SIZE) {
+			munmap(log_file.map, LOG_MAP_SIZE);
+			log_file.map = NULL;
+			log_file.map_off += LOG_MAP_SIZE;
+			log_file.map_len = 0;
+			log_file_map();
+			continue;
+		}
+		n = LOG_MAP_SIZE - log_file.map_len;
+		if(n > len)
+			n = len;
+		log_ring_get(pos, log_file.map + log_file.map_len, n);
+		log_file.map_len += n;
+		log_file.size += n;
+		pos += n;
+		len -= n;
+	}
+}
+
+/* written aside and renamed: readers never see a partial file */
+static int log_put_write(void)
+{
+	char tmp[PATH_MAX];
+	const char *p = log_put.data;
+	size_t len = log_put.len;
+	ssize_t n;
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", log_put.name);
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+	if(fd < 0)
+		return errno;
+	while(len) {
+		n = write(fd, p, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+			break;
+		p += n;
+		len -= n;
+	}
+	if(len || close(fd) < 0 || rename(tmp, log_put.name) < 0) {
+		int err = errno;
+		if(len)
+			close(fd);
+		unlink(tmp);
+		return err;
+	}
+	return 0;
+}
+
+static void *log_writer(void *arg)
+{
+	struct sllog_header hdr;
+	unsigned head, tail, len;
+	int stop;
+	for(;;) {
+		stop = __atomic_load_n(&log_ring.stop, __ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&log_put.data, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&log_put.err, log_put_write(),
+					 __ATOMIC_RELAXED);
+			free(log_put.data);
+			__atomic_store_n(&log_put.data, NULL,
+					 __ATOMIC_RELEASE);
+		}
+		head = __atomic_load_n(&log_ring.head, __ATOMIC_ACQUIRE);
+		tail = log_ring.tail;
+		if(head == tail) {
+			if(stop)
+				break;
+			usleep(LOG_IDLE_USEC);
+			continue;
 		}
-		ret = write(modem_log_fd,data,count);
-		if(ret < 0) {
-			fprintf(stderr,"log_data: cannot write data: %s\n",
-				strerror(errno));
-			return ret;
+		while(tail != head) {
+			log_ring_get(tail, &hdr, sizeof(hdr));
+			len = sizeof(hdr) + hdr.length;
+			if(log_file.size &&
+			   log_file.size + len > LOG_FILE_SIZE)
+				log_file_rotate();
+			log_file_write(tail, len);
+			tail += len;
+			__atomic_store_n(&log_ring.tail, tail,
+					 __ATOMIC_RELEASE);
 		}
 	}
-	return ret;
+	return NULL;
+}
+
+static int log_writer_start(void)
+{
+	pthread_attr_t attr;
+	struct sched_param prm;
+	int ret;
+
+	if(log_ring.running)
+		return 0;
+	log_ring.stop = 0;
+	/* the writer must not inherit the modem's real time priority */
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	prm.sched_priority = 0;
+	pthread_attr_setschedparam(&attr, &prm);
+	ret = pthread_create(&log_ring.writer, &attr, log_writer, NULL);
+	pthread_attr_destroy(&attr);
+	if(ret) {
+		fprintf(stderr,"cannot start log writer: %s\n",strerror(ret));
+		errno = ret;
+		return -1;
+	}
+	log_ring.running = 1;
+	return 0;
+}
+
+static int log_start(const char *name)
+{
+	snprintf(log_file.name, sizeof(log_file.name), "%s", name);
+	if(log_file_open() < 0)
+		return -1;
+	log_ring.buf = malloc(LOG_RING_SIZE);
+	if(!log_ring.buf) {
+		log_file_close();
+		return -1;
+	}
+	log_ring.head = log_ring.tail = 0;
+	log_ring.lost = log_ring.lost_bytes = 0;
+	if(log_writer_start() < 0) {
+		free(log_ring.buf);
+		log_ring.buf = NULL;
+		log_file_close();
+		return -1;
+	}
+	return 0;
+}
+
+static void log_stop(void)
+{
+	struct sllog_header hdr;
+	struct timespec ts;
+	if(!log_ring.running)
+		return;
+	if(log_ring.buf && log_ring.lost) {
+		/* report the last drops too: the writer makes room */
+		while(log_ring_space() < sizeof(hdr) + 2*sizeof(unsigned))
+			usleep(LOG_IDLE_USEC);
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		hdr.sec  = ts.tv_sec;
+		hdr.nsec = ts.tv_nsec;
+		__atomic_store_n(&log_ring.head,
+				 log_put_lost(log_ring.head, &hdr),
+				 __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&log_ring.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(log_ring.writer, NULL);
+	log_ring.running = 0;
+	free(log_put.data);
+	log_put.data = NULL;
+	if(!log_ring.buf)
+		return;
+	log_file_close();
+	free(log_ring.buf);
+	log_ring.buf = NULL;
+}
+
+/* starts the writer for modem_debug_put_file(), while threads can
+   still be created: before dropping privileges */
+int modem_debug_put_start(void)
+{
+	if(log_writer_start() < 0) {
+		log_put.err = errno;
+		return -1;
+	}
+	return 0;
+}
+
+/* Hands 'data' (malloc()ed, freed here or by the writer) to the writer,
+   which writes it aside and renames it over 'name'; 'name' must stay
+   valid. A file still waiting for the writer makes this one be dropped.
+   Returns the errno of the last write the writer finished, 0 if fine. */
+int modem_debug_put_file(const char *name, char *data, size_t len)
+{
+	if(!log_ring.running) {
+		free(data);
+		return log_put.err;
+	}
+	if(__atomic_load_n(&log_put.data, __ATOMIC_ACQUIRE)) {
+		free(data);
+		return 0;
+	}
+	log_put.name = name;
+	log_put.len = len;
+	__atomic_store_n(&log_put.data, data, __ATOMIC_RELEASE);
+	return __atomic_load_n(&log_put.err, __ATOMIC_RELAXED);
 }
 
 
@@ -97,13 +457,15 @@ int modem_debug_log_data(struct modem *m, unsigned id, const void *data, int cou
 
 static int debug_vprintf(unsigned level, const char *fmt, va_list args)
 {
-	static char debug_temp[512];
-        struct timeval tv;
+	char debug_temp[512];
+        struct timespec ts;
         int i, len;
-	gettimeofday(&tv,NULL);
+	clock_gettime(CLOCK_MONOTONIC,&ts);
 	i = snprintf(debug_temp,sizeof(debug_temp),"<%03ld.%06ld> ",
-		     (tv.tv_sec % 1000), tv.tv_usec);
+		     (ts.tv_sec % 1000), ts.tv_nsec / 1000);
         len = vsnprintf(debug_temp + i, sizeof(debug_temp) - i, fmt, args);
+	if(len > (int)sizeof(debug_temp) - i - 1)
+		len = sizeof(debug_temp) - i - 1;
 	if(modem_debug_logging)
 		modem_debug_log_data(0,
 				     MODEM_DBG_PRINT_MSG,debug_temp,len + i);
@@ -147,12 +509,8 @@ int modem_debug_init(const char *suffix)
 		}
 		else
 			name = modem_debug_logfile;
-		modem_log_fd = creat(name,S_IREAD|S_IWRITE);
-		if(modem_log_fd < 0) {
-			fprintf(stderr,"cannot create `%s': %s\n",
-				name,strerror(errno));
+		if(log_start(name) < 0)
 			return -1;
-		}
 		if(dsplibs_debug_level < 3)
 			dsplibs_debug_level = 3;
 	}
@@ -161,9 +519,6 @@ int modem_debug_init(const char *suffix)
 
 void modem_debug_exit()
 {
-	if(modem_log_fd > 0) {
-		close(modem_log_fd);
-		modem_log_fd = 0;
-	}
+	log_stop();
 }
 
@@ -63,7 +63,8 @@ enum MODEM_LOG_CATEGORIES {
 	/* 10-11 */
         MODEM_DBG_RX_CHARS,
         MODEM_DBG_TX_CHARS,
-        /* 'overflow marker' */
+        /* 'overflow marker': data is two unsigned, the number of
+           records dropped since the last one and their data bytes */
         MODEM_DBG_OVERFLOW
 };
 
@@ -72,6 +73,8 @@ struct sllog_header {
         unsigned modem_id;
         unsigned id;
         unsigned length;
+        unsigned sec;      /* CLOCK_MONOTONIC time of the record */
+        unsigned nsec;
         char     data[0];
 };
 
@@ -98,6 +101,8 @@ extern int modem_debug_log_data(struct modem *m, unsigned id, const void *, int)
 
 extern int  modem_debug_init(const char *suffix);
 extern void modem_debug_exit();
+extern int  modem_debug_put_start(void);
+extern int  modem_debug_put_file(const char *name, char *data, size_t len);
 
 
 #endif /* __MODEM_DEBUG_H__ */
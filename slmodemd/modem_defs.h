@@ -166,9 +166,11 @@ enum S_REGISTER {
         SREG_CONNNECT_MSG_FORMAT          = 70,
         SREG_CONNNECT_MSG_SPEED_SRC       = 71,
         SREG_ANS_DELAY                    = 92,
+        SREG_DP_CYCLE_TIME                = 93,    /* ms, modem_dp_process() slice */
 	/* new sgregs */
 	SREG_EC                           = 103,
 	SREG_COMP                         = 104,
+	SREG_COMP_SLZ                     = 105,   /* offer SLZ */
 
         SREG_DEFAULT_SETTING              = 161, // AT used
 #else
@@ -51,6 +51,7 @@
 #define LAPM_DFLT_INFO_SIZE 128  /* default info size */
 
 #define LAPM_MAX_RTX          5  /* max num of retransmissions (N400) */
+#define LAPM_SREJ_WIN_SIZE   63  /* max k with SREJ (modulus/2 - 1) */
 
 /* timeouts */
 // fixme: speed is parameter
@@ -102,6 +103,12 @@
 #define TX_RR(l,addr,pf_mask)  tx_super(l,addr,FRAME_S_RR,pf_mask)
 #define TX_RNR(l,addr,pf_mask) tx_super(l,addr,FRAME_S_RNR,pf_mask)
 #define TX_REJ(l,addr,pf_mask) tx_super(l,addr,FRAME_S_REJ,pf_mask)
+#define TX_SREJ(l,addr,nr,pf_mask) tx_super_nr(l,addr,FRAME_S_SREJ,nr,pf_mask)
+
+/* sequence number bitmaps */
+#define SEQ_SET(map,n)   ((map)[(n)>>5] |=  (1U<<((n)&31)))
+#define SEQ_CLR(map,n)   ((map)[(n)>>5] &= ~(1U<<((n)&31)))
+#define SEQ_TEST(map,n)  ((map)[(n)>>5] &   (1U<<((n)&31)))
 
 /* timers */
 #define T401_START(l) 	{ EC_DBG("T401 start.\n");\
@@ -135,11 +142,25 @@
 #define PI_RX_INFO_MAXSIZE	0x06
 #define PI_TX_WINDOW_SIZE	0x07
 #define PI_RX_WINDOW_SIZE	0x08
+/* optional functions bits (first octet) */
+#define OPTFUNC_SREJ		0x04
 /* private param negotiation */
 #define PI_PARAMETER_SET_ID	0x00
 #define PI_V42BIS_REQUEST	0x01
 #define PI_V42BIS_CW_NUMBER	0x02
 #define PI_V42BIS_MAX_STRING	0x03
+/* SLZ params: the same private group type, under a set id of our own
+   that V.42bis and V.44 peers skip */
+#define PARAM_SET_V42		0x563432
+#define PARAM_SET_SLZ		0x534c5a
+#define PI_SLZ_CAPABILITY	0x01
+#define PI_SLZ_REQUEST		0x02
+#define PI_SLZ_TX_CW_NUMBER	0x03
+#define PI_SLZ_RX_CW_NUMBER	0x04
+#define PI_SLZ_TX_MAX_STRING	0x05
+#define PI_SLZ_RX_MAX_STRING	0x06
+#define PI_SLZ_TX_HISTORY	0x07
+#define PI_SLZ_RX_HISTORY	0x08
 /* user data */
 /* fixme: ??? */
 
@@ -151,6 +172,9 @@ enum LAPM_STATES { LAPM_IDLE, LAPM_ESTAB, LAPM_DATA, LAPM_DISC };
 static int lapm_connect(struct lapm_state *l);
 static int lapm_disconnect(struct lapm_state *l);
 static void reset(struct lapm_state *l);
+static int alloc_info_frames(struct lapm_state *l);
+static int alloc_store_frames(struct lapm_state *l);
+static void push_rest_data(struct modem *m, int bits);
 
 /*
  * service functions
@@ -285,6 +309,11 @@ static int print_xid_params(char *str_buf, u8 *buf, int len)
 
 static int print_xid_private_params(char *str_buf, u8 *buf, int len)
 {
+	static const char *slz_names[] = {
+		"", "SLZ_CAP", "SLZ_REQUEST", "SLZ_TX_CWNUM", "SLZ_RX_CWNUM",
+		"SLZ_TX_MAXSTR", "SLZ_RX_MAXSTR", "SLZ_TX_HIST", "SLZ_RX_HIST"
+	};
+	u32 set = PARAM_SET_V42;
 	u8 pid, plen;
 	int i = 0;
 	while (len > 0) {
@@ -294,11 +323,19 @@ static int print_xid_private_params(char *str_buf, u8 *buf, int len)
 		len -= 2 + plen;
 		if (len < 0)
 			break;
-		switch (pid) {
-		case PI_PARAMETER_SET_ID:
-			i += sprintf(str_buf + i,"PARAM_SETID = 0x%x, ",
-				     lapm_get_be_val(buf,plen));
-			break;
+		if (pid == PI_PARAMETER_SET_ID) {
+			set = lapm_get_be_val(buf,plen);
+			i += sprintf(str_buf + i,"PARAM_SETID = 0x%x, ",set);
+		}
+		else if (set == PARAM_SET_SLZ) {
+			if (pid <= PI_SLZ_RX_HISTORY)
+				i += sprintf(str_buf + i,"%s = %d, ",
+					     slz_names[pid],
+					     lapm_get_be_val(buf,plen));
+			else
+				i += sprintf(str_buf + i,"??, ");
+		}
+		else switch (pid) {
 		case PI_V42BIS_REQUEST:
 			i += sprintf(str_buf + i,"V42BIS_REQUEST = 0x%x, ",
 				     lapm_get_be_val(buf,plen));
@@ -407,7 +444,7 @@ static int tx_unnum(struct lapm_state *l, u8 addr, u8 ctrl, u8 *info, int len)
 }
 
 /* S transmission */
-static int tx_super(struct lapm_state *l, u8 addr, u8 ctrl, u8 pf_mask)
+static int tx_super_nr(struct lapm_state *l, u8 addr, u8 ctrl, u8 nr, u8 pf_mask)
 {
 	frame_t *f = get_ctrl_frame(l);
 	if (!f) {
@@ -416,11 +453,16 @@ static int tx_super(struct lapm_state *l, u8 addr, u8 ctrl, u8 pf_mask)
 	}
 	f->buf[0] = addr;
 	f->buf[1] = ctrl;
-	f->buf[2] = (l->vr << 1)|pf_mask;
+	f->buf[2] = (nr << 1)|pf_mask;
 	f->size = 3;
 	return 0;
 }
 
+static inline int tx_super(struct lapm_state *l, u8 addr, u8 ctrl, u8 pf_mask)
+{
+	return tx_super_nr(l,addr,ctrl,l->vr,pf_mask);
+}
+
 
 /* parse xid */
 #define SET_PARAM(param,value,default) { \
@@ -431,7 +473,20 @@ static int tx_super(struct lapm_state *l, u8 addr, u8 ctrl, u8 pf_mask)
                  ((value)>=(default) && (param)>(value))) \
                 (param) = (value); }
 
-static int parse_xid_params(struct lapm_state *l, u8 *buf, int len)
+/* with SREJ old and new frames must not share a window: once the peer
+   has agreed to SREJ, k is run at most LAPM_SREJ_WIN_SIZE, whatever
+   it says.  Until then the full k is offered, for peers without SREJ */
+static void srej_win_clamp(struct lapm_state *l)
+{
+	if (!l->srej || !l->srej_settled)
+		return;
+	if (l->tx_win_size > LAPM_SREJ_WIN_SIZE)
+		l->tx_win_size = LAPM_SREJ_WIN_SIZE;
+	if (l->rx_win_size > LAPM_SREJ_WIN_SIZE)
+		l->rx_win_size = LAPM_SREJ_WIN_SIZE;
+}
+
+static int parse_xid_params(struct lapm_state *l, u8 *buf, int len, u32 *optfuncs)
 {
 	u32 pval;
 	u8 pid, plen;
@@ -445,6 +500,7 @@ static int parse_xid_params(struct lapm_state *l, u8 *buf, int len)
 		switch (pid) {
 		case PI_HDLC_OPTFUNCS:
 			pval = lapm_get_le_val(buf,plen);
+			*optfuncs = pval;
 			break;
 		case PI_TX_INFO_MAXSIZE:
 			pval = lapm_get_be_val(buf,plen);
@@ -473,8 +529,46 @@ static int parse_xid_params(struct lapm_state *l, u8 *buf, int len)
 }
 
 
+/* SLZ params: both directions run with the smaller of both sides;
+   a value below what SLZ runs with makes the whole offer unusable */
+static int parse_xid_slz_param(struct modem_config *cfg, u8 pid, u8 *buf, int plen)
+{
+	u32 pval = lapm_get_be_val(buf,plen);
+	u32 min;
+	int *param;
+	switch (pid) {
+	case PI_SLZ_REQUEST:
+		cfg->comp_slz = pval;
+		return 0;
+	case PI_SLZ_TX_CW_NUMBER:
+	case PI_SLZ_RX_CW_NUMBER:
+		param = &cfg->slz_dict_size;
+		min = SLZ_MIN_CODEWORDS;
+		break;
+	case PI_SLZ_TX_MAX_STRING:
+	case PI_SLZ_RX_MAX_STRING:
+		param = &cfg->slz_max_string;
+		min = SLZ_MIN_STRING;
+		break;
+	case PI_SLZ_TX_HISTORY:
+	case PI_SLZ_RX_HISTORY:
+		param = &cfg->slz_hist_size;
+		min = SLZ_MIN_HISTORY;
+		break;
+	default:
+		return 0;
+	}
+	if (pval < min)
+		return -1;
+	if (pval < *param)
+		*param = pval;
+	return 0;
+}
+
 static int parse_xid_private_params(struct lapm_state *l, struct modem_config *cfg, u8 *buf, int len)
 {
+	u32 pval, set = PARAM_SET_V42;
+	int slz_bad = 0;
 	u8 pid, plen;
 	while (len > 0) {
 		pid  = buf[0];
@@ -483,38 +577,58 @@ static int parse_xid_private_params(struct lapm_state *l, struct modem_config *c
 		len -= 2 + plen;
 		if (len < 0)
 			break;
-		switch (pid) {
-		case PI_PARAMETER_SET_ID:
-			//pval = lapm_get_be_val(buf,plen);
-			break;
+		if (pid == PI_PARAMETER_SET_ID)
+			set = lapm_get_be_val(buf,plen);
+		else if (set == PARAM_SET_SLZ)
+			slz_bad |= parse_xid_slz_param(cfg,pid,buf,plen);
+		else switch (pid) {
 		case PI_V42BIS_REQUEST:
 			cfg->comp = lapm_get_le_val(buf,plen);
 			break;
 		case PI_V42BIS_CW_NUMBER:
-			cfg->comp_dict_size = lapm_get_be_val(buf,plen);
+			/* the smaller dictionary of both sides */
+			pval = lapm_get_be_val(buf,plen);
+			if (pval > l->modem->cfg.comp_dict_size)
+				pval = l->modem->cfg.comp_dict_size;
+			cfg->comp_dict_size = pval;
 			break;
 		case PI_V42BIS_MAX_STRING:
-			cfg->comp_max_string = lapm_get_be_val(buf,plen);
+			pval = lapm_get_be_val(buf,plen);
+			if (pval > l->modem->cfg.comp_max_string)
+				pval = l->modem->cfg.comp_max_string;
+			cfg->comp_max_string = pval;
 			break;
 		default:
 			break;
 		}
 		buf += plen;
 	}
+	if (slz_bad && cfg->comp_slz) {
+		EC_DBG("SLZ params out of range, refused.\n");
+		cfg->comp_slz = 0;
+		l->slz_refused = 1;
+	}
 	return 0;
 }
 
-#define DEFAULT_MODEM_EC_CONFIG {1,1,15,15,128,128,0,512,6}
+#define DEFAULT_MODEM_EC_CONFIG {1,1,15,15,128,128,0,0,512,6}
 
 static int rx_xid(struct lapm_state *l, frame_t *f)
 {
 	struct modem_config cfg = DEFAULT_MODEM_EC_CONFIG;
 	u8 *buf = f->buf;
 	int len = f->count;
+	u32 optfuncs = 0;
 
 	/* skip addr and ctrl */
 	buf += 2; len -= 2;
 
+	l->slz_refused = 0;
+	/* SLZ params only go down from our own */
+	cfg.slz_dict_size  = l->modem->cfg.slz_dict_size;
+	cfg.slz_max_string = l->modem->cfg.slz_max_string;
+	cfg.slz_hist_size  = l->modem->cfg.slz_hist_size;
+
 	LAPM_PRINT_XID("rx_xid",f,len);
 	if (*buf != FI_GENERAL)
 		return -1;
@@ -529,7 +643,7 @@ static int rx_xid(struct lapm_state *l, frame_t *f)
 			break;
 		switch (gid) {
 		case GI_PARAM_NEGOTIATION:
-			parse_xid_params(l,buf,glen);
+			parse_xid_params(l,buf,glen,&optfuncs);
 			break;
 		case GI_PRIVATE_NEGOTIATION:
 			parse_xid_private_params(l,&cfg,buf,glen);
@@ -539,10 +653,16 @@ static int rx_xid(struct lapm_state *l, frame_t *f)
 		}
 		buf += glen;
 	}
+	/* SREJ only when both sides offer it */
+	if (!(optfuncs&OPTFUNC_SREJ))
+		l->srej = 0;
+	l->srej_settled = 1;
+	srej_win_clamp(l);
 	cfg.ec_tx_win_size  = l->tx_win_size;
 	cfg.ec_rx_win_size  = l->rx_win_size;
 	cfg.ec_tx_info_size = l->tx_info_size;
 	cfg.ec_rx_info_size = l->rx_info_size;
+	cfg.ec_srej = l->srej;
 	modem_update_config(l->modem,&cfg);
 	return 0;
 }
@@ -550,7 +670,7 @@ static int rx_xid(struct lapm_state *l, frame_t *f)
 static int tx_xid(struct lapm_state *l, u8 addr)
 {
 	u8 *buf;
-	int size = 2 + 1 + (3+19) + (3+15);
+	int size = 2 + 1 + (3+19) + (3+33) + (3+15);
 	int len = 0;
 	u32 pval;
 	int glen;
@@ -574,7 +694,7 @@ static int tx_xid(struct lapm_state *l, u8 addr)
 	len += 3;
 	*buf++ = PI_HDLC_OPTFUNCS;
 	*buf++ = 3; /* p length */ // v42vmi : 3
-	*buf++ = 0x8a; /* p value */
+	*buf++ = 0x8a | (l->srej ? OPTFUNC_SREJ : 0); /* p value */
 	*buf++ = 0x89;
 	*buf++ = 0x00; 
 	//*buf++ = 0x00;
@@ -596,6 +716,55 @@ static int tx_xid(struct lapm_state *l, u8 addr)
 	*buf++ = l->rx_win_size; /* p value */
 	len += glen;
 
+	/* SLZ goes first: a peer reading private params whatever the
+	   set id is then left with the V42bis ones.  A refused SLZ
+	   offer is answered with P0 = 0, so both ends fall back alike */
+	if(l->modem->cfg.comp &&
+	   (l->modem->cfg.comp_slz || l->slz_refused)) {
+		*buf++ = GI_PRIVATE_NEGOTIATION; /* group id */
+		glen = 33;                       /* group length (msb first) */
+		*buf++ = (glen>>8)&0xff;
+		*buf++ = glen&0xff;
+		len += 3;
+		*buf++ = PI_PARAMETER_SET_ID;
+		*buf++ = 3;    /* p length */
+		*buf++ = (PARAM_SET_SLZ>>16)&0xff; /* p value: "SLZ" */
+		*buf++ = (PARAM_SET_SLZ>>8)&0xff;
+		*buf++ = PARAM_SET_SLZ&0xff;
+		*buf++ = PI_SLZ_CAPABILITY;
+		*buf++ = 1; /* p length */
+		*buf++ = 0; /* no packet method */
+		*buf++ = PI_SLZ_REQUEST;
+		*buf++ = 1; /* p length */
+		/* 3 - compression in both direction */
+		*buf++ = l->modem->cfg.comp_slz ? l->modem->cfg.comp : 0;
+		pval = l->modem->cfg.slz_dict_size;
+		*buf++ = PI_SLZ_TX_CW_NUMBER;
+		*buf++ = 2; /* p length */
+		*buf++ = (pval>>8)&0xff; /* p value */
+		*buf++ = (pval&0xff);
+		*buf++ = PI_SLZ_RX_CW_NUMBER;
+		*buf++ = 2; /* p length */
+		*buf++ = (pval>>8)&0xff; /* p value */
+		*buf++ = (pval&0xff);
+		*buf++ = PI_SLZ_TX_MAX_STRING;
+		*buf++ = 1; /* p length */
+		*buf++ = l->modem->cfg.slz_max_string;
+		*buf++ = PI_SLZ_RX_MAX_STRING;
+		*buf++ = 1; /* p length */
+		*buf++ = l->modem->cfg.slz_max_string;
+		pval = l->modem->cfg.slz_hist_size;
+		*buf++ = PI_SLZ_TX_HISTORY;
+		*buf++ = 2; /* p length */
+		*buf++ = (pval>>8)&0xff; /* p value */
+		*buf++ = (pval&0xff);
+		*buf++ = PI_SLZ_RX_HISTORY;
+		*buf++ = 2; /* p length */
+		*buf++ = (pval>>8)&0xff; /* p value */
+		*buf++ = (pval&0xff);
+		len += glen;
+	}
+
 #if 1 /* v42bis-like compressor */
 	if(l->modem->cfg.comp) {
 		/* private param negotiation group */
@@ -642,6 +811,7 @@ static void t401_timeout(struct modem *m)
 {
 	struct lapm_state *l = &m->ec.lapm;
 	EC_DBG("t401_timeout: %d...\n",l->rtx_count);
+	l->stats.t401++;
 	if (l->rtx_count > LAPM_MAX_RTX ) {
 		EC_DBG("t401: max retransmission count was reached.\n");
 		l->rtx_count = 0;
@@ -707,10 +877,16 @@ static int tx_info(struct lapm_state *l)
 {
 	frame_t *f;
 	int n = 0;
-	if (l->peer_busy ||
-	    ((l->vs - l->va)&0x7f) >= l->tx_win_size) {
+	if (l->peer_busy)
+		return 0;
+	if (((l->vs - l->va)&0x7f) >= l->tx_win_size) {
+		if (!l->stalled && l->modem->xmit.count) {
+			l->stalled = 1;
+			l->stats.win_stalls++;
+		}
 		return 0;
 	}
+	l->stalled = 0;
 	if (l->tx_info == l->info_list) { /* empty tx */
 		if (l->info_list->next == l->tx_info ||
 		    l->info_list->next == l->sent_info) {
@@ -753,6 +929,10 @@ static int reject_info(struct lapm_state *l)
 		 l->va,l->vs,l->vr,n);
 	l->vs = l->va;
 	l->tx_info = l->sent_info;
+	/* pending selective resends are covered now */
+	memset(l->srej_rtx,0,sizeof(l->srej_rtx));
+	l->srej_pending = 0;
+	l->stats.rtx_frames += n;
 	l->tx_count += l->sent_count; // debug
 	l->sent_count = 0;            // debug
 	return n;
@@ -782,6 +962,10 @@ static int ack_info(struct lapm_state *l, u8 nr)
 		l->sent_info = l->sent_info->next;
 		l->sent_count--; // debug
 		l->info_count++; // debug
+		if (SEQ_TEST(l->srej_rtx,l->va)) {
+			SEQ_CLR(l->srej_rtx,l->va);
+			l->srej_pending--;
+		}
 		l->va = (l->va+1)&0x7f;
 		n++;
 	}
@@ -792,13 +976,152 @@ static int ack_info(struct lapm_state *l, u8 nr)
 	if(n > 0 && !l->rtx_count && !l->peer_busy) {
 #endif
 		TIMER_STOP(l);
-		if ((l->vs-l->va)&0x7f)
+		/* keep polling a busy peer, its RR may get lost */
+		if (((l->vs-l->va)&0x7f) || l->peer_busy)
 			TIMER_START(l); // exp.8.4.8
 	}
 	return n;
 }
 
 
+/* selective reject of one noacked frame: queue it for resend */
+static int srej_info(struct lapm_state *l, u8 nr)
+{
+	u8 out = (l->vs - l->va)&0x7f;
+	u8 n   = (nr - l->va)&0x7f;
+	frame_t *f;
+	u8 i;
+	if (l->state != LAPM_DATA) /* ignore retransmission */
+		return 0;
+	if (n >= out) {
+		EC_DBG("srej: nr %d is not outstanding.\n", nr);
+		return 0;
+	}
+	if (SEQ_TEST(l->srej_rtx,nr))
+		return 0;
+	EC_DBG("(va/vs/vr %d/%d/%d) srej info: resend %d...\n",
+	       l->va,l->vs,l->vr,nr);
+	SEQ_SET(l->srej_rtx,nr);
+	l->srej_pending++;
+	l->stats.rtx_frames++;
+	/* account what go-back-N would have sent again: all frames
+	   after the first rejected one of the current loss burst */
+	if (((l->gbn_end - l->va)&0x7f) > out)
+		l->gbn_end = l->va;
+	for (f = l->sent_info, i = 0; i < n; i++)
+		f = f->next;
+	if (n < ((l->gbn_end - l->va)&0x7f)) {
+		if (l->stats.srej_saved >= f->size - 3)
+			l->stats.srej_saved -= f->size - 3;
+	}
+	else {
+		for (f = f->next, i++; i < out; f = f->next, i++)
+			l->stats.srej_saved += f->size - 3;
+		l->gbn_end = l->vs;
+	}
+	return 1;
+}
+
+/* next frame queued by srej_info() */
+static frame_t *srej_get_frame(struct lapm_state *l)
+{
+	u8 out = (l->vs - l->va)&0x7f;
+	frame_t *f = l->sent_info;
+	u8 i, ns;
+	for (i = 0; i < out; i++, f = f->next) {
+		ns = (l->va + i)&0x7f;
+		if (SEQ_TEST(l->srej_rtx,ns)) {
+			SEQ_CLR(l->srej_rtx,ns);
+			l->srej_pending--;
+			l->sent_count--; // debug
+			l->tx_count++;   // debug
+			return f;
+		}
+	}
+	l->srej_pending = 0;
+	return NULL;
+}
+
+
+/* pass received info to the modem, enter busy state on overflow */
+static int deliver_info(struct lapm_state *l, u8 *buf, int count)
+{
+	int ret = 0;
+	if(l->modem->put_chars)
+		ret = l->modem->put_chars(l->modem,(const char*)buf,count);
+	if(ret<0) {
+		/* FIXME: handle error*/ ;
+		ret = 0;
+	}
+	if (ret != count) {
+		/* save rest data, enter busy state */
+		l->rx_head = 0;
+		l->rx_count = count - ret;
+		memcpy(l->rx_buf,buf+ret,l->rx_count);
+		// TBD
+		l->busy = 1;
+		// try to push rest data later
+		l->modem->packer_process = push_rest_data;
+	}
+	return ret;
+}
+
+/* deliver stored frames that are in sequence now */
+static int drain_store(struct lapm_state *l)
+{
+	frame_t *s;
+	int n = 0;
+	while (!l->busy && (s = l->rx_store[l->vr])) {
+		l->rx_store[l->vr] = NULL;
+		deliver_info(l,s->buf,s->count);
+		s->next = l->store_free;
+		l->store_free = s;
+		l->vr = (l->vr+1)&0x7f;
+		n++;
+	}
+	return n;
+}
+
+/* keep out of sequence frame, request missing ones by SREJ */
+static int store_info(struct lapm_state *l, frame_t *f)
+{
+	u8 ns = FRAME_NS(f);
+	frame_t *s;
+	u8 i;
+	if (((ns - l->vr)&0x7f) >= l->rx_win_size) { /* old duplicate */
+		EC_DBG("srej: duplicate ns %d, vr %d\n",ns,l->vr);
+		if (FRAME_I_PF(f))
+			TX_RR(l,l->rsp_addr,1);
+		return 0;
+	}
+	if (!l->rx_store[ns]) {
+		s = l->store_free;
+		if (!s)
+			return -1;
+		l->store_free = s->next;
+		memcpy(s->buf,f->buf+3,f->count-3);
+		s->count = f->count-3;
+		l->rx_store[ns] = s;
+		SEQ_CLR(l->srej_sent,ns);
+	}
+	/* request each missing frame once, keep ctrl frames for replies */
+	for (i = l->vr; i != ns; i = (i+1)&0x7f) {
+		if (l->rx_store[i] || SEQ_TEST(l->srej_sent,i))
+			continue;
+		if (l->ctrl_list->next == l->tx_ctrl ||
+		    l->ctrl_list->next->next == l->tx_ctrl)
+			break;
+		EC_DBG("tx srej %d...\n",i);
+		TX_SREJ(l,l->rsp_addr,i,0);
+		SEQ_SET(l->srej_sent,i);
+		l->stats.srej_tx++;
+	}
+	if (FRAME_I_PF(f))
+		TX_RR(l,l->rsp_addr,1);
+	return 0;
+}
+
+
 /* push rest data (when busy) */
 static void push_rest_data(struct modem *m, int bits)
 {
@@ -816,8 +1139,11 @@ static void push_rest_data(struct modem *m, int bits)
 				l->rx_head = 0;
 				/* reset busy state */
 				l->busy = 0;
-				TX_RR(l,l->cmd_addr,0);
 				l->modem->packer_process = NULL;
+				if (l->srej)
+					drain_store(l);
+				if (!l->busy)
+					TX_RR(l,l->cmd_addr,0);
 			}
 		}
 	}
@@ -826,7 +1152,7 @@ static void push_rest_data(struct modem *m, int bits)
 /* info frame process */
 static int rx_info(struct lapm_state *l, frame_t *f)
 {
-	int ret = 0, n;
+	int n;
 	//LAPM_PRINT_FRAME("rx_info",1,f);
 
 	/* ack I frames: nr -1 */
@@ -837,15 +1163,22 @@ static int rx_info(struct lapm_state *l, frame_t *f)
 			TX_RNR(l,l->rsp_addr,1);
 		return 0;
 	}
+	if (f->count - 3 > sizeof(l->rx_buf)) {
+		EC_ERR("rx_info: info field too long (%d).\n", f->count - 3);
+		return -1;
+	}
 	/* NS sequence error */
 	if (FRAME_NS(f)!= l->vr) {
 		/* TBD */ /* is info may be send */
 		EC_DBG("seq.error: ns %d, vr %d\n",FRAME_NS(f),l->vr);
+		if (l->srej && !store_info(l,f))
+			return -1;
 		// reject should be sent
 		if (l->reject) /* already sent */
 			return -1;
 		EC_DBG("tx reject...\n");
 		TX_REJ(l,l->rsp_addr,FRAME_I_PF(f));
+		l->stats.rej_tx++;
 		/* TX_REJ(l,l->cmd_addr,1); */
 		l->reject = 1;
 		// fixme: why to start timer
@@ -855,24 +1188,12 @@ static int rx_info(struct lapm_state *l, frame_t *f)
 	}
 	l->reject = 0;
 	/* recv data */
-	
-	if(l->modem->put_chars)
-		ret = l->modem->put_chars(l->modem,(const char*)(f->buf+3),f->count-3);
-	if(ret<0) {
-		/* FIXME: handle error*/ ;
-	}
-	if (ret != f->count-3) {
-		/* save rest data, enter busy state */
-		l->rx_head = 0;
-		l->rx_count = f->count - 3 - ret;
-		memcpy(l->rx_buf,f->buf+3+ret,l->rx_count);
-		// TBD
-		l->busy = 1;
-		// try to push rest data later
-		l->modem->packer_process = push_rest_data;
-	}
+	deliver_info(l,f->buf+3,f->count-3);
 	/* increment vr */
+	SEQ_CLR(l->srej_sent,l->vr);
 	l->vr = (l->vr+1)&0x7f;
+	if (l->srej)
+		drain_store(l);
 	/* response I,RR,RNR */
 	if (l->busy)
 		TX_RNR(l,FRAME_ADDR(f),FRAME_I_PF(f));
@@ -919,6 +1240,7 @@ static void rx_super_cmd(struct lapm_state *l, frame_t *f)
 	case FRAME_S_REJ:
 		/* clear peer_busy state */
 		l->peer_busy = 0;
+		l->stats.rej_rx++;
 		n = ack_info(l,FRAME_NR(f));
 		if (!l->rtx_count) {
 			TIMER_STOP(l);
@@ -933,9 +1255,21 @@ static void rx_super_cmd(struct lapm_state *l, frame_t *f)
 		}
 		break;
 	case FRAME_S_SREJ:
-		/* TBD, optional */
-		EC_ERR("unsupported SREJ command!\n");
-		return;
+		if (!l->srej) {
+			EC_ERR("unsupported SREJ command!\n");
+			return;
+		}
+		/* n(r) is the frame to resend, not an ack */
+		l->peer_busy = 0;
+		l->stats.srej_rx++;
+		srej_info(l,FRAME_NR(f));
+		if (FRAME_S_PF(f)) {
+			if (l->busy)
+				TX_RNR(l,FRAME_ADDR(f),FRAME_S_PF(f));
+			else
+				TX_RR(l,FRAME_ADDR(f),FRAME_S_PF(f));
+		}
+		break;
 	default:
 		EC_ERR("unknown s frame: %02x.\n",FRAME_CTRL(f));
 		return;
@@ -973,6 +1307,7 @@ static void rx_super_rsp(struct lapm_state *l, frame_t *f)
 		break;
 	case FRAME_S_REJ:
 		l->peer_busy = 0;
+		l->stats.rej_rx++;
 		n = ack_info(l,FRAME_NR(f));
 		if (!l->rtx_count || FRAME_S_PF(f)) {
 			reject_info(l);
@@ -980,9 +1315,14 @@ static void rx_super_rsp(struct lapm_state *l, frame_t *f)
 		}
 		break;
 	case FRAME_S_SREJ:
-		/* TBD, optional */
-		EC_ERR("unsupported SREJ response!\n");
-		return;
+		if (!l->srej) {
+			EC_ERR("unsupported SREJ response!\n");
+			return;
+		}
+		l->peer_busy = 0;
+		l->stats.srej_rx++;
+		srej_info(l,FRAME_NR(f));
+		break;
 	default:
 		EC_ERR("rx_s_rsp: unknown header %02x.\n", FRAME_CTRL(f));
 		return;
@@ -1151,6 +1491,13 @@ static frame_t *lapm_get_tx_frame(void *framer)
 	/* get info frame */
 	if ( l->peer_busy || l->config || l->state != LAPM_DATA)
 		return 0;
+	/* selectively rejected frames go first */
+	if ( l->srej_pending && (f = srej_get_frame(l)) ) {
+		f->buf[2] = l->vr << 1;
+		if (!l->modem->bit_timer)
+			TIMER_START(l);
+		return f;
+	}
 	if ( l->tx_info == l->info_list && !tx_info(l) )
 		return 0;
 	f = l->tx_info;
@@ -1297,35 +1644,110 @@ static void reset(struct lapm_state *l)
 	l->vr = 0;
 	/* discard pended data */
 	// l->rx_head = l->rx_count = 0;
-	/* discard info frames */
+	srej_win_clamp(l);
+	/* discard info frames, size the pool for the negotiated params */
+	alloc_info_frames(l);
 	l->sent_info = l->info_list;
 	l->tx_info   = l->info_list;
 	l->sent_count = l->tx_count = 0;
-	l->info_count = LAPM_INFO_FRAMES;
+	l->info_count = l->info_frames;
+	l->stalled = 0;
+	/* discard out of order frames and pending selective resends */
+	memset(l->rx_store,0,sizeof(l->rx_store));
+	memset(l->srej_sent,0,sizeof(l->srej_sent));
+	memset(l->srej_rtx,0,sizeof(l->srej_rtx));
+	l->srej_pending = 0;
+	l->gbn_end = 0;
+	if (l->srej)
+		alloc_store_frames(l);
 	/* discard ctrl frames */
 	// TBD ???
 }
 
-/* fixme: optimize mem usage */
-static int alloc_frames(struct lapm_state *l)
+/* info frames come from one block of tx_win_size + 1 frames with room
+   for tx_info_size bytes each; it is only reallocated when it has to
+   grow. */
+static int alloc_info_frames(struct lapm_state *l)
 {
-#define arrsize(a) (sizeof(a)/sizeof((a)[0]))
+	int frames = l->tx_win_size + 1;
+	int stride = (sizeof(frame_t) + 3 + l->tx_info_size + 7)&~7;
 	frame_t *f;
+	u8 *pool;
 	int i;
-	EC_DBG("alloc_frames: lapm size %d (info %d, ctrl %d).\n",
-	       sizeof(*l), sizeof(l->info_buf), sizeof(l->ctrl_buf));
-	/* init info list */
-	l->info_list = &l->info_buf[0].frame;
-	for (i=0;i<arrsize(l->info_buf);i++) {
-		f = &l->info_buf[i].frame;
-		f->next = &l->info_buf[i+1].frame;
-		f->buf  = l->info_buf[i].ctrl;
-		f->size = sizeof(l->info_buf[0]) - sizeof(frame_t);
+
+	if (!l->info_pool || frames > l->info_frames ||
+	    stride > l->info_stride) {
+		pool = malloc(frames*stride);
+		if (!pool) {
+			EC_ERR("alloc_info_frames: no memory for %d frames.\n",
+			       frames);
+			if (!l->info_pool)
+				return -1;
+			/* keep the old pool, shrink to it */
+			l->tx_win_size  = l->info_frames - 1;
+			l->tx_info_size = l->info_stride - sizeof(frame_t) - 3;
+			return 0;
+		}
+		free(l->info_pool);
+		l->info_pool   = pool;
+		l->info_frames = frames;
+		l->info_stride = stride;
+		EC_DBG("alloc_info_frames: %d frames of %d.\n", frames, stride);
+		l->info_list = (frame_t *)l->info_pool;
+		for (i=0;i<l->info_frames;i++) {
+			f = (frame_t *)(l->info_pool + i*l->info_stride);
+			f->next = (frame_t *)(l->info_pool +
+				   (i+1)%l->info_frames*l->info_stride);
+			f->buf  = (u8 *)(f + 1);
+			f->size = l->info_stride - sizeof(frame_t);
+		}
 	}
-	f->next = l->info_list;
-	l->info_count= arrsize(l->info_buf); // debug
-	l->tx_info   = l->info_list;
-	l->sent_info = l->info_list;
+	return 0;
+}
+
+/* out of order store: rx_win_size frames of rx_info_size bytes kept
+   on a free list; without it SREJ mode falls back to REJ. */
+static int alloc_store_frames(struct lapm_state *l)
+{
+	int frames = l->rx_win_size;
+	int stride = (sizeof(frame_t) + l->rx_info_size + 7)&~7;
+	frame_t *f;
+	u8 *pool;
+	int i;
+
+	if (!l->store_pool || frames > l->store_frames ||
+	    stride > l->store_stride) {
+		pool = malloc(frames*stride);
+		if (!pool) {
+			EC_ERR("alloc_store_frames: no memory for %d frames.\n",
+			       frames);
+			free(l->store_pool);
+			l->store_pool = NULL;
+			l->store_frames = 0;
+			l->store_free = NULL;
+			return -1;
+		}
+		free(l->store_pool);
+		l->store_pool   = pool;
+		l->store_frames = frames;
+		l->store_stride = stride;
+	}
+	l->store_free = NULL;
+	for (i=0;i<l->store_frames;i++) {
+		f = (frame_t *)(l->store_pool + i*l->store_stride);
+		f->buf  = (u8 *)(f + 1);
+		f->size = l->store_stride - sizeof(frame_t);
+		f->next = l->store_free;
+		l->store_free = f;
+	}
+	return 0;
+}
+
+static int alloc_ctrl_frames(struct lapm_state *l)
+{
+#define arrsize(a) (sizeof(a)/sizeof((a)[0]))
+	frame_t *f;
+	int i;
 	/* init  ctrl list */
 	l->ctrl_list = &l->ctrl_buf[0].frame;
 	for (i=0;i<arrsize(l->ctrl_buf);i++) {
@@ -1343,6 +1765,8 @@ static int alloc_frames(struct lapm_state *l)
 
 static int lapm_init(struct lapm_state *l, struct modem *m)
 {
+	free(l->info_pool);
+	free(l->store_pool);
 	memset(l,0,sizeof(*l));
 	l->modem = m;
 	l->state      = LAPM_IDLE;
@@ -1356,15 +1780,34 @@ static int lapm_init(struct lapm_state *l, struct modem *m)
 	l->rx_win_size  = m->cfg.ec_rx_win_size;
 	l->tx_info_size = m->cfg.ec_tx_info_size;
 	l->rx_info_size = m->cfg.ec_rx_info_size;
+	l->srej         = m->cfg.ec_srej;
 
-	alloc_frames(l);
+	alloc_ctrl_frames(l);
+	if (alloc_info_frames(l) < 0)
+		return -1;
 	reset(l);
 	return 0;
 }
 
 static int lapm_exit(struct lapm_state *l)
 {
-	reset(l);
+	struct lapm_stats *st = &l->stats;
+	if (l->info_pool)
+		dprintf("%s ec: k %d, N401 %d%s: window stalls %u, "
+			"rtx frames %u, REJ rx %u tx %u, SREJ rx %u tx %u "
+			"(%u bytes saved), T401 %u\n",
+			l->modem->name, l->tx_win_size, l->tx_info_size,
+			l->srej ? ", SREJ" : "",
+			st->win_stalls, st->rtx_frames,
+			st->rej_rx, st->rej_tx, st->srej_rx, st->srej_tx,
+			st->srej_saved, st->t401);
+	free(l->info_pool);
+	l->info_pool = NULL;
+	free(l->store_pool);
+	l->store_pool = NULL;
+	l->store_frames = 0;
+	l->store_free = NULL;
+	l->info_frames = 0;
 	l->info_list = 0;
 	l->ctrl_list = 0;
 	return 0;
@@ -1413,8 +1856,7 @@ void modem_ec_stop(struct modem *m)
 int modem_ec_init(struct modem *m)
 {
 	struct lapm_state *l = &m->ec.lapm;
-	lapm_init(l,m);
-	return 0;
+	return lapm_init(l,m);
 }
 
 void modem_ec_exit(struct modem *m)
@@ -0,0 +1,186 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_g711.c  --  G.711 u-law and A-law conversions.
+ *
+ *    Follows the Sun Microsystems reference g711.c and matches, bit for
+ *    bit, the table driven conversions pjmedia is built with by default
+ *    (PJMEDIA_HAS_ALAW_ULAW_TABLE): the encoders only look at the top 14
+ *    bits of a sample.  Code here thus quantizes exactly like the SIP
+ *    side does.
+ *
+ */
+
+#include <modem_g711.h>
+
+#define	SIGN_BIT	(0x80)		/* sign bit for an A-law byte */
+#define	QUANT_MASK	(0xf)		/* quantization field mask */
+#define	SEG_SHIFT	(4)		/* left shift for segment number */
+#define	SEG_MASK	(0x70)		/* segment field mask */
+#define	BIAS		(0x84)		/* bias for linear code */
+
+static const short seg_end[8] = {
+	0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF
+};
+
+static int search(int val)
+{
+	int i;
+	for (i = 0; i < 8; i++)
+		if (val <= seg_end[i])
+			return i;
+	return 8;
+}
+
+unsigned char modem_linear2ulaw(int pcm_val)
+{
+	int mask, seg;
+
+	pcm_val &= ~3;
+	if (pcm_val < 0) {
+		pcm_val = BIAS - pcm_val;
+		mask = 0x7F;
+	} else {
+		pcm_val += BIAS;
+		mask = 0xFF;
+	}
+	seg = search(pcm_val);
+	if (seg >= 8)
+		return 0x7F ^ mask;
+	return ((seg << 4) | ((pcm_val >> (seg + 3)) & 0xF)) ^ mask;
+}
+
+int modem_ulaw2linear(unsigned char u_val)
+{
+	int t;
+
+	u_val = ~u_val;
+	t = ((u_val & QUANT_MASK) << 3) + BIAS;
+	t <<= ((unsigned)u_val & SEG_MASK) >> SEG_SHIFT;
+	return (u_val & SIGN_BIT) ? (BIAS - t) : (t - BIAS);
+}
+
+unsigned char modem_linear2alaw(int pcm_val)
+{
+	int mask, seg;
+	unsigned char aval;
+
+	pcm_val &= ~3;
+	if (pcm_val >= 0) {
+		mask = 0xD5;
+	} else {
+		mask = 0x55;
+		pcm_val = -pcm_val;
+	}
+	seg = search(pcm_val);
+	if (seg >= 8)
+		return 0x7F ^ mask;
+	aval = seg << SEG_SHIFT;
+	if (seg < 2)
+		aval |= (pcm_val >> 4) & QUANT_MASK;
+	else
+		aval |= (pcm_val >> (seg + 3)) & QUANT_MASK;
+	return aval ^ mask;
+}
+
+int modem_alaw2linear(unsigned char a_val)
+{
+	int t, seg;
+
+	a_val ^= 0x55;
+	t = (a_val & QUANT_MASK) << 4;
+	seg = ((unsigned)a_val & SEG_MASK) >> SEG_SHIFT;
+	switch (seg) {
+	case 0:
+		t += 8;
+		break;
+	case 1:
+		t += 0x108;
+		break;
+	default:
+		t += 0x108;
+		t <<= seg - 1;
+	}
+	return (a_val & SIGN_BIT) ? t : -t;
+}
+
+/*
+ *    Table driven buffer conversions.  Expanding is one lookup in 256
+ *    entries; compressing indexes by the 14 bits the encoders look at.
+ *    Tables are built on first use, 33KB for both laws.
+ */
+
+static short ulaw_linear[256], alaw_linear[256];
+static unsigned char linear_ulaw[1 << 14], linear_alaw[1 << 14];
+static int tables_ready;
+
+static void tables_init(void)
+{
+	int i;
+	for (i = 0; i < 256; i++) {
+		ulaw_linear[i] = modem_ulaw2linear(i);
+		alaw_linear[i] = modem_alaw2linear(i);
+	}
+	for (i = 0; i < 1 << 14; i++) {
+		linear_ulaw[i] = modem_linear2ulaw((short)(i << 2));
+		linear_alaw[i] = modem_linear2alaw((short)(i << 2));
+	}
+	tables_ready = 1;
+}
+
+void modem_g711_expand(int law, short *dst, const unsigned char *src,
+		       int count)
+{
+	const short *t;
+	int i;
+	if (!tables_ready)
+		tables_init();
+	t = law == MODEM_G711_ALAW ? alaw_linear : ulaw_linear;
+	for (i = 0; i < count; i++)
+		dst[i] = t[src[i]];
+}
+
+void modem_g711_compress(int law, unsigned char *dst, const short *src,
+			 int count)
+{
+	const unsigned char *t;
+	int i;
+	if (!tables_ready)
+		tables_init();
+	t = law == MODEM_G711_ALAW ? linear_alaw : linear_ulaw;
+	for (i = 0; i < count; i++)
+		dst[i] = t[(unsigned short)src[i] >> 2];
+}
@@ -0,0 +1,60 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_g711.h  --  G.711 u-law and A-law conversions.
+ *
+ */
+
+#ifndef __MODEM_G711_H__
+#define __MODEM_G711_H__
+
+extern unsigned char modem_linear2ulaw(int pcm_val);
+extern int modem_ulaw2linear(unsigned char u_val);
+extern unsigned char modem_linear2alaw(int pcm_val);
+extern int modem_alaw2linear(unsigned char a_val);
+
+/* companded audio channel: whole buffers through tables */
+#define MODEM_G711_NONE 0
+#define MODEM_G711_ULAW 1
+#define MODEM_G711_ALAW 2
+#define MODEM_G711_RATE 8000 /* it carries the line's own samples */
+
+extern void modem_g711_expand(int law, short *dst, const unsigned char *src,
+			      int count);
+extern void modem_g711_compress(int law, unsigned char *dst, const short *src,
+				int count);
+
+#endif /* __MODEM_G711_H__ */
@@ -0,0 +1,638 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_hdlc_bench.c  --  HDLC packer and FCS microbenchmark.
+ *
+ *    Checks the table driven HDLC code in modem_pack.c against the
+ *    original bit at a time implementation kept here as a reference:
+ *    random frames (some too big for the receiver) are stuffed by both
+ *    with every symbol size from 1 to 8 bits and the bit streams must
+ *    be identical.  The stream, with random bit errors added, is then
+ *    unstuffed by both and the received frames must be identical too.
+ *    The CRC-32 FCS is checked by a loop through the new code alone.
+ *
+ *    Then reports the speed of both packers and of the FCS routines.
+ *    The exit status is non zero if anything did not match.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <modem.h>
+#include <modem_debug.h>
+#include <modem_crc.h>
+
+#define INFO(fmt,args...) fprintf(stderr, fmt , ##args );
+#define ERR(fmt,args...) fprintf(stderr, "error: " fmt , ##args );
+
+#define MAX_FRAME   640   /* bigger than the 512 bytes rx buffer */
+#define MAX_RX_DATA (1<<22)
+
+static unsigned bench_frames = 2000;
+static unsigned bench_errors = 20;	/* bit errors per 100000 bits */
+static unsigned bench_seed = 1;
+static double bench_secs = 1.0;
+
+static unsigned rnd(void)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+
+/*
+ *    reference: bit at a time HDLC, as it was in modem_pack.c
+ *
+ */
+
+#define HDLC_FLAG   0x7e
+
+static u16 ref_fcstab[256];
+
+#define GET_FCS(fcs,c)	(((fcs) >> 8) ^ ref_fcstab[((fcs) ^ (c)) & 0xff])
+#define INIT_FCS    INIT_FCS16
+#define GOOD_FCS    GOOD_FCS16
+
+struct ref_hdlc {
+	struct bits_state pack, unpack;
+	frame_t *tx_frame;
+	frame_t *rx_frame;
+	int rx_error;
+	int rx_ones,tx_ones;
+	frame_t *(*get_tx_frame)(void *framer);
+	void (*rx_complete)(void *framer, frame_t *fr);
+	void *framer;
+	frame_t _rx_frame;
+	u8 _rx_buf[sizeof(((struct hdlc_state *)0)->_rx_buf)];
+};
+
+static void ref_start(struct ref_hdlc *h)
+{
+	int i, j;
+	u16 c;
+	for (i = 0 ; i < 256 ; i++) {
+		for (c = i, j = 0 ; j < 8 ; j++)
+			c = c&1 ? (c>>1)^0x8408 : c>>1;
+		ref_fcstab[i] = c;
+	}
+	memset(h,0,sizeof(*h));
+	h->rx_error = 1;
+	h->rx_frame = &h->_rx_frame;
+	h->rx_frame->buf  = h->_rx_buf;
+	h->rx_frame->size = sizeof(h->_rx_buf);
+	h->rx_frame->fcs  = INIT_FCS;
+}
+
+#define	HDLC_PUT_BYTE  { \
+	for( i = 0 ; i < 8 ; i++ ) { \
+		s->data<<=1; \
+		s->bit++; \
+		if(in&0x1) { \
+			h->tx_ones++; \
+		        s->data |= 0x1; \
+		        if (h->tx_ones==5) { \
+			        s->data<<=1; \
+			        s->bit++; \
+			        h->tx_ones = 0; \
+		        } \
+                } \
+		else { \
+			h->tx_ones = 0; \
+                } \
+		in>>=1; \
+	} }
+
+static int ref_get_bits(struct ref_hdlc *h, int nbits, u8 *bit_buf, int bit_cnt)
+{
+	struct bits_state *s = &h->pack;
+	int i, ret = 0;
+	u8 in, mask = ((1<<nbits) - 1);
+	do {
+		while ( bit_cnt > 0 && s->bit >= nbits) {
+			*bit_buf++ = (s->data>>(s->bit-nbits))&mask;
+			s->bit -= nbits;
+			ret ++;
+			bit_cnt--;
+		}
+		if (bit_cnt <= 0)
+			break;
+		if (!h->tx_frame) {
+			s->data <<= 8;
+			s->data |= HDLC_FLAG;
+			s->bit  += 8;
+			if (h->get_tx_frame &&
+			    (h->tx_frame = h->get_tx_frame(h->framer))) {
+				h->tx_frame->fcs = INIT_FCS;
+				h->tx_frame->count = 0;
+			}
+		}
+		else if(h->tx_frame->count == h->tx_frame->size) {
+			h->tx_frame->fcs ^= 0xffff;
+			in = h->tx_frame->fcs&0xff;
+			HDLC_PUT_BYTE;
+			in = (h->tx_frame->fcs>>8)&0xff;
+			HDLC_PUT_BYTE;
+			h->tx_ones = 0;
+			h->tx_frame = NULL;
+		}
+		else {
+			in = h->tx_frame->buf[h->tx_frame->count];
+			h->tx_frame->count++;
+			h->tx_frame->fcs = GET_FCS(h->tx_frame->fcs,in);
+			HDLC_PUT_BYTE;
+		}
+	} while (1);
+	return ret;
+}
+
+static int ref_put_bits(struct ref_hdlc *h, int nbits, u8 *bit_buf, int bit_cnt)
+{
+	struct bits_state *s = &h->unpack;
+	int i, ret = 0;
+	u8 in, out, mask = ((0x1<<nbits)-1);
+	while(bit_cnt > 0) {
+		s->data <<= nbits;
+		s->data |= *bit_buf++ & mask;
+		s->bit += nbits;
+		bit_cnt--;
+		ret++;
+		if ( s->bit < 8 + 8 + 2)
+			continue;
+		out = 0;
+		for ( i=0 ; i<8 ; i++ ) {
+			in = s->data >> (s->bit-8) ;
+			if (in == HDLC_FLAG) {
+				if ( !h->rx_frame->count ) ;
+				else if (h->rx_error) ;
+				else if (i) ;
+				else if ( h->rx_frame->count < 3 ) ;
+				else if ( h->rx_frame->fcs != GOOD_FCS ) ;
+				else if ( h->rx_complete ) {
+					h->rx_frame->count -= 2;
+					h->rx_complete(h->framer,h->rx_frame);
+				}
+				s->bit -= 8;
+				h->rx_ones = 0;
+				h->rx_error = 0;
+				h->rx_frame->fcs   = INIT_FCS;
+				h->rx_frame->count = 0;
+				break;
+			}
+			else if(h->rx_error) {
+				s->bit--;
+				continue;
+			}
+			out >>= 1;
+			if (in&0x80) {
+				out |= 0x80;
+				h->rx_ones++;
+				if (h->rx_ones == 5) {
+					if (in&0x40) {
+						h->rx_error++;
+						h->rx_frame->count = 0;
+					}
+					s->bit--;
+					h->rx_ones = 0;
+				}
+			}
+			else
+				h->rx_ones = 0;
+			s->bit--;
+		}
+		if(i==8 && !h->rx_error) {
+			if (h->rx_frame->count < h->rx_frame->size) {
+				h->rx_frame->buf[h->rx_frame->count] = out;
+				h->rx_frame->count++;
+				h->rx_frame->fcs = GET_FCS(h->rx_frame->fcs,out);
+			}
+			else {
+				h->rx_error++;
+				h->rx_frame->count = 0;
+			}
+		}
+	}
+	return ret;
+}
+
+
+/*
+ *    frame source and sink
+ *
+ */
+
+struct frames {
+	frame_t *frame;
+	u8 *data;
+	unsigned count, next;
+};
+
+struct sink {
+	u8 *buf;
+	unsigned len;
+	unsigned frames;
+};
+
+static frame_t *get_frame(void *framer)
+{
+	struct frames *fs = framer;
+	if (fs->next == fs->count)
+		return NULL;
+	return &fs->frame[fs->next++];
+}
+
+/* frames go to the sink as length (two bytes) and data */
+static void put_frame(void *framer, frame_t *f)
+{
+	struct sink *k = framer;
+	if (k->len + f->count + 2 > MAX_RX_DATA)
+		return;
+	k->buf[k->len++] = f->count&0xff;
+	k->buf[k->len++] = f->count>>8;
+	memcpy(k->buf + k->len, f->buf, f->count);
+	k->len += f->count;
+	k->frames++;
+}
+
+static void frames_init(struct frames *fs, unsigned count)
+{
+	unsigned i, j, size, total = 0;
+	fs->count = count;
+	fs->next = 0;
+	fs->frame = calloc(count,sizeof(*fs->frame));
+	fs->data = malloc(count*MAX_FRAME);
+	for (i = 0 ; i < count ; i++) {
+		frame_t *f = &fs->frame[i];
+		size = rnd()%64 ? 1 + rnd()%260 : 500 + rnd()%(MAX_FRAME-500);
+		f->buf = fs->data + total;
+		f->size = size;
+		/* plenty of ones runs and flag look-alikes */
+		for (j = 0 ; j < size ; j++) {
+			switch (rnd()%4) {
+			case 0:  f->buf[j] = 0xff; break;
+			case 1:  f->buf[j] = HDLC_FLAG; break;
+			default: f->buf[j] = rnd(); break;
+			}
+		}
+		total += size;
+	}
+}
+
+static unsigned frames_bits(struct frames *fs)
+{
+	unsigned i, bits = 0;
+	for (i = 0 ; i < fs->count ; i++)
+		bits += (fs->frame[i].size + 4)*10;
+	return bits + 64;
+}
+
+static double cpu_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/*
+ *    the two implementations behind one interface
+ *
+ */
+
+struct packer {
+	const char *name;
+	int  (*start)(void *p, struct frames *fs, struct sink *k);
+	int  (*get_bits)(void *p, int nbits, u8 *buf, int n);
+	int  (*put_bits)(void *p, int nbits, u8 *buf, int n);
+	void *p;
+};
+
+static struct ref_hdlc ref;
+static struct modem modem;
+
+static int ref_init(void *p, struct frames *fs, struct sink *k)
+{
+	ref_start(&ref);
+	ref.get_tx_frame = get_frame;
+	ref.rx_complete = put_frame;
+	/* one framer for both: source and sink are not used together */
+	ref.framer = fs ? (void *)fs : (void *)k;
+	return 0;
+}
+
+static int new_init(void *p, struct frames *fs, struct sink *k)
+{
+	struct hdlc_state *h = &modem.packer.hdlc;
+	int fcs32 = (long)p;
+	modem.name = "bench";
+	modem_hdlc_start(&modem);
+	h->get_tx_frame = get_frame;
+	h->rx_complete = put_frame;
+	h->framer = fs ? (void *)fs : (void *)k;
+	h->fcs32 = fcs32;
+	return 0;
+}
+
+static int ref_get(void *p, int nbits, u8 *buf, int n)
+{
+	return ref_get_bits(&ref,nbits,buf,n);
+}
+
+static int ref_put(void *p, int nbits, u8 *buf, int n)
+{
+	return ref_put_bits(&ref,nbits,buf,n);
+}
+
+static int new_get(void *p, int nbits, u8 *buf, int n)
+{
+	return modem_hdlc_get_bits(&modem,nbits,buf,n);
+}
+
+static int new_put(void *p, int nbits, u8 *buf, int n)
+{
+	return modem_hdlc_put_bits(&modem,nbits,buf,n);
+}
+
+static struct packer ref_packer = {"bitwise", ref_init, ref_get, ref_put, NULL};
+static struct packer new_packer = {"table", new_init, new_get, new_put, NULL};
+
+
+/* stuff all frames into sym[] in calls of random size */
+static unsigned pack(struct packer *pk, struct frames *fs, int nbits,
+		     u8 *sym, unsigned nsym, unsigned seed)
+{
+	unsigned n = 0, cnt;
+	bench_seed = seed;
+	fs->next = 0;
+	pk->start(pk->p,fs,NULL);
+	while (n < nsym) {
+		cnt = 1 + rnd()%64;
+		if (cnt > nsym - n)
+			cnt = nsym - n;
+		n += pk->get_bits(pk->p,nbits,sym + n,cnt);
+	}
+	return n;
+}
+
+static void unpack(struct packer *pk, struct sink *k, int nbits,
+		   u8 *sym, unsigned nsym, unsigned seed)
+{
+	unsigned n = 0, cnt;
+	bench_seed = seed;
+	k->len = k->frames = 0;
+	pk->start(pk->p,NULL,k);
+	while (n < nsym) {
+		cnt = 1 + rnd()%64;
+		if (cnt > nsym - n)
+			cnt = nsym - n;
+		n += pk->put_bits(pk->p,nbits,sym + n,cnt);
+	}
+}
+
+static unsigned corrupt(u8 *sym, unsigned nsym, int nbits)
+{
+	unsigned i, errors = 0;
+	for (i = 0 ; i < nsym ; i++)
+		if (rnd()%100000 < bench_errors*nbits) {
+			sym[i] ^= 1<<(rnd()%nbits);
+			errors++;
+		}
+	return errors;
+}
+
+/* the sink holds all frames which fit the receiver, as sent */
+static int sent_back(struct frames *fs, struct sink *k, unsigned max)
+{
+	unsigned i, pos = 0, len;
+	for (i = 0 ; i < fs->count ; i++) {
+		frame_t *f = &fs->frame[i];
+		if (f->size > max)
+			continue;
+		if (pos + 2 > k->len)
+			return 0;
+		len = k->buf[pos] | k->buf[pos+1]<<8;
+		pos += 2;
+		if (len != f->size || pos + len > k->len ||
+		    memcmp(k->buf + pos, f->buf, len))
+			return 0;
+		pos += len;
+	}
+	return pos == k->len;
+}
+
+static int check(struct frames *fs)
+{
+	struct sink k1, k2;
+	unsigned nsym, errors, seed;
+	u8 *s1, *s2;
+	int nbits, fails = 0;
+
+	k1.buf = malloc(MAX_RX_DATA);
+	k2.buf = malloc(MAX_RX_DATA);
+	for (nbits = 1 ; nbits <= 8 ; nbits++) {
+		nsym = frames_bits(fs)/nbits;
+		s1 = malloc(nsym);
+		s2 = malloc(nsym);
+		seed = rnd();
+		pack(&ref_packer,fs,nbits,s1,nsym,seed);
+		pack(&new_packer,fs,nbits,s2,nsym,seed);
+		if (memcmp(s1,s2,nsym)) {
+			ERR("%d bits: stuffed streams differ\n",nbits);
+			fails++;
+		}
+		bench_seed = seed;
+		errors = corrupt(s1,nsym,nbits);
+		seed = rnd();
+		unpack(&ref_packer,&k1,nbits,s1,nsym,seed);
+		unpack(&new_packer,&k2,nbits,s1,nsym,seed);
+		INFO("%d bits/symbol: %u frames, %u bit errors, "
+		     "%u/%u frames received\n",
+		     nbits,fs->count,errors,k1.frames,k2.frames);
+		if (k1.len != k2.len || memcmp(k1.buf,k2.buf,k1.len)) {
+			ERR("%d bits: received frames differ\n",nbits);
+			fails++;
+		}
+		/* 32-bit FCS: must come back as sent */
+		new_packer.p = (void *)1;
+		pack(&new_packer,fs,nbits,s2,nsym,seed);
+		unpack(&new_packer,&k2,nbits,s2,nsym,seed);
+		new_packer.p = NULL;
+		if (!sent_back(fs,&k2,sizeof(ref._rx_buf)-4)) {
+			ERR("%d bits: 32-bit FCS: frames lost or damaged\n",
+			    nbits);
+			fails++;
+		}
+		free(s1);
+		free(s2);
+	}
+	free(k1.buf);
+	free(k2.buf);
+	return fails;
+}
+
+/* Mbit/s of raw line bits through the packer */
+static void speed(struct packer *pk, struct frames *fs)
+{
+	struct sink k;
+	unsigned nsym = frames_bits(fs)/8, loops = 0;
+	u8 *sym = malloc(nsym);
+	double t, tx = 0, rx = 0;
+
+	k.buf = malloc(MAX_RX_DATA);
+	do {
+		t = cpu_time();
+		pack(pk,fs,8,sym,nsym,1);
+		tx += cpu_time() - t;
+		t = cpu_time();
+		unpack(pk,&k,8,sym,nsym,1);
+		rx += cpu_time() - t;
+		loops++;
+	} while (tx + rx < bench_secs);
+	INFO("%-8s  tx %7.1f Mbit/s   rx %7.1f Mbit/s\n", pk->name,
+	     nsym*8.0*loops/tx/1e6, nsym*8.0*loops/rx/1e6);
+	free(k.buf);
+	free(sym);
+}
+
+static void fcs_speed(void)
+{
+	static u8 buf[1<<16];
+	unsigned i, loops;
+	volatile u32 fcs = 0;
+	double t;
+
+	for (i = 0 ; i < sizeof(buf) ; i++)
+		buf[i] = rnd();
+	for (loops = 0, t = cpu_time() ; cpu_time() - t < bench_secs/4 ; loops++) {
+		u16 c = INIT_FCS;
+		for (i = 0 ; i < sizeof(buf) ; i++)
+			c = GET_FCS(c,buf[i]);
+		fcs += c;
+	}
+	INFO("crc16 bytewise  %7.1f MB/s\n", loops*sizeof(buf)/(cpu_time()-t)/1e6);
+	for (loops = 0, t = cpu_time() ; cpu_time() - t < bench_secs/4 ; loops++)
+		fcs += modem_crc16(INIT_FCS16,buf,sizeof(buf));
+	INFO("crc16 slice-by-8%7.1f MB/s\n", loops*sizeof(buf)/(cpu_time()-t)/1e6);
+	for (loops = 0, t = cpu_time() ; cpu_time() - t < bench_secs/4 ; loops++)
+		fcs += modem_crc32(INIT_FCS32,buf,sizeof(buf));
+	INFO("crc32 slice-by-8%7.1f MB/s\n", loops*sizeof(buf)/(cpu_time()-t)/1e6);
+}
+
+static int fcs_check(void)
+{
+	u8 buf[300];
+	unsigned i, n;
+	u16 c;
+	for (n = 0 ; n < 256 ; n++) {
+		for (i = 0 ; i < n ; i++)
+			buf[i] = rnd();
+		for (c = INIT_FCS, i = 0 ; i < n ; i++)
+			c = GET_FCS(c,buf[i]);
+		if (c != modem_crc16(INIT_FCS16,buf,n)) {
+			ERR("crc16 differs at length %u\n",n);
+			return 1;
+		}
+	}
+	/* the standard check value */
+	if ((modem_crc32(INIT_FCS32,(const u8 *)"123456789",9)^0xffffffff) != 0xcbf43926) {
+		ERR("crc32 check value\n");
+		return 1;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n <frames>  number of random frames (default %u)\n"
+		"  -e <errors>  bit errors per 100000 line bits (default %u)\n"
+		"  -s <seed>    random seed\n"
+		"  -t <secs>    CPU seconds per speed run (default %.1f)\n"
+		"  -d           debug messages\n",
+		prog,bench_frames,bench_errors,bench_secs);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct frames fs;
+	int opt, fails;
+
+	while((opt = getopt(argc,argv,"n:e:s:t:dh")) != -1) {
+		switch(opt) {
+		case 'n':
+			bench_frames = strtoul(optarg,NULL,0);
+			break;
+		case 'e':
+			bench_errors = strtoul(optarg,NULL,0);
+			break;
+		case 's':
+			bench_seed = strtoul(optarg,NULL,0);
+			if (!bench_seed)
+				bench_seed = 1;
+			break;
+		case 't':
+			bench_secs = atof(optarg);
+			break;
+		case 'd':
+			modem_debug_level++;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!bench_frames)
+		usage(argv[0]);
+
+	modem_crc_init();
+	ref_start(&ref);
+	frames_init(&fs,bench_frames);
+	fails = fcs_check();
+	fails += check(&fs);
+	INFO("%s\n", fails ? "FAILED" : "bit exact");
+	if (bench_secs > 0) {
+		speed(&ref_packer,&fs);
+		speed(&new_packer,&fs);
+		fcs_speed();
+	}
+	return fails ? 1 : 0;
+}
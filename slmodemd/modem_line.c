@@ -0,0 +1,245 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_line.c  --  VoIP line impairment simulator.
+ *
+ *    Models one direction of a modem call carried over RTP, at the
+ *    modem sample rate on both ends:
+ *
+ *      9600 Hz -> 8000 Hz, skewed by the sender/receiver clock offset
+ *              -> gain and additive white noise (the analog part)
+ *              -> G.711 u-law or A-law quantization
+ *              -> packets of ptime ms, lost in bursts (Gilbert model)
+ *                 or arriving later than the receiver's playout delay
+ *              -> 8000 Hz -> 9600 Hz
+ *
+ *    Lost and late packets play out as silence, as in the modem mode of
+ *    the d-modem jitter buffer.  All randomness comes from the seed, so
+ *    a run is reproducible.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <modem_line.h>
+#include <modem_g711.h>
+#include <modem_resample.h>
+
+#define LINE_RATE 8000
+
+/* rms of a 0 dBm0 tone in 16 bit linear: G.711 full scale is +3.17 dBm0 */
+#define LINE_DBM0_RMS 15773.0
+
+struct modem_line {
+	struct modem_line_params p;
+	struct modem_resampler *down, *up;
+	int16_t *ring;		/* packetization + playout delay, 8 kHz */
+	unsigned ring_size;
+	unsigned pos;		/* write position */
+	unsigned packet_len;	/* samples per packet */
+	unsigned packet_fill;
+	unsigned bad;		/* Gilbert model state */
+	double p_bad, p_good;	/* good->bad, bad->good transition */
+	double gain, noise_rms;
+	unsigned rand;
+	int have_gauss;
+	double gauss;
+	struct modem_line_stats stats;
+};
+
+void modem_line_defaults(struct modem_line_params *p)
+{
+	memset(p,0,sizeof(*p));
+	p->law = MODEM_LINE_ULAW;
+	p->ptime = 20;
+	p->burst = 1;
+	p->jb_delay = 60;
+	p->noise = MODEM_LINE_NOISE_OFF;
+	p->seed = 1;
+}
+
+
+/* xorshift32, uniform in (0,1) */
+static double line_rand(struct modem_line *l)
+{
+	unsigned x = l->rand;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	l->rand = x;
+	return ((x >> 8) + 0.5) / (1 << 24);
+}
+
+static double line_gauss(struct modem_line *l)
+{
+	double r, a;
+	if (l->have_gauss) {
+		l->have_gauss = 0;
+		return l->gauss;
+	}
+	r = sqrt(-2 * log(line_rand(l)));
+	a = 2 * M_PI * line_rand(l);
+	l->gauss = r * sin(a);
+	l->have_gauss = 1;
+	return r * cos(a);
+}
+
+
+struct modem_line *modem_line_create(const struct modem_line_params *p,
+				     unsigned rate)
+{
+	struct modem_line *l;
+	double loss;
+
+	l = malloc(sizeof(*l));
+	if (!l)
+		return NULL;
+	memset(l,0,sizeof(*l));
+	l->p = *p;
+	if (!l->p.ptime)
+		l->p.ptime = 20;
+	l->packet_len = LINE_RATE * l->p.ptime / 1000;
+	/* a packet is played once complete, plus the playout delay */
+	l->ring_size = l->packet_len + LINE_RATE * l->p.jb_delay / 1000;
+	l->ring = calloc(l->ring_size,sizeof(*l->ring));
+	l->down = modem_resample_create(rate,LINE_RATE);
+	l->up = modem_resample_create(LINE_RATE,rate);
+	if (!l->ring || !l->down || !l->up) {
+		modem_line_delete(l);
+		return NULL;
+	}
+	modem_resample_set_ppm(l->down,l->p.skew);
+
+	/* Gilbert model: mean burst 1/p_good, stationary loss p/(p+r) */
+	loss = l->p.loss / 100;
+	if (loss > 0.999)
+		loss = 0.999;
+	l->p_good = l->p.burst >= 1 ? 1 / l->p.burst : 1;
+	l->p_bad = loss > 0 ? loss * l->p_good / (1 - loss) : 0;
+	if (l->p_bad > 1)
+		l->p_bad = 1;
+
+	l->gain = pow(10,l->p.gain / 20);
+	l->noise_rms = l->p.noise > MODEM_LINE_NOISE_OFF ?
+		LINE_DBM0_RMS * pow(10,l->p.noise / 20) : 0;
+	l->rand = l->p.seed ? l->p.seed : 1;
+	return l;
+}
+
+void modem_line_delete(struct modem_line *l)
+{
+	if (l->down)
+		modem_resample_delete(l->down);
+	if (l->up)
+		modem_resample_delete(l->up);
+	free(l->ring);
+	free(l);
+}
+
+
+static int16_t line_sample(struct modem_line *l, int16_t s)
+{
+	double v = s * l->gain;
+	int q;
+	if (l->noise_rms)
+		v += l->noise_rms * line_gauss(l);
+	q = lrint(v);
+	if (q > 32767)
+		q = 32767;
+	else if (q < -32768)
+		q = -32768;
+	switch (l->p.law) {
+	case MODEM_LINE_ULAW:
+		return modem_ulaw2linear(modem_linear2ulaw(q));
+	case MODEM_LINE_ALAW:
+		return modem_alaw2linear(modem_linear2alaw(q));
+	}
+	return q;
+}
+
+/* the packet just completed at l->pos: decide whether it gets played */
+static void line_packet(struct modem_line *l)
+{
+	unsigned i, start;
+	int drop;
+
+	l->stats.packets++;
+	if (l->bad)
+		l->bad = line_rand(l) >= l->p_good;
+	else
+		l->bad = line_rand(l) < l->p_bad;
+	drop = l->bad;
+	if (drop)
+		l->stats.lost++;
+	else if (l->p.jitter > 0 &&
+		 -l->p.jitter * log(line_rand(l)) > l->p.jb_delay) {
+		l->stats.late++;
+		drop = 1;
+	}
+	if (!drop)
+		return;
+	start = (l->pos + l->ring_size - l->packet_len) % l->ring_size;
+	for (i = 0 ; i < l->packet_len ; i++)
+		l->ring[(start + i) % l->ring_size] = 0;
+}
+
+int modem_line_process(struct modem_line *l, const int16_t *in,
+		       int count, int16_t *out)
+{
+	int16_t buf[count + 2];	/* rate >= LINE_RATE */
+	int i, n;
+
+	n = modem_resample_process(l->down,in,count,buf);
+	for (i = 0 ; i < n ; i++) {
+		int16_t s = line_sample(l,buf[i]);
+		/* the slot being overwritten is the oldest one: play it */
+		buf[i] = l->ring[l->pos];
+		l->ring[l->pos] = s;
+		l->pos = (l->pos + 1) % l->ring_size;
+		if (++l->packet_fill == l->packet_len) {
+			l->packet_fill = 0;
+			line_packet(l);
+		}
+	}
+	return modem_resample_process(l->up,buf,n,out);
+}
+
+void modem_line_get_stats(struct modem_line *l, struct modem_line_stats *s)
+{
+	*s = l->stats;
+}
@@ -0,0 +1,84 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_line.h  --  VoIP line impairment simulator.
+ *
+ */
+
+#ifndef __MODEM_LINE_H__
+#define __MODEM_LINE_H__
+
+#include <stdint.h>
+
+#define MODEM_LINE_LINEAR 0
+#define MODEM_LINE_ULAW   1
+#define MODEM_LINE_ALAW   2
+
+#define MODEM_LINE_NOISE_OFF (-100.0)	/* noise level meaning no noise */
+
+struct modem_line_params {
+	unsigned law;		/* MODEM_LINE_* codec */
+	unsigned ptime;		/* packet duration, ms */
+	double loss;		/* packet loss, percent */
+	double burst;		/* mean loss burst length, packets */
+	double jitter;		/* mean extra packet delay, ms */
+	unsigned jb_delay;	/* receiver playout delay, ms */
+	double skew;		/* sender clock faster than receiver, ppm */
+	double gain;		/* dB */
+	double noise;		/* receiver noise, dBm0 */
+	unsigned seed;
+};
+
+struct modem_line_stats {
+	unsigned long packets;
+	unsigned long lost;	/* by the loss model */
+	unsigned long late;	/* missed the playout time */
+};
+
+struct modem_line;
+
+extern void modem_line_defaults(struct modem_line_params *p);
+extern struct modem_line *modem_line_create(const struct modem_line_params *p,
+					    unsigned rate);
+extern void modem_line_delete(struct modem_line *l);
+/* returns the number of samples written to out, which must have room
+   for count + 8 samples */
+extern int modem_line_process(struct modem_line *l, const int16_t *in,
+			      int count, int16_t *out);
+extern void modem_line_get_stats(struct modem_line *l,
+				 struct modem_line_stats *s);
+
+#endif /* __MODEM_LINE_H__ */
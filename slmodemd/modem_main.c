@@ -48,6 +48,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -55,6 +56,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/resource.h>
 #include <sched.h>
 #include <signal.h>
@@ -62,9 +64,12 @@
 #include <grp.h>
 #include <pwd.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 
 #define ENOIOCTLCMD 515
@@ -80,6 +85,10 @@
 
 #include <modem.h>
 #include <modem_debug.h>
+#include <modem_shm.h>
+#include <modem_agent.h>
+#include <modem_g711.h>
+#include <modem_resample.h>
 
 #define INFO(fmt,args...) fprintf(stderr, fmt , ##args );
 #define ERR(fmt,args...) fprintf(stderr, "error: " fmt , ##args );
@@ -91,8 +100,6 @@
 #define LOCKED_MEM_MIN_KB (8UL * 1024)
 #define LOCKED_MEM_MIN    (LOCKED_MEM_MIN_KB * 1024)
 
-#define CLOSE_COUNT_MAX 100
-
 
 /* modem init externals : FIXME remove it */
 extern int  dp_dummy_init(void);
@@ -113,11 +120,51 @@ extern const char *modem_group;
 extern mode_t modem_perm;
 extern unsigned int use_short_buffer;
 extern const char *modem_exec;
+extern const char *modem_agent;
+extern unsigned int modem_count;
+extern unsigned int use_shm;
+extern const char *modem_stats_file;
+extern unsigned int modem_g711;
+
+
+struct device_struct;
 
+struct io_source {
+	struct device_struct *dev;
+	int type;
+};
 
 struct device_struct {
 	int num;
 	int fd;
+	pid_t pid;
+	struct modem *modem;
+	int pty;
+	unsigned pty_closed;
+	unsigned pty_ready;
+	unsigned dev_ready;
+	struct io_source dev_src;
+	struct io_source pty_src;
+	/* shared memory transport: dev->fd is control/EOF only */
+	struct modem_shm *shm;
+	int shm_fd;
+	int event_fd;
+	struct io_source ctl_src;
+	/* idle connection to the agent, rings come in on it */
+	int agent_fd;
+	struct io_source agent_src;
+	unsigned long long agent_retry;
+	/* socket stream: half a sample read, bytes the socket refused */
+	int rx_part;
+	unsigned char rx_byte;
+	int tx_len;
+	char tx_tail[4096];
+	/* G.711 socket: line rate <-> MODEM_RATE */
+	struct modem_resampler *up;
+	struct modem_resampler *down;
+	char name[32];
+	char link_name[PATH_MAX];
+	char data_name[PATH_MAX];
 #ifdef SUPPORT_ALSA
 	snd_pcm_t *phandle;
 	snd_pcm_t *chandle;
@@ -557,6 +604,141 @@ struct modem_driver alsa_modem_driver = {
 #endif
 
 
+/*
+ *    reactor: one edge triggered epoll set for all devices and PTYs
+ *
+ */
+
+#define REACTOR_MAX_EVENTS 64
+#define REACTOR_STATS_PERIOD 10000 /* iterations */
+
+enum io_source_type { IO_SOURCE_DEV, IO_SOURCE_PTY, IO_SOURCE_TIMER, IO_SOURCE_CTL,
+		      IO_SOURCE_AGENT };
+
+static int reactor_fd = -1;
+
+static struct reactor_stats {
+	unsigned long loops;
+	unsigned long syscalls;
+	unsigned long last_loops;
+	unsigned long last_syscalls;
+} rstats;
+
+#define RSTATS_SYSCALL() (rstats.syscalls++)
+
+static int reactor_init(void)
+{
+	reactor_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (reactor_fd < 0) {
+		ERR("epoll_create: %s\n",strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int reactor_add(int fd, unsigned events, struct io_source *src)
+{
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = src;
+	if (epoll_ctl(reactor_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		ERR("epoll_ctl add %d: %s\n",fd,strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void reactor_del(int fd)
+{
+	/* fds may be shared with forked children: always remove explicitly */
+	if (fd >= 0 && reactor_fd >= 0)
+		epoll_ctl(reactor_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static void reactor_print_stats(const char *when)
+{
+	unsigned long loops = rstats.loops - rstats.last_loops;
+	unsigned long calls = rstats.syscalls - rstats.last_syscalls;
+	if (!loops)
+		return;
+	DBG("reactor %s: %lu iterations, %lu syscalls, %lu.%02lu syscalls/iteration\n",
+	    when, loops, calls, calls/loops, (calls*100/loops)%100);
+	rstats.last_loops = rstats.loops;
+	rstats.last_syscalls = rstats.syscalls;
+}
+
+
+
+/*
+ *    stats file: per modem 'key=value' lines, replaced about once a second
+ *
+ */
+
+#define STATS_PERIOD_MS 1000
+
+static unsigned long long stats_last;
+static int stats_failed;
+
+static unsigned long long monotonic_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* formatted in memory here, written and renamed by the log writer
+   thread: the modem thread never waits on the file system for it */
+static void stats_write(struct device_struct *devs, unsigned long period_ms)
+{
+	struct device_struct *dev;
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *f;
+	int err;
+
+	f = open_memstream(&buf, &len);
+	if (!f) {
+		err = errno;
+	} else {
+		for( dev = devs ; dev->modem ; dev++ )
+			modem_stats_print(dev->modem, f, period_ms);
+		if (fclose(f) == 0) {
+			err = modem_debug_put_file(modem_stats_file, buf, len);
+		} else {
+			err = errno;
+			free(buf);
+		}
+	}
+	if (!err) {
+		stats_failed = 0;
+		return;
+	}
+	if (!stats_failed)
+		ERR("cannot write stats file `%s': %s\n",
+		    modem_stats_file, strerror(err));
+	stats_failed = 1;
+}
+
+static void stats_check(struct device_struct *devs)
+{
+	unsigned long long now = monotonic_ns();
+	if (now - stats_last < STATS_PERIOD_MS * 1000000ULL)
+		return;
+	stats_write(devs, (now - stats_last) / 1000000);
+	stats_last = now;
+}
+
+static int dev_events(void)
+{
+#ifdef SUPPORT_ALSA
+	if(use_alsa) /* alsa_device_read() does not drain the device */
+		return EPOLLIN|EPOLLPRI;
+#endif
+	return EPOLLIN|EPOLLPRI|EPOLLET;
+}
+
+
 /*
  *    'driver' stuff
  *
@@ -613,15 +795,183 @@ struct modem_driver mdm_modem_driver = {
         .ioctl = modemap_ioctl,
 };
 
-static int socket_start (struct modem *m)
+/* shared memory audio rings, doorbell is an eventfd */
+static int shm_create(struct device_struct *dev)
 {
-	struct device_struct *dev = m->dev_data;
-	int ret;
-	DBG("socket_start...\n");
+	dev->shm_fd = memfd_create("slmodem-audio", MFD_CLOEXEC);
+	if (dev->shm_fd < 0) {
+		ERR("memfd_create: %s\n",strerror(errno));
+		return -1;
+	}
+	if (ftruncate(dev->shm_fd, sizeof(*dev->shm)) < 0) {
+		ERR("ftruncate shm: %s\n",strerror(errno));
+		goto error;
+	}
+	dev->shm = mmap(NULL, sizeof(*dev->shm), PROT_READ|PROT_WRITE,
+			MAP_SHARED, dev->shm_fd, 0);
+	if (dev->shm == MAP_FAILED) {
+		ERR("mmap shm: %s\n",strerror(errno));
+		dev->shm = NULL;
+		goto error;
+	}
+	modem_shm_init(dev->shm);
+	dev->event_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (dev->event_fd < 0) {
+		ERR("eventfd: %s\n",strerror(errno));
+		goto error;
+	}
+	return 0;
+ error:
+	if (dev->shm)
+		munmap(dev->shm, sizeof(*dev->shm));
+	dev->shm = NULL;
+	close(dev->shm_fd);
+	dev->shm_fd = -1;
+	return -1;
+}
 
+static void shm_release(struct device_struct *dev)
+{
+	if (!dev->shm)
+		return;
+	reactor_del(dev->event_fd);
+	close(dev->event_fd);
+	dev->event_fd = -1;
+	munmap(dev->shm, sizeof(*dev->shm));
+	dev->shm = NULL;
+	close(dev->shm_fd);
+	dev->shm_fd = -1;
+}
+
+#define AGENT_RETRY_NS 5000000000ULL /* agent down or full */
+
+static int agent_socket(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, modem_agent, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void agent_close(struct device_struct *dev)
+{
+	reactor_del(dev->agent_fd);
+	close(dev->agent_fd);
+	dev->agent_fd = -1;
+}
+
+/* an idle modem keeps a connection to d-modem -l open, so that incoming
+   calls can ring it and answering costs no connect */
+static void agent_listen(struct device_struct *dev)
+{
+	struct modem_agent_req req;
+	int fd;
+
+	dev->agent_retry = monotonic_ns() + AGENT_RETRY_NS;
+	fd = agent_socket();
+	if (fd < 0) {
+		DBG("%s: cannot connect to agent `%s': %s\n",
+		    dev->name, modem_agent, strerror(errno));
+		return;
+	}
+	modem_agent_req_init(&req, MODEM_AGENT_LISTEN, dev->name);
+	if (modem_agent_send(fd, &req, NULL, 0) < 0 ||
+	    reactor_add(fd, EPOLLIN, &dev->agent_src) < 0) {
+		ERR("%s: agent listen: %s\n", dev->name, strerror(errno));
+		close(fd);
+		return;
+	}
+	fcntl(fd,F_SETFL,O_NONBLOCK);
+	dev->agent_fd = fd;
+}
+
+/* the idle connection: RING, or EOF when the caller gave up or the
+   agent went away */
+static int modem_run_agent(struct device_struct *dev)
+{
+	struct modem_agent_req req;
+	int fds[MODEM_AGENT_MAX_FDS];
+	int nfds;
+
+	while(dev->agent_fd >= 0) {
+		errno = 0;
+		if (modem_agent_recv(dev->agent_fd, &req, fds, &nfds) < 0) {
+			if (errno == EAGAIN)
+				break;
+			DBG("%s: agent closed idle connection\n", dev->name);
+			agent_close(dev);
+			/* a cancelled call, or the agent is full: back soon */
+			dev->agent_retry = monotonic_ns() + AGENT_RETRY_NS/5;
+			break;
+		}
+		while (nfds > 0)
+			close(fds[--nfds]);
+		if (req.cmd != MODEM_AGENT_RING)
+			continue;
+		DBG("%s: RING from `%s'\n", dev->name, req.dial);
+		modem_ring_valid(dev->modem); /* may answer: takes agent_fd */
+	}
+	return 0;
+}
+
+/* the call goes over the idle connection if there is one; answering
+   needs it, it is where the ring came from */
+static int agent_connect(struct device_struct *dev, struct modem *m)
+{
+	struct modem_agent_req req;
+	int fds[2], fd;
+
+	fd = dev->agent_fd;
+	if (fd >= 0) {
+		reactor_del(fd);
+		dev->agent_fd = -1;
+	}
+	else if (!m->caller) {
+		ERR("%s: no incoming call to answer\n", dev->name);
+		return -1;
+	}
+	else if ((fd = agent_socket()) < 0) {
+		ERR("cannot connect to agent `%s': %s\n",
+		    modem_agent,strerror(errno));
+		return -1;
+	}
+	if (m->caller)
+		modem_agent_req_init(&req, MODEM_AGENT_DIAL, m->dial_string);
+	else
+		modem_agent_req_init(&req, MODEM_AGENT_ANSWER, NULL);
+	if (dev->shm) {
+		req.flags |= MODEM_AGENT_SHM;
+		fds[0] = dev->shm_fd;
+		fds[1] = dev->event_fd;
+	}
+	if (modem_g711 == MODEM_G711_ULAW)
+		req.flags |= MODEM_AGENT_ULAW;
+	else if (modem_g711 == MODEM_G711_ALAW)
+		req.flags |= MODEM_AGENT_ALAW;
+	if (modem_agent_send(fd, &req, fds, dev->shm ? 2 : 0) < 0) {
+		ERR("agent request: %s\n",strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* fork and exec the audio application, it gets the other end */
+static int exec_connect(struct device_struct *dev, const char *dial)
+{
 	int sockets[2];
 
-	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1) {
+	if (socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, sockets) == -1) {
 		perror("socketpair");
 		exit(-1);
 	}
@@ -632,24 +982,178 @@ static int socket_start (struct modem *m)
 		exit(-1);
 	}
 	if (pid == 0) { // child
-		char str[16];
+		char str[16], shm_str[16], event_str[16], ptime_str[16];
 		snprintf(str,sizeof(str),"%d",sockets[0]);
 		close(sockets[1]);
-		execl(modem_exec,modem_exec,m->dial_string,str,NULL);
-	} else {
-		close(sockets[0]);
-		dev->fd = sockets[1];
-		dev->delay = 0;
-		ret = 192*2;
-		memset(outbuf, 0 , ret);
-		ret = write(dev->fd, outbuf, ret);
-		DBG("done delay thing\n");
-		if (ret < 0) {
-			close(dev->fd);
-			dev->fd = -1;
+		fcntl(sockets[0],F_SETFD,0); /* only this end survives exec */
+		if (dev->modem->frag != MODEM_FRAG) {
+			snprintf(ptime_str,sizeof(ptime_str),"%d",
+				 dev->modem->frag * 1000 / dev->modem->srate);
+			setenv("DMODEM_PTIME", ptime_str, 1); /* frame = cycle */
+		}
+		if (modem_g711)
+			setenv("DMODEM_LAW", modem_g711 == MODEM_G711_ALAW ?
+			       "alaw" : "ulaw", 1);
+		if (dev->shm) {
+			snprintf(shm_str,sizeof(shm_str),"%d",dev->shm_fd);
+			snprintf(event_str,sizeof(event_str),"%d",dev->event_fd);
+			fcntl(dev->shm_fd,F_SETFD,0);
+			fcntl(dev->event_fd,F_SETFD,0);
+			execl(modem_exec,modem_exec,dial,str,
+			      shm_str,event_str,NULL);
+		}
+		else
+			execl(modem_exec,modem_exec,dial,str,NULL);
+		_exit(-1);
+	}
+	close(sockets[0]);
+	dev->pid = pid;
+	return sockets[1];
+}
+
+/* G.711 bytes on the socket are the line's samples at its own rate,
+   as the RTP stream carries them: only here are they expanded and
+   converted to and from MODEM_RATE, so the one companding step is
+   the codec's own */
+static unsigned char lawbuf[sizeof(outbuf)/2];
+static short linebuf[sizeof(outbuf)/2];
+
+static int law_read(struct device_struct *dev, char *buf, int count)
+{
+	int max = (count - 2) * MODEM_G711_RATE / MODEM_RATE, ret;
+
+	/* a few bytes may not make a sample yet */
+	do {
+		ret = read(dev->fd, lawbuf, max);
+		if (ret <= 0)
+			return ret;
+		modem_g711_expand(modem_g711, linebuf, lawbuf, ret);
+		ret = modem_resample_process(dev->up, linebuf, ret,
+					     (int16_t *)buf);
+	} while (!ret);
+	return ret;
+}
+
+/* socket samples are linear, or G.711 bytes (law_read()).  The peer
+   writes whatever fits, so reads and writes end anywhere in a sample:
+   a split sample is carried over, never dropped, or every later one
+   would be misaligned */
+static int sock_read(struct device_struct *dev, char *buf, int count)
+{
+	unsigned char *p = (unsigned char *)buf;
+	int len = dev->rx_part, ret;
+
+	if (modem_g711)
+		return law_read(dev, buf, count);
+	if (len)
+		p[0] = dev->rx_byte;
+	do {
+		ret = read(dev->fd, p + len, count*2 - len);
+		if (ret <= 0) { /* keep the byte, if one came */
+			dev->rx_part = len;
+			dev->rx_byte = p[0];
+			return ret;
+		}
+		len += ret;
+	} while (len < 2);
+	count = len / 2;
+	dev->rx_part = len % 2;
+	if (dev->rx_part)
+		dev->rx_byte = p[len - 1];
+	return count;
+}
+
+/* what the socket refuses is kept, in whole frames; a frame that does
+   not fit behind an earlier tail is dropped before any of it goes */
+static int sock_write(struct device_struct *dev, const char *buf, int count)
+{
+	int size = count*2, ret;
+
+	if (modem_g711) {
+		size = modem_resample_process(dev->down, (const int16_t *)buf,
+					      count, linebuf);
+		modem_g711_compress(modem_g711, lawbuf, linebuf, size);
+		buf = (const char *)lawbuf;
+	}
+	if (dev->tx_len) {
+		ret = write(dev->fd, dev->tx_tail, dev->tx_len);
+		if (ret < 0 && errno != EAGAIN)
 			return ret;
+		if (ret > 0) {
+			dev->tx_len -= ret;
+			memmove(dev->tx_tail, dev->tx_tail + ret, dev->tx_len);
+		}
+	}
+	ret = 0;
+	if (!dev->tx_len) {
+		ret = write(dev->fd, buf, size);
+		if (ret < 0) {
+			if (errno != EAGAIN)
+				return ret;
+			ret = 0;
 		}
-		dev->delay = ret/2;
+	}
+	if (ret == size)
+		return count;
+	if (dev->tx_len + size - ret > sizeof(dev->tx_tail)) {
+		errno = EAGAIN;
+		return -1;
+	}
+	memcpy(dev->tx_tail + dev->tx_len, buf + ret, size - ret);
+	dev->tx_len += size - ret;
+	return count;
+}
+
+static int socket_start (struct modem *m)
+{
+	struct device_struct *dev = m->dev_data;
+	int ret;
+	DBG("socket_start...\n");
+
+	if (use_shm && shm_create(dev) < 0)
+		return -1;
+
+	dev->fd = modem_agent ? agent_connect(dev, m) :
+				exec_connect(dev, m->dial_string);
+	if (dev->fd < 0) {
+		shm_release(dev);
+		return -1;
+	}
+
+	dev->delay = 0;
+	dev->rx_part = dev->tx_len = 0;
+	if (modem_g711) {
+		modem_resample_reset(dev->up);
+		modem_resample_reset(dev->down);
+	}
+	ret = 192;
+	memset(outbuf, 0 , ret*2);
+	if (dev->shm)
+		ret = modem_shm_ring_write(&dev->shm->tx,
+					   (int16_t *)outbuf, ret);
+	else
+		ret = sock_write(dev, outbuf, ret);
+	DBG("done delay thing\n");
+	if (ret < 0) {
+		close(dev->fd);
+		dev->fd = -1;
+		shm_release(dev);
+		return ret;
+	}
+	dev->delay = ret;
+	fcntl(dev->fd,F_SETFL,O_NONBLOCK);
+	dev->dev_ready = 0;
+	if (dev->shm)
+		ret = reactor_add(dev->fd, EPOLLIN|EPOLLET, &dev->ctl_src) ||
+		      reactor_add(dev->event_fd, EPOLLIN|EPOLLET, &dev->dev_src);
+	else
+		ret = reactor_add(dev->fd, dev_events(), &dev->dev_src);
+	if (ret) {
+		reactor_del(dev->fd);
+		close(dev->fd);
+		dev->fd = -1;
+		shm_release(dev);
+		return -1;
 	}
 	return 0;
 }
@@ -658,9 +1162,15 @@ static int socket_stop (struct modem *m)
 {
 	struct device_struct *dev = m->dev_data;
 	DBG("socket_stop...\n");
+	reactor_del(dev->fd);
 	close(dev->fd);
 	dev->fd = -1;
-	wait(NULL); // for exec'ed child
+	shm_release(dev);
+	if (dev->pid > 0) { // for exec'ed child of this modem only
+		waitpid(dev->pid, NULL, 0);
+		dev->pid = 0;
+	}
+	dev->agent_retry = 0; /* listen again right away */
 	return 0;
 }
 
@@ -709,18 +1219,44 @@ struct modem_driver socket_modem_driver = {
         .ioctl = socket_ioctl,
 };
 
-static int mdm_device_read(struct device_struct *dev, char *buf, int size)
+static int shm_device_read(struct device_struct *dev, char *buf, int size)
 {
-	int ret = read(dev->fd, buf, size*2);
-	if (ret > 0) ret /= 2;
+	uint64_t val;
+	int ret = modem_shm_ring_read(&dev->shm->rx, (int16_t *)buf, size);
+	if (ret > 0)
+		return ret;
+	/* ring drained: reset doorbell, then recheck for a racing producer */
+	if (read(dev->event_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+		return -1;
+	ret = modem_shm_ring_read(&dev->shm->rx, (int16_t *)buf, size);
+	if (ret > 0)
+		return ret;
+	errno = EAGAIN;
+	return -1;
+}
+
+static int shm_device_write(struct device_struct *dev, const char *buf, int size)
+{
+	int ret = modem_shm_ring_write(&dev->shm->tx, (const int16_t *)buf, size);
+	if (ret == 0 && size > 0) {
+		errno = EAGAIN;
+		return -1;
+	}
 	return ret;
 }
 
+static int mdm_device_read(struct device_struct *dev, char *buf, int size)
+{
+	if (dev->shm)
+		return shm_device_read(dev, buf, size);
+	return sock_read(dev, buf, size);
+}
+
 static int mdm_device_write(struct device_struct *dev, const char *buf, int size)
 {
-	int ret = write(dev->fd, buf, size*2);
-	if (ret > 0) ret /= 2;
-	return ret;
+	if (dev->shm)
+		return shm_device_write(dev, buf, size);
+	return sock_write(dev, buf, size);
 }
 #if 0
 static int mdm_device_setup(struct device_struct *dev, const char *dev_name)
@@ -758,6 +1294,16 @@ static int mdm_device_release(struct device_struct *dev)
 static int socket_device_setup(struct device_struct *dev, const char *dev_name)
 {
 	memset(dev,0,sizeof(*dev));
+	dev->fd = -1;
+	dev->shm_fd = -1;
+	dev->event_fd = -1;
+	dev->agent_fd = -1;
+	if (modem_g711) {
+		dev->up = modem_resample_create(MODEM_G711_RATE, MODEM_RATE);
+		dev->down = modem_resample_create(MODEM_RATE, MODEM_G711_RATE);
+		if (!dev->up || !dev->down)
+			return -1;
+	}
 	return 0;
 }
 
@@ -767,16 +1313,18 @@ static int socket_device_setup(struct device_struct *dev, const char *dev_name)
  *
  */
 
-static char link_name[PATH_MAX];
-
 int create_pty(struct modem *m)
 {
+	struct device_struct *dev = m->dev_data;
+	char *link_name = dev->link_name;
 	struct termios termios;
 	const char *pty_name;
 	int pty, ret;
 
-	if(m->pty)
+	if(m->pty) {
+		reactor_del(m->pty);
 		close(m->pty);
+	}
 
         pty  = getpt();
         if (pty < 0 || grantpt(pty) < 0 || unlockpt(pty) < 0) {
@@ -794,6 +1342,8 @@ int create_pty(struct modem *m)
 		cfsetispeed(&termios, B115200);
 		cfsetospeed(&termios, B115200);
 	}
+	/* report slave termios changes through packet mode */
+	termios.c_lflag |= EXTPROC;
 
         ret = tcsetattr(pty, TCSANOW, &termios);
         if (ret) {
@@ -802,6 +1352,15 @@ int create_pty(struct modem *m)
         }
 
 	fcntl(pty,F_SETFL,O_NONBLOCK);
+	fcntl(pty,F_SETFD,FD_CLOEXEC);
+	ret = 1;
+	if (ioctl(pty, TIOCPKT, &ret) < 0) {
+		ERR("ioctl TIOCPKT: %s\n",strerror(errno));
+		return -1;
+	}
+	dev->pty_ready = 0;
+	if (reactor_add(pty, EPOLLIN|EPOLLET, &dev->pty_src) < 0)
+		return -1;
 
 	pty_name = ptsname(pty);
 
@@ -868,235 +1427,439 @@ void mark_termination(int signum)
 }
 
 
-static int modem_run(struct modem *m, struct device_struct *dev)
+/* termios changes arrive as TIOCPKT_IOCTL, which needs EXTPROC */
+static void pty_check_termios(struct modem *m)
 {
-	struct timeval tmo;
-	fd_set rset,eset;
 	struct termios termios;
-	unsigned pty_closed = 0, close_count = 0;
-	int max_fd;
+	tcgetattr(m->pty,&termios);
+	RSTATS_SYSCALL();
+	if(!(termios.c_lflag&EXTPROC)) {
+		termios.c_lflag |= EXTPROC;
+		tcsetattr(m->pty,TCSANOW,&termios);
+		RSTATS_SYSCALL();
+	}
+	if(memcmp(&termios,&m->termios,sizeof(termios))) {
+		DBG("termios changed.\n");
+		modem_update_termios(m,&termios);
+	}
+}
+
+static int modem_run_pty(struct device_struct *dev)
+{
+	struct modem *m = dev->modem;
 	int ret, count;
-	void *in;
 
-	while(keep_running) {
+	while(dev->pty_ready) {
+		/* read data */
+		count = m->xmit.size - m->xmit.count;
+		if(count == 0) /* resumed after modem_process() */
+			return 0;
+		if(count > sizeof(inbuf) - 1)
+			count = sizeof(inbuf) - 1;
+		/* packet mode: one status byte precedes the data */
+		count = read(m->pty,inbuf,count + 1);
+		RSTATS_SYSCALL();
+		if(count < 0) {
+			if(errno == EAGAIN) {
+				dev->pty_ready = 0;
+				return 0;
+			}
+			if(errno == EIO) { /* closed */
+				dev->pty_ready = 0;
+				if(!dev->pty_closed) {
+					DBG("%s: pty closed.\n", dev->name);
+					if(m->termios.c_cflag&HUPCL) {
+						modem_hangup(m);
+						/* re-create PTM - simulate hangup */
+						ret = create_pty(m);
+						if (ret < 0) {
+							ERR("cannot re-create PTY.\n");
+							return -1;
+						}
+					}
+					else
+						dev->pty_closed = 1;
+				}
+				return 0;
+			}
+			ERR("pty read: %s\n",strerror(errno));
+			return -1;
+		}
+		else if (count == 0) {
+			DBG("pty read = 0\n");
+			dev->pty_ready = 0;
+			return 0;
+		}
+		if(inbuf[0] != TIOCPKT_DATA) {
+			if(inbuf[0] & TIOCPKT_IOCTL)
+				pty_check_termios(m);
+			continue;
+		}
+		dev->pty_closed = 0;
+		count = modem_write(m,inbuf + 1,count - 1);
+		if(count < 0) {
+			ERR("modem_write failed.\n");
+			return -1;
+		}
+	}
+	return 0;
+}
 
-		if(m->event)
-			modem_event(m);
+static void modem_run_lost(struct device_struct *dev)
+{
+	struct modem *m = dev->modem;
+	// hack to force hangup
+	modem_hangup(m); // sets sample_timer_func to run_modem_stop()
+	if(m->sample_timer_func)
+		m->sample_timer_func(m);
+	m->sample_timer = 0;
+	m->sample_timer_func = NULL;
+}
 
-#ifdef MODEM_CONFIG_RING_DETECTOR
-		if(ring_detector && !m->started)
-			modem_ring_detector_start(m);
-#endif
+/* control socket of shared memory transport: only EOF is expected */
+static int modem_run_ctl(struct device_struct *dev)
+{
+	int ret;
+	while(dev->fd >= 0) {
+		ret = read(dev->fd, inbuf, sizeof(inbuf));
+		RSTATS_SYSCALL();
+		if(ret > 0)
+			continue;
+		if(ret < 0 && errno == EAGAIN)
+			break;
+		if(ret < 0 && errno != ECONNRESET)
+			ERR("ctl read: %s\n",strerror(errno));
+		DBG("%s: lost connection to child socket process\n",
+		    dev->name);
+		modem_run_lost(dev);
+		break;
+	}
+	return 0;
+}
 
-                tmo.tv_sec = 1;
-                tmo.tv_usec= 0;
-                FD_ZERO(&rset);
-		FD_ZERO(&eset);
-		if(m->started)
-			FD_SET(dev->fd,&rset);
-
-		FD_SET(dev->fd,&eset);
-		max_fd = dev->fd;
-		
-		if(pty_closed && close_count > 0) {
-			if(!m->started ||
-				++close_count > CLOSE_COUNT_MAX )
-				close_count = 0;
+/* a write error ends this modem's call, not the others' */
+static void dev_write_lost(struct device_struct *dev)
+{
+	if(errno == EPIPE || errno == ECONNRESET) {
+		DBG("%s: lost connection to child socket process\n",
+		    dev->name);
+	} else {
+		ERR("dev write: %s\n",strerror(errno));
+	}
+	dev->dev_ready = 0;
+	modem_run_lost(dev);
+}
+
+static int modem_run_dev(struct device_struct *dev)
+{
+	struct modem *m = dev->modem;
+	unsigned long long t;
+	int count;
+	void *in;
+
+	while(dev->dev_ready && dev->fd >= 0) {
+		count = device_read(dev,inbuf,sizeof(inbuf)/2);
+		RSTATS_SYSCALL();
+		if(count < 0 && errno == EAGAIN) {
+			dev->dev_ready = 0;
+			break;
+		}
+		if(count <= 0) {
+			if (count == 0 || errno == ECONNRESET) {
+				DBG("%s: lost connection to child socket process\n",
+				    dev->name);
+			} else {
+				ERR("dev read: %s\n",strerror(errno));
+			}
+			dev->dev_ready = 0;
+			modem_run_lost(dev);
+			break;
 		}
-		else if(m->xmit.size - m->xmit.count > 0) {
-			FD_SET(m->pty,&rset);
-			if(m->pty > max_fd) max_fd = m->pty;
+		if(!(dev_events()&EPOLLET))
+			dev->dev_ready = 0;
+		in = inbuf;
+		if(m->update_delay < 0) {
+			if ( -m->update_delay >= count) {
+				DBG("change delay -%d...\n", count);
+				dev->delay -= count;
+				m->update_delay += count;
+				continue;
+			}
+			DBG("change delay %d...\n", m->update_delay);
+			in -= m->update_delay;
+			count += m->update_delay;
+			dev->delay += m->update_delay;
+			m->update_delay = 0;
 		}
 
-                ret = select(max_fd + 1,&rset,NULL,&eset,&tmo);
+		t = monotonic_ns();
+		modem_process(m,inbuf,outbuf,count);
+		m->stats.process_ns += monotonic_ns() - t;
+		if (dev->fd == -1) {
+			DBG("%s: closed connection to child socket process\n",
+			    dev->name);
+			break;
+		}
+		count = device_write(dev,outbuf,count);
+		RSTATS_SYSCALL();
+		if(count < 0) {
+			if(errno == EAGAIN) {
+				DBG("%s: dev write would block, frame dropped\n",
+				    dev->name);
+			}
+			else {
+				dev_write_lost(dev);
+				break;
+			}
+		}
+		else if (count == 0) {
+			DBG("dev write = 0\n");
+		}
 
-                if (ret < 0) {
-			if (errno == EINTR)
-				continue;
-                        ERR("select: %s\n",strerror(errno));
-                        return ret;
-                }
+		/* a short write is part of the delay, the rest stays pending */
+		if(m->update_delay > 0) {
+			DBG("change delay +%d...\n", m->update_delay);
+			memset(outbuf, 0, m->update_delay*2);
+			count = device_write(dev,outbuf,m->update_delay);
+			RSTATS_SYSCALL();
+			if(count < 0 && errno != EAGAIN) {
+				dev_write_lost(dev);
+				break;
+			}
+			if(count > 0) {
+				dev->delay += count;
+				m->update_delay -= count;
+			}
+		}
 
-		if ( ret == 0 )
-			continue;
+		/* modem_process() made room in xmit queue */
+		if(dev->pty_ready && modem_run_pty(dev) < 0)
+			return -1;
+	}
+	return 0;
+}
 
-		if(FD_ISSET(dev->fd, &eset)) {
-			unsigned stat;
-			DBG("dev exception...\n");
+static int modem_run_exception(struct device_struct *dev)
+{
+	struct modem *m = dev->modem;
+	unsigned stat;
+	int ret;
+	DBG("dev exception...\n");
 #ifdef SUPPORT_ALSA
-			if(use_alsa) {
-				DBG("dev exception...\n");
-				continue;
-			}
+	if(use_alsa)
+		return 0;
 #endif
-			ret = ioctl(dev->fd,100000+MDMCTL_GETSTAT,&stat);
-			if(ret < 0) {
-				ERR("dev ioctl: %s\n",strerror(errno));
-				return -1;
-			}
-			if(stat&MDMSTAT_ERROR) modem_error(m);
-			if(stat&MDMSTAT_RING)  modem_ring(m);
-			continue;
+	ret = ioctl(dev->fd,100000+MDMCTL_GETSTAT,&stat);
+	RSTATS_SYSCALL();
+	if(ret < 0) {
+		ERR("dev ioctl: %s\n",strerror(errno));
+		return -1;
+	}
+	if(stat&MDMSTAT_ERROR) modem_error(m);
+	if(stat&MDMSTAT_RING)  modem_ring(m);
+	return 0;
+}
+
+
+static int modem_run(struct device_struct *devs)
+{
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	struct io_source timer_src = { NULL, IO_SOURCE_TIMER };
+	struct device_struct *dev;
+	struct io_source *src;
+	struct modem *m;
+	int i, n;
+
+	if (reactor_add(modem_timer_fd(), EPOLLIN, &timer_src) < 0)
+		return -1;
+	stats_last = monotonic_ns();
+
+	while(keep_running) {
+
+		for( dev = devs ; dev->modem ; dev++ ) {
+			m = dev->modem;
+			if(m->event)
+				modem_event(m);
+			/* a running modem flushes in modem_process() */
+			if(m->recv.count && !m->started)
+				modem_flush_chars(m);
+#ifdef MODEM_CONFIG_RING_DETECTOR
+			if(ring_detector && !m->started)
+				modem_ring_detector_start(m);
+#endif
+			if(modem_agent && dev->agent_fd < 0 && dev->fd < 0 &&
+			   !m->started && monotonic_ns() >= dev->agent_retry)
+				agent_listen(dev);
 		}
-		if(FD_ISSET(dev->fd, &rset)) {
-			count = device_read(dev,inbuf,sizeof(inbuf)/2);
-			if(count <= 0) {
-				if (errno == ECONNRESET) {
-					DBG("lost connection to child socket process\n");
-				} else {
-					ERR("dev read: %s\n",strerror(errno));
-				}
-				// hack to force hangup
-				modem_hangup(m); // sets sample_timer_func to run_modem_stop()
-				m->sample_timer_func(m);
-				m->sample_timer = 0;
-				m->sample_timer_func = NULL;
+
+		n = epoll_wait(reactor_fd, events, REACTOR_MAX_EVENTS, 1000);
+		RSTATS_SYSCALL();
+		rstats.loops++;
+
+		if (n < 0) {
+			if (errno == EINTR)
 				continue;
-			}
-			in = inbuf;
-			if(m->update_delay < 0) {
-				if ( -m->update_delay >= count) {
-					DBG("change delay -%d...\n", count);
-					dev->delay -= count;
-					m->update_delay += count;
-					continue;
-				}
-				DBG("change delay %d...\n", m->update_delay);
-				in -= m->update_delay;
-				count += m->update_delay;
-				dev->delay += m->update_delay;
-				m->update_delay = 0;
-			}
+			ERR("epoll_wait: %s\n",strerror(errno));
+			return n;
+		}
 
-			modem_process(m,inbuf,outbuf,count);
-			if (dev->fd == -1) {
-				DBG("closed connection to child socket process\n");
+		for( i = 0 ; i < n ; i++ ) {
+			src = events[i].data.ptr;
+			dev = src->dev;
+			if(src->type == IO_SOURCE_TIMER) {
+				modem_timer_run();
+				RSTATS_SYSCALL();
 				continue;
 			}
-			count = device_write(dev,outbuf,count);
-			if(count < 0) {
-				ERR("dev write: %s\n",strerror(errno));
-				return -1;
-			}
-			else if (count == 0) {
-				DBG("dev write = 0\n");
+			if(src->type == IO_SOURCE_PTY) {
+				dev->pty_ready = 1;
+				continue;
 			}
-
-			if(m->update_delay > 0) {
-				DBG("change delay +%d...\n", m->update_delay);
-				memset(outbuf, 0, m->update_delay*2);
-				count = device_write(dev,outbuf,m->update_delay);
-				if(count < 0) {
-					ERR("dev write: %s\n",strerror(errno));
-					return -1;
-				}
-				if(count != m->update_delay) {
-					ERR("cannot update delay: %d instead of %d.\n",
-					    count, m->update_delay);
+			if(src->type == IO_SOURCE_CTL ||
+			   src->type == IO_SOURCE_AGENT)
+				continue;
+			if(dev->fd < 0)
+				continue;
+			if(events[i].events & EPOLLPRI) {
+				if(modem_run_exception(dev) < 0)
 					return -1;
-				}
-				dev->delay += m->update_delay;
-				m->update_delay = 0;
+				continue;
 			}
+			dev->dev_ready = 1;
 		}
-		if(FD_ISSET(m->pty,&rset)) {
-			/* check termios */
-			tcgetattr(m->pty,&termios);
-			if(memcmp(&termios,&m->termios,sizeof(termios))) {
-				DBG("termios changed.\n");
-				modem_update_termios(m,&termios);
-			}
-			/* read data */
-			count = m->xmit.size - m->xmit.count;
-			if(count == 0)
-				continue;
-			if(count > sizeof(inbuf))
-				count = sizeof(inbuf);
-			count = read(m->pty,inbuf,count);
-			if(count < 0) {
-				if(errno == EAGAIN) {
-					DBG("pty read, errno = EAGAIN\n");
-					continue;
-				}
-				if(errno == EIO) { /* closed */
-					if(!pty_closed) {
-						DBG("pty closed.\n");
-						if(termios.c_cflag&HUPCL) {
-							modem_hangup(m);
-							/* re-create PTM - simulate hangup */
-							ret = create_pty(m);
-							if (ret < 0) {
-								ERR("cannot re-create PTY.\n");
-								return -1;
-							}
-						}
-						else
-							pty_closed = 1;
-					}
-					// DBG("pty read, errno = EIO\n");
-					close_count = 1;
-					continue;
-				}
-				else
-					ERR("pty read: %s\n",strerror(errno));
+
+		for( i = 0 ; i < n ; i++ ) {
+			src = events[i].data.ptr;
+			dev = src->dev;
+			if(src->type == IO_SOURCE_DEV && modem_run_dev(dev) < 0)
 				return -1;
-			}
-			else if (count == 0) {
-				DBG("pty read = 0\n");
-			}
-			pty_closed = 0;
-			count = modem_write(m,inbuf,count);
-			if(count < 0) {
-				ERR("modem_write failed.\n");
+			if(src->type == IO_SOURCE_PTY && modem_run_pty(dev) < 0)
+				return -1;
+			if(src->type == IO_SOURCE_CTL && modem_run_ctl(dev) < 0)
+				return -1;
+			if(src->type == IO_SOURCE_AGENT && modem_run_agent(dev) < 0)
 				return -1;
-			}
 		}
+
+		if(rstats.loops - rstats.last_loops >= REACTOR_STATS_PERIOD)
+			reactor_print_stats("stats");
+		if(modem_stats_file)
+			stats_check(devs);
 	}
 
+	reactor_print_stats("exit");
 	return 0;
 }
 
 
-int modem_main(const char *dev_name)
+static int modem_instance_init(struct device_struct *dev, const char *dev_name, int num)
 {
-	char path_name[PATH_MAX];
-	struct device_struct device;
+	const char *base = basename(dev_name);
 	struct modem *m;
-	int pty;
-	int ret = 0;
-	struct passwd *pwd;
-
-	modem_debug_init(basename(dev_name));
+	int len, ret;
 
-	ret = device_setup(&device, dev_name);
+	ret = device_setup(dev, dev_name);
 	if (ret) {
 		ERR("cannot setup device `%s'\n", dev_name);
-		exit(-1);
+		return -1;
 	}
+	dev->dev_src.dev = dev;
+	dev->dev_src.type = IO_SOURCE_DEV;
+	dev->pty_src.dev = dev;
+	dev->pty_src.type = IO_SOURCE_PTY;
+	dev->ctl_src.dev = dev;
+	dev->ctl_src.type = IO_SOURCE_CTL;
+	dev->agent_src.dev = dev;
+	dev->agent_src.type = IO_SOURCE_AGENT;
+	if (dev->fd >= 0 &&
+	    reactor_add(dev->fd, dev_events(), &dev->dev_src) < 0)
+		return -1;
 
-	dp_dummy_init();
-	dp_sinus_init();
-	prop_dp_init();
-	modem_timer_init();
+	/* modem pool: slamr0 -> slamr0, slamr1, ... */
+	dev->num = num;
+	if (modem_count > 1) {
+		len = strlen(base);
+		while (len > 0 && isdigit(base[len-1]))
+			len--;
+		snprintf(dev->name, sizeof(dev->name), "%.*s%d", len, base, num);
+	}
+	else
+		snprintf(dev->name, sizeof(dev->name), "%s", base);
 
-	sprintf(link_name,"/dev/ttySL%d", device.num);
+	sprintf(dev->link_name,"/dev/ttySL%d", dev->num);
 
-	m = modem_create(modem_driver,basename(dev_name));
-	m->name = basename(dev_name);
-	m->dev_data = &device;
+	m = modem_create(modem_driver,dev->name);
+	if (!m) {
+		ERR("cannot create modem `%s'\n", dev->name);
+		return -1;
+	}
+	m->name = dev->name;
+	m->dev_data = dev;
 	m->dev_name = dev_name;
-	
+	dev->modem = m;
+
 	ret = create_pty(m);
 	if(ret < 0) {
 		ERR("cannot create PTY.\n");
-		exit(-1);
+		return -1;
 	}
 
 	INFO("modem `%s' created. TTY is `%s'\n",
 	     m->name, m->pty_name);
 
-	sprintf(path_name,"/var/lib/slmodem/data.%s",basename(dev_name));
-	datafile_load_info(path_name,&m->dsp_info);
+	sprintf(dev->data_name,"/var/lib/slmodem/data.%s",dev->name);
+	datafile_load_info(dev->data_name,&m->dsp_info);
+	return 0;
+}
+
+static int modem_instance_release(struct device_struct *dev)
+{
+	struct modem *m = dev->modem;
+	int pty;
+
+	datafile_save_info(dev->data_name,&m->dsp_info);
+
+	pty = m->pty;
+	modem_delete(m);
+	dev->modem = NULL;
+	return pty;
+}
+
+
+int modem_main(const char *dev_name)
+{
+	struct device_struct *devs, *dev;
+	int i;
+	int ret = 0;
+	struct passwd *pwd;
+
+	modem_debug_init(basename(dev_name));
+	if (modem_stats_file)
+		modem_debug_put_start();
+
+	/* zero terminated: devs[modem_count].modem == NULL */
+	devs = calloc(modem_count + 1, sizeof(*devs));
+	if (!devs) {
+		ERR("cannot allocate %u modems\n", modem_count);
+		exit(-1);
+	}
+
+	if (reactor_init() < 0)
+		exit(-1);
+
+	dp_dummy_init();
+	dp_sinus_init();
+	prop_dp_init();
+	if (modem_timer_init() < 0) {
+		ERR("cannot create timer: %s\n",strerror(errno));
+		exit(-1);
+	}
+
+	for (i = 0 ; i < modem_count ; i++) {
+		ret = modem_instance_init(&devs[i], dev_name, i);
+		if (ret < 0)
+			exit(-1);
+	}
 
 	if (need_realtime) {
 		struct sched_param prm;
@@ -1112,6 +1875,8 @@ int modem_main(const char *dev_name)
 
 	signal(SIGINT, mark_termination);
 	signal(SIGTERM, mark_termination);
+	/* a peer closing its audio socket shows up as EPIPE */
+	signal(SIGPIPE, SIG_IGN);
 
 #ifdef SLMODEMD_USER
 	if (need_realtime) {
@@ -1153,28 +1918,32 @@ int modem_main(const char *dev_name)
 	    (long)pwd->pw_gid,(long)pwd->pw_uid);
 #endif
 
-	INFO("Use `%s' as modem device, Ctrl+C for termination.\n",
-	     *link_name ? link_name : m->pty_name);
+	for (dev = devs ; dev->modem ; dev++)
+		INFO("Use `%s' as modem device%s\n",
+		     *dev->link_name ? dev->link_name : dev->modem->pty_name,
+		     dev[1].modem ? "," : ", Ctrl+C for termination.");
 
 	/* main loop here */
-	ret = modem_run(m,&device);
+	ret = modem_run(devs);
 
-	datafile_save_info(path_name,&m->dsp_info);
-
-	pty = m->pty;
-	modem_delete(m);
+	for (i = 0 ; i < modem_count ; i++)
+		devs[i].pty = modem_instance_release(&devs[i]);
 
 	usleep(100000);
-	close(pty);
-	if(*link_name)
-		unlink(link_name);
-	
+	for (i = 0 ; i < modem_count ; i++) {
+		close(devs[i].pty);
+		if(*devs[i].link_name)
+			unlink(devs[i].link_name);
+		device_release(&devs[i]);
+	}
+	free(devs);
+	close(reactor_fd);
+	modem_timer_exit();
+
 	dp_dummy_exit();
 	dp_sinus_exit();
 	prop_dp_exit();
 
-	device_release(&device);
-
 	modem_debug_exit();
 
 	exit(ret);
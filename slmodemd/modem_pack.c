@@ -43,6 +43,7 @@
 
 #include <modem.h>
 #include <modem_debug.h>
+#include <modem_crc.h>
 
 #define PACK_DBG(fmt,arg...) dprintf("%s: " fmt , m->name , ##arg)
 #define PACK_ERR(fmt,arg...) eprintf("%s: " fmt , m->name , ##arg)
@@ -81,10 +82,13 @@ static const u8 _ordered[] = {
 #define CHAR_DATA(p,ch) (((ch)<<1)|0x1)
 #endif
 
+#define ASYNC_CHUNK 64
+
 int modem_async_get_bits(struct modem *m, int nbits, u8 *bit_buf, int bit_cnt)
 {
 	struct bits_state *s = &m->pack;
-	int ret = 0;
+	u8 chars[ASYNC_CHUNK];
+	int ret = 0, i, n;
 	u8 ch;
 	do {
 		/* fill bits */
@@ -94,15 +98,28 @@ int modem_async_get_bits(struct modem *m, int nbits, u8 *bit_buf, int bit_cnt)
 			ret ++;
 			bit_cnt--;
 		}
-		if (bit_cnt <= 0)
+		if (bit_cnt <= 0 || !m->get_chars)
 			break;
-		/* get char */
-		if (!m->get_chars || m->get_chars(m, (char*)&ch, 1) != 1)
+		/* get exactly as many chars as the symbols left need */
+		n = (bit_cnt*nbits - s->bit + CHAR_SIZE(m) - 1)/CHAR_SIZE(m);
+		if (n > ASYNC_CHUNK)
+			n = ASYNC_CHUNK;
+		n = m->get_chars(m, (char*)chars, n);
+		if (n <= 0)
 			break;
-		REVERSE_BITS(ch);
-		s->data <<= CHAR_SIZE(m);
-		s->data |=  CHAR_DATA(m,ch);
-		s->bit  +=  CHAR_SIZE(m);
+		for (i = 0 ; i < n ; i++) {
+			ch = chars[i];
+			REVERSE_BITS(ch);
+			s->data <<= CHAR_SIZE(m);
+			s->data |=  CHAR_DATA(m,ch);
+			s->bit  +=  CHAR_SIZE(m);
+			while ( bit_cnt > 0 && s->bit >= nbits) {
+				*bit_buf++ = (s->data>>(s->bit-nbits));
+				s->bit -= nbits;
+				ret ++;
+				bit_cnt--;
+			}
+		}
 	} while (1);
 	if (s->bit && bit_cnt > 0) {
 		/* left data + stops */
@@ -129,7 +146,8 @@ int modem_async_get_bits(struct modem *m, int nbits, u8 *bit_buf, int bit_cnt)
 int modem_async_put_bits(struct modem *m, int nbits, u8 *bit_buf, int bit_cnt)
 {
 	struct bits_state *s = &m->unpack;
-	int ret = 0;
+	u8 chars[ASYNC_CHUNK];
+	int ret = 0, n = 0;
 	u8 ch;
 	while(bit_cnt > 0) {
 		s->data<<= nbits;
@@ -144,10 +162,17 @@ int modem_async_put_bits(struct modem *m, int nbits, u8 *bit_buf, int bit_cnt)
 				(s->bit-(CHAR_SIZE(m)-STOP_BITS(m))); 
 			s->bit-= CHAR_SIZE(m);
 			REVERSE_BITS(ch);
-			if (m->put_chars)
-				m->put_chars(m,(const char*)&ch,1);
+			chars[n++] = ch;
+			if (n == ASYNC_CHUNK) {
+				if (m->put_chars)
+					m->put_chars(m,(const char*)chars,n);
+				n = 0;
+			}
 		}
 	}
+	/* no flow control without EC: what does not fit is lost */
+	if (n && m->put_chars)
+		m->put_chars(m,(const char*)chars,n);
 	return ret;
 }
 
@@ -342,83 +367,136 @@ void modem_detector_start(struct modem *m) {
  */
 
 
-/* static data */
-
-/* fcs16 table */
-static const
-u16 fcs16_tab[256] = {
-	0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
-	0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
-	0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
-	0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
-	0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
-	0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
-	0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
-	0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
-	0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
-	0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
-	0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
-	0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
-	0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
-	0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
-	0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
-	0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
-	0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
-	0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
-	0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
-	0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
-	0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
-	0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
-	0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
-	0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
-	0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
-	0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
-	0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
-	0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
-	0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
-	0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
-	0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
-	0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
-};
-
-#define fcstab	fcs16_tab
-#define INIT_FCS16    0xffff  /* Initial FCS16 value */
-#define GOOD_FCS16    0xf0b8  /* Good final FCS16 value */
-
-#define GET_FCS(fcs,c)	(((fcs) >> 8) ^ fcstab[((fcs) ^ (c)) & 0xff])
-#define INIT_FCS    INIT_FCS16  /* Initial FCS value */
-#define GOOD_FCS    GOOD_FCS16  /* Good final FCS value */
+/*
+ *  Bits go through lookup tables a byte at a time.
+ *
+ *  tx: (ones run, data byte) -> stuffed bits (at most 10), their count
+ *  and the new ones run.
+ *
+ *  rx: destuffing is a state machine over the raw bits, rx_bit_step()
+ *  below is its definition.  The state is the current ones run and
+ *  whether that run follows a data zero: only a zero not removed as
+ *  stuffing may start a flag.  Its data bits (the zero and five ones)
+ *  are passed on before the flag is known and taken back when it
+ *  completes.  The table gives (state, raw byte) -> data bits, their
+ *  count and the new state.  Bytes where a flag or an abort shows up
+ *  go bit by bit, as well as those which may overflow the frame.
+ *  While hunting for a flag (rx_error) the last raw bits are kept in
+ *  rx_hunt, behind a leading 1.
+ *
+ *  FCS (CRC-16, or CRC-32 when fcs32 is set) is done over whole frames
+ *  by modem_crc.c.
+ *
+ */
+
+#define RX_Z        0x8   /* ones run follows a data zero */
 
+enum RX_ACTION { RX_DATA, RX_DROP, RX_FLAG, RX_ABORT, RX_ABORT1 };
 
-/* hdlc bit generators */
+#define TX_ENTRY(bits,n,ones)  ((bits)|(n)<<16|(ones)<<24)
+#define TX_BITS(e)   ((e)&0xffff)
+#define TX_NBITS(e)  (((e)>>16)&0xff)
+#define TX_ONES(e)   ((e)>>24)
 
-#define	HDLC_PUT_BYTE  { \
-	for( i = 0 ; i < 8 ; i++ ) { \
-		s->data<<=1; \
-		s->bit++; \
-		if(in&0x1) { \
-			h->tx_ones++; \
-		        s->data |= 0x1; \
-		        if (h->tx_ones==5) { \
-			        s->data<<=1; \
-			        s->bit++; \
-			        h->tx_ones = 0; \
-		        } \
-                } \
-		else { \
-			h->tx_ones = 0; \
-                } \
-		in>>=1; \
-	} }
+#define RX_ENTRY(bits,n,state) ((bits)|(n)<<8|(state)<<12)
+#define RX_SLOW      (1<<16)
+#define RX_BITS(e)   ((e)&0xff)
+#define RX_NBITS(e)  (((e)>>8)&0xf)
+#define RX_STATE(e)  (((e)>>12)&0xf)
 
+static u32 hdlc_tx_tab[5][256];
+static u32 hdlc_rx_tab[16][256];
+
+static enum RX_ACTION rx_bit_step(int *state, int bit)
+{
+	int ones = *state&0x7;
+	if (!bit) {
+		if (ones == 5) {          /* stuffed zero */
+			*state = 0;
+			return RX_DROP;
+		}
+		*state = RX_Z;
+		return ones == 6 ? RX_FLAG : RX_DATA;
+	}
+	if (ones < 5) {
+		(*state)++;
+		return RX_DATA;
+	}
+	if (ones == 5 && (*state&RX_Z)) { /* sixth one: flag or abort */
+		(*state)++;
+		return RX_DROP;
+	}
+	/* abort: six ones not after a data zero, or seven ones */
+	*state = 0;
+	return ones == 5 ? RX_ABORT : RX_ABORT1;
+}
+
+static void hdlc_init_tables(void)
+{
+	static int done;
+	int ones, byte, i, n, state, bits;
+	if (done)
+		return;
+	modem_crc_init();
+	for (ones = 0 ; ones < 5 ; ones++) {
+		for (byte = 0 ; byte < 256 ; byte++) {
+			int o = ones;
+			bits = n = 0;
+			for (i = 0 ; i < 8 ; i++) {
+				bits = bits<<1|((byte>>i)&1);
+				n++;
+				if (!((byte>>i)&1))
+					o = 0;
+				else if (++o == 5) {
+					bits <<= 1;
+					n++;
+					o = 0;
+				}
+			}
+			hdlc_tx_tab[ones][byte] = TX_ENTRY(bits,n,o);
+		}
+	}
+	for (state = 0 ; state < 16 ; state++) {
+		for (byte = 0 ; byte < 256 ; byte++) {
+			int st = state, b;
+			u32 e = 0;
+			bits = n = 0;
+			if ((state&0x7) > 6 || state == 6) {
+				hdlc_rx_tab[state][byte] = RX_SLOW;
+				continue;
+			}
+			for (i = 7 ; i >= 0 ; i--) {
+				b = (byte>>i)&1;
+				switch (rx_bit_step(&st,b)) {
+				case RX_DATA:
+					bits |= b<<n;
+					n++;
+					break;
+				case RX_DROP:
+					break;
+				default:
+					e = RX_SLOW;
+					break;
+				}
+			}
+			hdlc_rx_tab[state][byte] = e ? e : RX_ENTRY(bits,n,st);
+		}
+	}
+	done = 1;
+}
+
+
+/* hdlc bit generators */
 
 int modem_hdlc_get_bits(struct modem *m, int nbits,
 			u8 *bit_buf, int bit_cnt)
 {
 	struct hdlc_state *h = &m->packer.hdlc;
 	register struct bits_state *s = &m->pack;
-	register int i, ret = 0;
+	register int ret = 0;
 	register u8 in, mask = ((1<<nbits) - 1);
+	frame_t *f;
+	u32 e;
 
 	do {
 		/* fill bits */
@@ -430,45 +508,144 @@ int modem_hdlc_get_bits(struct modem *m, int nbits,
 		}
 		if (bit_cnt <= 0)
 			break;
-		if (!h->tx_frame) {
+		f = h->tx_frame;
+		if (!f) {
 			s->data <<= 8;
 			s->data |= HDLC_FLAG;
 			s->bit  += 8;
 			if (h->get_tx_frame &&
-			    (h->tx_frame = h->get_tx_frame(h->framer))) {
-				h->tx_frame->fcs = INIT_FCS;
-				h->tx_frame->count = 0;
+			    (f = h->tx_frame = h->get_tx_frame(h->framer))) {
+				f->count = 0;
+				if (h->fcs32) {
+					f->fcs = ~modem_crc32(INIT_FCS32,f->buf,f->size);
+					h->tx_fcs = 4;
+				}
+				else {
+					f->fcs = modem_crc16(INIT_FCS16,f->buf,f->size)^0xffff;
+					h->tx_fcs = 2;
+				}
 			}
+			continue;
+		}
+		if (f->count < f->size)
+			in = f->buf[f->count++];
+		else {  /* fcs, low byte first */
+			in = f->fcs&0xff;
+			f->fcs >>= 8;
+			h->tx_fcs--;
 		}
-		else if(h->tx_frame->count == h->tx_frame->size) {
+		e = hdlc_tx_tab[h->tx_ones][in];
+		s->data <<= TX_NBITS(e);
+		s->data |=  TX_BITS(e);
+		s->bit  +=  TX_NBITS(e);
+		h->tx_ones = TX_ONES(e);
+		if (f->count == f->size && !h->tx_fcs) {
 			/* end frame */
-			/* put fcs */
-			h->tx_frame->fcs ^= 0xffff;
-			in = h->tx_frame->fcs&0xff;
-			HDLC_PUT_BYTE;
-			in = (h->tx_frame->fcs>>8)&0xff;
-			HDLC_PUT_BYTE;
 			h->tx_ones = 0;
 			/* frame complete callback */
-			if (h->tx_complete) 
-				h->tx_complete(h->framer, h->tx_frame);
+			if (h->tx_complete)
+				h->tx_complete(h->framer, f);
 			/* reset tx frame */
 			h->tx_frame = NULL;
 			/* put flags will done automatically */
 		}
-		else {
-			in = h->tx_frame->buf[h->tx_frame->count];
-			h->tx_frame->count++;
-			/* fixme: in order to speed up
-			   fcs calc: copy it to local var */
-			h->tx_frame->fcs = GET_FCS(h->tx_frame->fcs,in);
-			HDLC_PUT_BYTE;
-		}
 	} while (1);
 	return ret;
 }
 
 
+static void hdlc_rx_error(struct hdlc_state *h, unsigned hunt)
+{
+	h->rx_error++;
+	h->rx_hunt = hunt;
+	h->rx_frame->count = 0;
+	h->rx_bits  = 0;
+	h->rx_nbits = 0;
+}
+
+static void hdlc_rx_flag(struct modem *m, struct hdlc_state *h)
+{
+	frame_t *f = h->rx_frame;
+	int fcs_len = h->fcs32 ? 4 : 2;
+	/* data bits before the flag zero */
+	int n = f->count*8 + h->rx_nbits - 6;
+
+	if (h->rx_error || n < 8) {
+		//HDLC_DBG("empty.\n");
+	}
+	else if (n%8) {
+		PACK_DBG("hdlc frame integrity error.\n");
+	}
+	else if ((f->count = n/8) < fcs_len + 1) {
+		PACK_DBG("hdlc frame size error.\n");
+	}
+	else if (h->fcs32 ?
+		 modem_crc32(INIT_FCS32,f->buf,f->count) != GOOD_FCS32 :
+		 modem_crc16(INIT_FCS16,f->buf,f->count) != GOOD_FCS16) {
+		PACK_DBG("hdlc frame fcs error.\n");
+	}
+	/* good frame */
+	else if ( h->rx_complete ) {
+		/* reduce fcs size */
+		f->count -= fcs_len;
+		h->rx_complete(h->framer,f);
+	}
+	h->rx_state = 0;
+	h->rx_error = 0;
+	h->rx_bits  = 0;
+	h->rx_nbits = 0;
+	f->count = 0;
+}
+
+/* the rx destuffer, a bit at a time */
+static void hdlc_rx_bit(struct modem *m, struct hdlc_state *h, int bit)
+{
+	frame_t *f = h->rx_frame;
+	int i;
+	if (h->rx_error) {
+		h->rx_hunt = h->rx_hunt<<1|bit;
+		if (h->rx_hunt >= 0x100) {
+			if ((h->rx_hunt&0xff) == HDLC_FLAG) {
+				hdlc_rx_flag(m,h);
+				return;
+			}
+			h->rx_hunt = (h->rx_hunt&0x7f)|0x80;
+		}
+		return;
+	}
+	switch (rx_bit_step(&h->rx_state,bit)) {
+	case RX_DATA:
+		h->rx_bits |= bit<<h->rx_nbits;
+		if (++h->rx_nbits < 8)
+			break;
+		h->rx_nbits = 0;
+		if (f->count < f->size) {
+			f->buf[f->count++] = h->rx_bits;
+			h->rx_bits = 0;
+			break;
+		}
+		/* overflow */
+		PACK_DBG("hdlc rx frame overflow.\n");
+		/* the hunt starts here, but keeps the zero and ones just
+		   passed on: they may begin a flag */
+		i = h->rx_state&0x7;
+		hdlc_rx_error(h,(h->rx_state&RX_Z) ? 0x2<<i|((1<<i)-1) : 1);
+		h->rx_state = 0;
+		break;
+	case RX_DROP:
+		break;
+	case RX_FLAG:
+		hdlc_rx_flag(m,h);
+		break;
+	case RX_ABORT:
+		hdlc_rx_error(h,1);
+		break;
+	case RX_ABORT1:
+		hdlc_rx_error(h,0x3);
+		break;
+	}
+}
+
 int modem_hdlc_put_bits(struct modem *m, int nbits,
 			u8 *bit_buf, int bit_cnt)
 {
@@ -476,7 +653,9 @@ int modem_hdlc_put_bits(struct modem *m, int nbits,
 	register struct bits_state *s = &m->unpack;
 	register int ret = 0;
 	register int i;
-	register u8 in, out, mask = ((0x1<<nbits)-1);
+	register u8 in, mask = ((0x1<<nbits)-1);
+	frame_t *f = h->rx_frame;
+	u32 e, w;
 	while(bit_cnt > 0) {
 		s->data <<= nbits;
 		s->data |= *bit_buf++ & mask;
@@ -484,88 +663,39 @@ int modem_hdlc_put_bits(struct modem *m, int nbits,
 		bit_cnt--;
 		ret++;
 
-		/* 8 char, 2 possible escapes, +8 estimated flag */
-		if ( s->bit < 8 + 8 + 2)
-			continue;
-
-		out = 0;
-		// fixme: probably may be optimized by handling whole
-		// byte with masking
-		/* mask = 0x80; */
-		for ( i=0 ; i<8 ; i++ ) {
-			in = s->data >> (s->bit-8) ;
-			/* flag: finish frame */
-			if (in == HDLC_FLAG) {
-				/* end of frame */;
-				if ( !h->rx_frame->count ) {
-					//HDLC_DBG("empty.\n");
-				}
-				/* check frame for errors */
-				else if (h->rx_error) {
-					PACK_DBG("hdlc frame error.\n");
-				}
-				else if (i) {
-					PACK_DBG("hdlc frame integrity error.\n");
-				}
-#if 1
-				else if ( h->rx_frame->count < 3 ) {
-#else
-				else if ( h->rx_frame->count < 4 ) {
-#endif
-					PACK_DBG("hdlc frame size error.\n");
+		while (s->bit >= 8) {
+			s->bit -= 8;
+			in = s->data >> s->bit;
+			if (h->rx_error) {
+				/* hunt: does a flag end in this byte? */
+				w = h->rx_hunt<<8|in;
+				for (i = 7 ; i >= 0 ; i--)
+					if ((w>>i) >= 0x100 &&
+					    ((w>>i)&0xff) == HDLC_FLAG)
+						break;
+				if (i < 0) {
+					h->rx_hunt = (in&0x7f)|0x80;
+					continue;
 				}
-				else if ( h->rx_frame->fcs != GOOD_FCS ) {
-					PACK_DBG("hdlc frame fcs error.\n");
-				}
-				/* good frame */
-				else if ( h->rx_complete ) {
-					/* reduce fcs size */
-					h->rx_frame->count -= 2;
-					h->rx_complete(h->framer,h->rx_frame);
-				}
-				s->bit -= 8;
-				h->rx_ones = 0;
-				h->rx_error = 0;
-				h->rx_frame->fcs   = INIT_FCS;
-				h->rx_frame->count = 0;
-				break;
-			}
-			else if(h->rx_error) {
-				s->bit--;
-				continue;
 			}
-			/* put reversed data bit */
-			out >>= 1;
-			if (in&0x80) {
-				out |= 0x80;
-				h->rx_ones++;
-				/* escape or idle reached */
-				if (h->rx_ones == 5) {
-					if (in&0x40) {
-						h->rx_error++;
-						h->rx_frame->count = 0;
+			else {
+				e = hdlc_rx_tab[h->rx_state][in];
+				if (!(e&RX_SLOW) &&
+				    (f->count < f->size ||
+				     h->rx_nbits + RX_NBITS(e) < 8)) {
+					h->rx_bits |= RX_BITS(e)<<h->rx_nbits;
+					h->rx_nbits += RX_NBITS(e);
+					h->rx_state  = RX_STATE(e);
+					if (h->rx_nbits >= 8) {
+						f->buf[f->count++] = h->rx_bits;
+						h->rx_bits >>= 8;
+						h->rx_nbits -= 8;
 					}
-					s->bit--;
-					h->rx_ones = 0;
+					continue;
 				}
 			}
-			else
-				h->rx_ones = 0;
-			s->bit--;
-		}
-
-		/* finish char */
-		if(i==8 && !h->rx_error) {
-			if (h->rx_frame->count < h->rx_frame->size) {
-				h->rx_frame->buf[h->rx_frame->count] = out;
-				h->rx_frame->count++;
-				h->rx_frame->fcs = GET_FCS(h->rx_frame->fcs,out);
-			}
-			else { /* overflow */
-				PACK_DBG("hdlc rx frame overflow.\n");
-				h->rx_error++;
-				h->rx_frame->count = 0;
-			}
+			for (i = 7 ; i >= 0 ; i--)
+				hdlc_rx_bit(m,h,(in>>i)&1);
 		}
 	}
 
@@ -577,6 +707,7 @@ void modem_hdlc_start(struct modem *m)
 {
 	struct hdlc_state *h = &m->packer.hdlc;
 	PACK_DBG("hdlc_start...\n");
+	hdlc_init_tables();
 	memset(h,0,sizeof(*h));
 	/* wait for flag to clear rx error state */
 	h->rx_error = 1;
@@ -585,7 +716,7 @@ void modem_hdlc_start(struct modem *m)
 	h->rx_frame->buf  = h->_rx_buf;
 	h->rx_frame->count= 0;
 	h->rx_frame->size = sizeof(h->_rx_buf);
-	h->rx_frame->fcs  = INIT_FCS;
+	h->rx_hunt = 1;
 	/* tx frame */
 	h->tx_frame = 0;
 
@@ -42,6 +42,8 @@
  */
 
 
+#include <sys/ioctl.h>
+
 #include <modem.h>
 #include <modem_homolog.h>
 #include <modem_param.h>
@@ -184,6 +186,9 @@ long modem_set_param(struct modem *m, unsigned name, int val)
 		break;
 	case MDMPRM_RX_RATE:
 		m->rx_rate = val;
+		m->rate_updates++;
+		if(m->modem_info&TIOCM_CD) /* rate change after CONNECT */
+			m->stats.retrains++;
 		break;
 	case MDMPRM_TX_RATE:
 		m->tx_rate = val;
@@ -0,0 +1,765 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_replay.c  --  reader for the binary log of slmodemd -l.
+ *
+ *    The log (slmodem.log.<dev>) is a stream of struct sllog_header
+ *    records.  Without options a summary is printed: per modem record
+ *    and byte counts of each category, the calls found in it (a call is
+ *    a run of RX sample blocks without a gap of a second or more) and
+ *    the records the logger had to drop.
+ *
+ *    -w writes the RX, TX and echo canceller samples of one modem to WAV
+ *    files.  -r replays the RX samples of one call through modem_process()
+ *    of a headless modem, as fast as the CPU allows, and compares every
+ *    block it transmits with the recorded one.  The replayed modem must
+ *    be set up as the recorded one was (-c), then a replay is
+ *    deterministic, and the CPU time it takes is DSP time on real line
+ *    audio.
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include <modem.h>
+#include <modem_debug.h>
+
+#define INFO(fmt,args...) fprintf(stderr, fmt , ##args );
+#define ERR(fmt,args...) fprintf(stderr, "error: " fmt , ##args );
+
+#define DBG(fmt,args...) if(modem_debug_level) \
+                             fprintf(stderr, "replay: " fmt , ##args );
+
+
+/* modem init externals : FIXME remove it */
+extern int  dp_dummy_init(void);
+extern void dp_dummy_exit(void);
+extern int  dp_sinus_init(void);
+extern void dp_sinus_exit(void);
+extern int  prop_dp_init(void);
+extern void prop_dp_exit(void);
+
+extern unsigned int modem_debug_logging;
+
+
+#define REPLAY_RATE      MODEM_RATE
+#define REPLAY_BLOCK     4096	/* samples per modem_process() call, max */
+#define REPLAY_CALL_GAP  1000000000ULL /* ns without RX samples: new call */
+#define REPLAY_MODEMS    64
+#define REPLAY_CATEGORIES (MODEM_DBG_OVERFLOW + 1)
+
+static const char *category_names[REPLAY_CATEGORIES] = {
+	[MODEM_DBG_PRINT_MSG]     = "print_msg",
+	[MODEM_DBG_RX_SAMPLES]    = "rx_samples",
+	[MODEM_DBG_TX_SAMPLES]    = "tx_samples",
+	[MODEM_DBG_ECHOC_SAMPLES] = "echoc_samples",
+	[MODEM_DBG_MISC_DATA]     = "misc_data",
+	[MODEM_DBG_MISC1_DATA]    = "misc1_data",
+	[MODEM_DBG_RX_BITS]       = "rx_bits",
+	[MODEM_DBG_TX_BITS]       = "tx_bits",
+	[MODEM_DBG_RX_DATA]       = "rx_data",
+	[MODEM_DBG_TX_DATA]       = "tx_data",
+	[MODEM_DBG_RX_CHARS]      = "rx_chars",
+	[MODEM_DBG_TX_CHARS]      = "tx_chars",
+	[MODEM_DBG_OVERFLOW]      = "overflow",
+};
+
+
+/* log reader */
+
+struct log_file {
+	const u8 *start, *pos, *end;
+	size_t size;
+};
+
+struct log_rec {
+	struct sllog_header hdr;
+	unsigned long long time; /* ns, CLOCK_MONOTONIC */
+	const u8 *data;
+};
+
+static int log_open(struct log_file *l, const char *name)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(name,O_RDONLY);
+	if(fd < 0 || fstat(fd,&st) < 0) {
+		ERR("cannot open `%s': %s\n",name,strerror(errno));
+		if(fd >= 0)
+			close(fd);
+		return -1;
+	}
+	l->size = st.st_size;
+	l->start = l->size ? mmap(NULL,l->size,PROT_READ,MAP_PRIVATE,fd,0) :
+			     NULL;
+	close(fd);
+	if(l->start == MAP_FAILED) {
+		ERR("cannot map `%s': %s\n",name,strerror(errno));
+		return -1;
+	}
+	l->pos = l->start;
+	l->end = l->start + l->size;
+	return 0;
+}
+
+static void log_close(struct log_file *l)
+{
+	if(l->start)
+		munmap((void *)l->start,l->size);
+}
+
+static void log_rewind(struct log_file *l)
+{
+	l->pos = l->start;
+}
+
+/* records are packed, not aligned: the header is copied out */
+static int log_next(struct log_file *l, struct log_rec *r)
+{
+	if(l->end - l->pos < (long)sizeof(r->hdr))
+		return 0;
+	memcpy(&r->hdr,l->pos,sizeof(r->hdr));
+	if(r->hdr.length > l->end - l->pos - sizeof(r->hdr)) {
+		INFO("log truncated at offset %ld\n",(long)(l->pos - l->start));
+		l->pos = l->end;
+		return 0;
+	}
+	r->data = l->pos + sizeof(r->hdr);
+	r->time = r->hdr.sec*1000000000ULL + r->hdr.nsec;
+	l->pos += sizeof(r->hdr) + r->hdr.length;
+	return 1;
+}
+
+
+/* summary */
+
+struct modem_sum {
+	unsigned id;
+	unsigned long records[REPLAY_CATEGORIES];
+	unsigned long long bytes[REPLAY_CATEGORIES];
+	unsigned calls;
+	unsigned long long last_rx;	/* time of the last RX block */
+};
+
+static struct modem_sum *find_sum(struct modem_sum *sums, unsigned *n,
+				  unsigned id)
+{
+	unsigned i;
+	for(i = 0 ; i < *n ; i++)
+		if(sums[i].id == id)
+			return &sums[i];
+	if(*n == REPLAY_MODEMS)
+		return NULL;
+	memset(&sums[*n],0,sizeof(sums[*n]));
+	sums[*n].id = id;
+	return &sums[(*n)++];
+}
+
+/* call number of an RX block: updates s->calls and s->last_rx */
+static unsigned call_of(struct modem_sum *s, unsigned long long time)
+{
+	if(!s->calls || time - s->last_rx >= REPLAY_CALL_GAP)
+		s->calls++;
+	s->last_rx = time;
+	return s->calls;
+}
+
+static void print_summary(struct log_file *l)
+{
+	static struct modem_sum sums[REPLAY_MODEMS];
+	unsigned long long first = 0, last = 0, call_start = 0;
+	unsigned long lost = 0, lost_bytes = 0, call_samples = 0;
+	unsigned nsums = 0, i, j, call;
+	struct modem_sum *s;
+	struct log_rec r;
+
+	while(log_next(l,&r)) {
+		if(!first)
+			first = r.time;
+		last = r.time;
+		if(r.hdr.id == MODEM_DBG_OVERFLOW && r.hdr.length >= 8) {
+			unsigned cnt[2];
+			memcpy(cnt,r.data,sizeof(cnt));
+			lost += cnt[0];
+			lost_bytes += cnt[1];
+			printf("%10.3f s: %u records (%u bytes) dropped\n",
+			       (r.time - first)/1e9, cnt[0], cnt[1]);
+			continue;
+		}
+		if(r.hdr.id >= REPLAY_CATEGORIES)
+			continue;
+		s = find_sum(sums,&nsums,r.hdr.modem_id);
+		if(!s)
+			continue;
+		s->records[r.hdr.id]++;
+		s->bytes[r.hdr.id] += r.hdr.length;
+		if(r.hdr.id != MODEM_DBG_RX_SAMPLES)
+			continue;
+		call = s->calls;
+		if(call_of(s,r.time) != call) {
+			if(call)
+				printf("  %.3f s, %lu samples\n",
+				       (double)call_samples/REPLAY_RATE,
+				       call_samples);
+			call_start = r.time;
+			call_samples = 0;
+			printf("%10.3f s: modem %08x call %u",
+			       (call_start - first)/1e9, s->id, s->calls);
+		}
+		call_samples += r.hdr.length >> MFMT_SHIFT(MODEM_FORMAT);
+	}
+	if(call_start)
+		printf("  %.3f s, %lu samples\n",
+		       (double)call_samples/REPLAY_RATE, call_samples);
+
+	printf("log: %ld bytes, %.3f s", (long)l->size, (last - first)/1e9);
+	if(lost)
+		printf(", %lu records (%lu bytes) dropped by the logger",
+		       lost, lost_bytes);
+	printf("\n");
+	for(i = 0 ; i < nsums ; i++) {
+		s = &sums[i];
+		printf("modem %08x: %u calls\n", s->id, s->calls);
+		for(j = 0 ; j < REPLAY_CATEGORIES ; j++)
+			if(s->records[j])
+				printf("  %-14s %10lu records %12llu bytes\n",
+				       category_names[j],
+				       s->records[j], s->bytes[j]);
+	}
+}
+
+
+/* modem and call selection, shared by -w and -r */
+
+static int select_modem(struct log_file *l, int *have_id, unsigned *id)
+{
+	struct log_rec r;
+	if(*have_id)
+		return 0;
+	log_rewind(l);
+	while(log_next(l,&r))
+		if(r.hdr.id == MODEM_DBG_RX_SAMPLES) {
+			*id = r.hdr.modem_id;
+			*have_id = 1;
+			log_rewind(l);
+			return 0;
+		}
+	ERR("no RX samples in the log\n");
+	return -1;
+}
+
+
+/* WAV export: 16 bit mono at the modem rate; gaps are not filled */
+
+struct wav_file {
+	FILE *f;
+	unsigned long bytes;
+};
+
+static void put_le(u8 *p, unsigned val, int n)
+{
+	while(n--) {
+		*p++ = val;
+		val >>= 8;
+	}
+}
+
+static void wav_header(struct wav_file *w)
+{
+	u8 h[44];
+	memcpy(h,"RIFF",4);
+	put_le(h+4,36 + w->bytes,4);
+	memcpy(h+8,"WAVEfmt ",8);
+	put_le(h+16,16,4);
+	put_le(h+20,1,2);		/* PCM */
+	put_le(h+22,1,2);		/* mono */
+	put_le(h+24,REPLAY_RATE,4);
+	put_le(h+28,REPLAY_RATE*2,4);
+	put_le(h+32,2,2);
+	put_le(h+34,16,2);
+	memcpy(h+36,"data",4);
+	put_le(h+40,w->bytes,4);
+	fseek(w->f,0,SEEK_SET);
+	fwrite(h,1,sizeof(h),w->f);
+}
+
+static int write_wavs(struct log_file *l, unsigned id, unsigned call,
+		      const char *prefix)
+{
+	static const struct {
+		unsigned cat;
+		const char *suffix;
+	} wavs[] = {
+		{ MODEM_DBG_RX_SAMPLES,    "rx" },
+		{ MODEM_DBG_TX_SAMPLES,    "tx" },
+		{ MODEM_DBG_ECHOC_SAMPLES, "echo" },
+	};
+	struct wav_file w[3];
+	struct modem_sum s;
+	struct log_rec r;
+	char name[512];
+	unsigned cur = 0;
+	int i, ret = 0;
+
+	memset(&s,0,sizeof(s));
+	memset(w,0,sizeof(w));
+	while(log_next(l,&r)) {
+		if(r.hdr.modem_id != id)
+			continue;
+		if(r.hdr.id == MODEM_DBG_RX_SAMPLES)
+			cur = call_of(&s,r.time);
+		if(!cur || (call && cur != call))
+			continue;
+		for(i = 0 ; i < 3 ; i++) {
+			if(r.hdr.id != wavs[i].cat)
+				continue;
+			if(!w[i].f) {
+				snprintf(name,sizeof(name),"%s-%s.wav",
+					 prefix,wavs[i].suffix);
+				w[i].f = fopen(name,"w");
+				if(!w[i].f) {
+					ERR("cannot create `%s': %s\n",
+					    name,strerror(errno));
+					ret = -1;
+					goto out;
+				}
+				wav_header(&w[i]);
+			}
+			fwrite(r.data,1,r.hdr.length,w[i].f);
+			w[i].bytes += r.hdr.length;
+		}
+	}
+ out:
+	for(i = 0 ; i < 3 ; i++) {
+		if(!w[i].f)
+			continue;
+		wav_header(&w[i]);
+		fclose(w[i].f);
+		INFO("%s-%s.wav: %.3f s\n", prefix, wavs[i].suffix,
+		     (double)w[i].bytes/2/REPLAY_RATE);
+	}
+	return ret;
+}
+
+
+/* replay: 'driver' of the headless modem, as the socket driver of slmodemd */
+
+static unsigned replay_started;
+
+static int replay_start(struct modem *m)
+{
+	DBG("%s: start...\n",m->name);
+	replay_started = 1;
+	return 0;
+}
+
+static int replay_stop(struct modem *m)
+{
+	DBG("%s: stop...\n",m->name);
+	replay_started = 0;
+	return 0;
+}
+
+static int replay_ioctl(struct modem *m, unsigned int cmd, unsigned long arg)
+{
+        switch (cmd) {
+        case MDMCTL_CAPABILITIES:
+                return -1;
+        case MDMCTL_HOOKSTATE:
+        case MDMCTL_SPEED:
+        case MDMCTL_GETFMTS:
+        case MDMCTL_SETFMT:
+        case MDMCTL_SETFRAGMENT:
+        case MDMCTL_SPEAKERVOL:
+        case MDMCTL_IODELAY:
+		return 0;
+        case MDMCTL_CODECTYPE:
+                return 4; /* CODEC_STLC7550, as slmodemd's socket driver */
+        default:
+                break;
+        }
+	return -2;
+}
+
+static struct modem_driver replay_driver = {
+        .name = "modem_replay driver",
+        .start = replay_start,
+        .stop = replay_stop,
+        .ioctl = replay_ioctl,
+};
+
+struct replay {
+	struct modem *modem;
+	int data_fd;		/* our side of the modem's 'pty' */
+	FILE *out;		/* received data, -o */
+	int online;
+	char result[128];	/* result code being collected */
+	unsigned result_len;
+	unsigned long rx_bytes;
+	unsigned long blocks, diffs;
+	long first_diff;	/* sample count */
+};
+
+static double cpu_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static unsigned long long cpu_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/* drain what the modem wrote to its 'pty' */
+static void replay_read_data(struct replay *rp, unsigned long now)
+{
+	unsigned char buf[4096];
+	int i, n;
+	while((n = read(rp->data_fd,buf,sizeof(buf))) > 0) {
+		for(i = 0 ; i < n ; i++) {
+			if(rp->online) {
+				if(rp->out)
+					fputc(buf[i],rp->out);
+				rp->rx_bytes++;
+				continue;
+			}
+			if(buf[i] != '\r' && buf[i] != '\n') {
+				if(rp->result_len < sizeof(rp->result) - 1)
+					rp->result[rp->result_len++] = buf[i];
+				continue;
+			}
+			rp->result[rp->result_len] = '\0';
+			rp->result_len = 0;
+			if(!rp->result[0])
+				continue;
+			INFO("%10.3f s: %s\n",(double)now/REPLAY_RATE,
+			     rp->result);
+			if(!strncmp(rp->result,"CONNECT",7))
+				rp->online = 1;
+		}
+	}
+}
+
+static void replay_at(struct replay *rp, const char *cmd)
+{
+	DBG("%s\n",cmd);
+	modem_write(rp->modem,cmd,strlen(cmd));
+}
+
+static int replay_init(struct replay *rp)
+{
+	struct termios termios;
+	int sv[2];
+
+	memset(rp,0,sizeof(*rp));
+	rp->first_diff = -1;
+	if(socketpair(AF_UNIX,SOCK_STREAM,0,sv) < 0) {
+		ERR("socketpair: %s\n",strerror(errno));
+		return -1;
+	}
+	fcntl(sv[0],F_SETFL,O_NONBLOCK);
+	fcntl(sv[1],F_SETFL,O_NONBLOCK);
+	rp->modem = modem_create(&replay_driver,"replay");
+	if(!rp->modem) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	rp->modem->name = "replay";
+	rp->modem->dev_name = "replay";
+	rp->modem->pty_name = "replay";
+	rp->modem->pty = sv[0];
+	rp->data_fd = sv[1];
+
+	memset(&termios,0,sizeof(termios));
+	cfmakeraw(&termios);
+	cfsetispeed(&termios,B115200);
+	cfsetospeed(&termios,B115200);
+	modem_update_termios(rp->modem,&termios);
+	return 0;
+}
+
+static void replay_free(struct replay *rp)
+{
+	int pty = rp->modem->pty;
+	modem_delete(rp->modem);
+	close(pty);
+	close(rp->data_fd);
+}
+
+/* feed one recorded RX block, compare with the next recorded TX block */
+static void replay_block(struct replay *rp, struct log_file *l,
+			 const struct log_rec *rx, unsigned id,
+			 unsigned long *now)
+{
+	static short in[REPLAY_BLOCK], out[REPLAY_BLOCK];
+	struct modem *m = rp->modem;
+	const u8 *pos = l->pos;
+	unsigned long long t;
+	struct log_rec tx;
+	int n, found = 0;
+
+	n = rx->hdr.length >> MFMT_SHIFT(m->format);
+	if(n > REPLAY_BLOCK) {
+		ERR("%u byte block is too big\n",rx->hdr.length);
+		return;
+	}
+	memcpy(in,rx->data,rx->hdr.length);
+	t = cpu_ns();
+	modem_process(m,in,out,n);
+	m->stats.process_ns += cpu_ns() - t;
+	/* delay changes are already in the recorded stream */
+	m->update_delay = 0;
+
+	while(!found && log_next(l,&tx))
+		found = tx.hdr.modem_id == id &&
+			(tx.hdr.id == MODEM_DBG_TX_SAMPLES ||
+			 tx.hdr.id == MODEM_DBG_RX_SAMPLES);
+	if(!found || tx.hdr.id != MODEM_DBG_TX_SAMPLES) {
+		/* TX not logged: leave the next RX block to the caller */
+		l->pos = pos;
+		*now += n;
+		return;
+	}
+	rp->blocks++;
+	if(tx.hdr.length != rx->hdr.length ||
+	   memcmp(tx.data,out,tx.hdr.length)) {
+		if(!rp->diffs)
+			rp->first_diff = *now;
+		rp->diffs++;
+	}
+	*now += n;
+}
+
+static int replay(struct log_file *l, unsigned id, unsigned call,
+		  const char *at, int answer, const char *out_name)
+{
+	struct replay rp;
+	struct modem_sum s;
+	struct log_rec r;
+	unsigned long now = 0;
+	unsigned cur = 0;
+	char cmd[256];
+	double cpu;
+	int dialed = 0;
+
+	if(replay_init(&rp) < 0)
+		return -1;
+	if(out_name) {
+		rp.out = fopen(out_name,"w");
+		if(!rp.out) {
+			ERR("cannot create `%s': %s\n",out_name,strerror(errno));
+			replay_free(&rp);
+			return -1;
+		}
+	}
+	memset(&s,0,sizeof(s));
+	modem_timer_simulate(0);
+	snprintf(cmd,sizeof(cmd),"ATE0%s\r",at ? at : "");
+	replay_at(&rp,cmd);
+	replay_read_data(&rp,now);
+
+	cpu = cpu_time();
+	while(log_next(l,&r)) {
+		if(r.hdr.modem_id != id || r.hdr.id != MODEM_DBG_RX_SAMPLES)
+			continue;
+		cur = call_of(&s,r.time);
+		if(cur < call)
+			continue;
+		if(cur > call)
+			break;
+		if(!dialed) {
+			replay_at(&rp,answer ? "ATA\r" : "ATDT1\r");
+			dialed = 1;
+		}
+		if(!replay_started) {
+			INFO("%10.3f s: modem stopped\n",
+			     (double)now/REPLAY_RATE);
+			break;
+		}
+		replay_block(&rp,l,&r,id,&now);
+
+		modem_timer_simulate(now*MODEM_HZ/REPLAY_RATE);
+		modem_timer_run();
+		if(rp.modem->event)
+			modem_event(rp.modem);
+		replay_read_data(&rp,now);
+	}
+	cpu = cpu_time() - cpu;
+	if(!dialed) {
+		ERR("modem %08x has no call %u\n",id,call);
+		replay_free(&rp);
+		return -1;
+	}
+
+	INFO("replayed %.3f s in %.3f s cpu (%.1fx real time), "
+	     "%lu bytes received\n",
+	     (double)now/REPLAY_RATE, cpu,
+	     cpu > 0 ? (double)now/REPLAY_RATE/cpu : 0.0, rp.rx_bytes);
+	if(rp.diffs) {
+		INFO("tx differs from the log in %lu of %lu blocks, "
+		     "first at %.3f s\n", rp.diffs, rp.blocks,
+		     (double)rp.first_diff/REPLAY_RATE);
+	}
+	else if(rp.blocks) {
+		INFO("tx matches the log (%lu blocks)\n",rp.blocks);
+	}
+	modem_stats_print(rp.modem,stdout,now*1000/REPLAY_RATE);
+
+	if(rp.out)
+		fclose(rp.out);
+	replay_free(&rp);
+	return rp.diffs ? 1 : 0;
+}
+
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <log file>\n"
+		"  (no option)    summary: records per modem and category, calls\n"
+		"  -m <id>        modem id, hex as in the summary (default: the\n"
+		"                 first one with RX samples)\n"
+		"  -n <call>      call number for -w and -r (default: all for -w,\n"
+		"                 1 for -r)\n"
+		"  -w <prefix>    write <prefix>-rx.wav, -tx.wav and -echo.wav\n"
+		"  -r             replay RX samples through a headless modem\n"
+		"  -c <AT>        AT commands (without 'AT') to set up the\n"
+		"                 replayed modem as the recorded one, e.g.\n"
+		"                 'X3+MS=132,0,4800,9600'\n"
+		"  -a             the replayed modem answers (default: dials)\n"
+		"  -o <file>      write the data the replayed modem receives\n"
+		"  -l <level>     log the replay to slmodem.log.replay\n"
+		"  -d             increase debug level\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *wav = NULL, *at = NULL, *out = NULL;
+	int opt, have_id = 0, do_replay = 0, answer = 0, ret = 0;
+	unsigned id = 0, call = 0;
+	struct log_file l;
+
+	while((opt = getopt(argc,argv,"m:n:w:rc:ao:l:dh")) != -1) {
+		switch(opt) {
+		case 'm':
+			id = strtoul(optarg,NULL,16);
+			have_id = 1;
+			break;
+		case 'n':
+			call = strtoul(optarg,NULL,0);
+			break;
+		case 'w':
+			wav = optarg;
+			break;
+		case 'r':
+			do_replay = 1;
+			break;
+		case 'c':
+			at = optarg;
+			break;
+		case 'a':
+			answer = 1;
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'l':
+			modem_debug_logging = strtoul(optarg,NULL,0);
+			break;
+		case 'd':
+			modem_debug_level++;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if(optind != argc - 1)
+		usage(argv[0]);
+	if(log_open(&l,argv[optind]) < 0)
+		return 2;
+
+	if(!wav && !do_replay) {
+		print_summary(&l);
+		log_close(&l);
+		return 0;
+	}
+	if(select_modem(&l,&have_id,&id) < 0) {
+		log_close(&l);
+		return 2;
+	}
+	if(wav && write_wavs(&l,id,call,wav) < 0)
+		ret = 2;
+	if(do_replay && !ret) {
+		log_rewind(&l);
+		modem_debug_init("replay");
+		dp_dummy_init();
+		dp_sinus_init();
+		prop_dp_init();
+		if(modem_timer_init() < 0) {
+			ERR("cannot create timer: %s\n",strerror(errno));
+			exit(2);
+		}
+		ret = replay(&l,id,call ? call : 1,at,answer,out);
+		if(ret < 0)
+			ret = 2;
+		dp_dummy_exit();
+		dp_sinus_exit();
+		prop_dp_exit();
+		modem_timer_exit();
+		modem_debug_exit();
+	}
+	log_close(&l);
+	return ret;
+}
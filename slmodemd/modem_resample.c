@@ -0,0 +1,197 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *    modem_resample.c  --  polyphase sample rate converter with a finely
+ *                          adjustable ratio.
+ *
+ *    The input is interpolated at output instants with a Kaiser windowed
+ *    sinc, tabulated in PHASES sub-sample phases and linearly interpolated
+ *    between neighbouring phases.  The output instant is tracked as an
+ *    exact fraction of out_rate * SCALE, so nominal ratios like
+ *    8000 <-> 9600 stay sample exact, and modem_resample_set_ppm() can
+ *    trim the ratio in steps well below one ppm to follow a drifting
+ *    clock.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <modem_resample.h>
+
+#define TAPS        48   /* input samples per output */
+#define PHASES      256  /* filter phases per input sample */
+#define SCALE       (1ULL << 20) /* sub-unit resolution of the step */
+#define KAISER_BETA 8.0
+#define CUTOFF      0.97 /* of the lower Nyquist frequency */
+
+struct modem_resampler {
+	unsigned in_rate, out_rate;
+	uint64_t den;      /* one input sample, in step units */
+	uint64_t step;     /* input advance per output */
+	uint64_t frac;     /* fractional position of next output, < den */
+	int idx;           /* input index of next output */
+	float *coef;       /* [phase][tap], tap 0 applies to newest sample */
+	int16_t hist[TAPS - 1]; /* last input samples */
+};
+
+static double bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	int k;
+	for (k = 1; k < 32; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/* coef[p][k] weights input sample idx-k for an output at idx + p/PHASES,
+   delayed by TAPS/2 samples to keep the filter causal */
+static void design_filter(struct modem_resampler *r)
+{
+	double fc = CUTOFF * 0.5;
+	double half = TAPS / 2.0;
+	double i0b = bessel_i0(KAISER_BETA);
+	unsigned p, k;
+
+	if (r->out_rate < r->in_rate)
+		fc = fc * r->out_rate / r->in_rate;
+
+	for (p = 0; p <= PHASES; p++) {
+		float *c = r->coef + p * TAPS;
+		double sum = 0;
+		for (k = 0; k < TAPS; k++) {
+			double t = k + (double)p / PHASES - (half - 1), h, w;
+			h = t == 0 ? 2 * fc : sin(2 * M_PI * fc * t) / (M_PI * t);
+			w = t / half;
+			w = fabs(w) >= 1 ? 0 :
+				bessel_i0(KAISER_BETA * sqrt(1 - w * w)) / i0b;
+			c[k] = h * w;
+			sum += c[k];
+		}
+		/* unity gain at DC for every phase */
+		for (k = 0; k < TAPS; k++)
+			c[k] /= sum;
+	}
+}
+
+struct modem_resampler *modem_resample_create(unsigned in_rate,
+					      unsigned out_rate)
+{
+	struct modem_resampler *r;
+
+	if (!in_rate || !out_rate)
+		return NULL;
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	r->in_rate = in_rate;
+	r->out_rate = out_rate;
+	r->den = out_rate * SCALE;
+	r->coef = calloc((PHASES + 1) * TAPS, sizeof(*r->coef));
+	if (!r->coef) {
+		free(r);
+		return NULL;
+	}
+	design_filter(r);
+	modem_resample_set_ppm(r, 0);
+	return r;
+}
+
+void modem_resample_delete(struct modem_resampler *r)
+{
+	if (!r)
+		return;
+	free(r->coef);
+	free(r);
+}
+
+void modem_resample_reset(struct modem_resampler *r)
+{
+	r->frac = 0;
+	r->idx = 0;
+	memset(r->hist, 0, sizeof(r->hist));
+}
+
+void modem_resample_set_ppm(struct modem_resampler *r, double ppm)
+{
+	r->step = llrint(r->in_rate * SCALE * (1 + ppm * 1e-6));
+}
+
+static inline int16_t sat16(float v)
+{
+	if (v >= 32767.0f)
+		return 32767;
+	if (v <= -32768.0f)
+		return -32768;
+	return (int16_t)lrintf(v);
+}
+
+int modem_resample_process(struct modem_resampler *r,
+			   const int16_t *in, int count, int16_t *out)
+{
+	int16_t buf[TAPS - 1 + 1024];
+	const int16_t *x;
+	int n = 0, k, chunk;
+
+	while (count > 0) {
+		chunk = count > 1024 ? 1024 : count;
+		memcpy(buf, r->hist, sizeof(r->hist));
+		memcpy(buf + TAPS - 1, in, chunk * sizeof(*in));
+		while (r->idx < chunk) {
+			uint64_t pos = r->frac * PHASES;
+			unsigned p = pos / r->den;
+			float mu = (float)(pos % r->den) / r->den;
+			const float *c0 = r->coef + p * TAPS;
+			const float *c1 = c0 + TAPS;
+			float acc0 = 0, acc1 = 0;
+			/* newest input at buf[idx + TAPS - 1] */
+			x = buf + r->idx + TAPS - 1;
+			for (k = 0; k < TAPS; k++) {
+				acc0 += c0[k] * x[-k];
+				acc1 += c1[k] * x[-k];
+			}
+			out[n++] = sat16(acc0 + mu * (acc1 - acc0));
+			r->frac += r->step;
+			r->idx += r->frac / r->den;
+			r->frac %= r->den;
+		}
+		r->idx -= chunk;
+		memcpy(r->hist, buf + chunk, sizeof(r->hist));
+		in += chunk;
+		count -= chunk;
+	}
+	return n;
+}
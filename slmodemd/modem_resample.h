@@ -0,0 +1,57 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ *    modem_resample.h  --  polyphase sample rate converter (8000 <-> 9600 Hz
+ *                          and the like) with drift trimming.
+ *
+ */
+
+#ifndef __MODEM_RESAMPLE_H__
+#define __MODEM_RESAMPLE_H__
+
+#include <stdint.h>
+
+struct modem_resampler;
+
+extern struct modem_resampler *modem_resample_create(unsigned in_rate,
+						     unsigned out_rate);
+extern void modem_resample_delete(struct modem_resampler *r);
+extern void modem_resample_reset(struct modem_resampler *r);
+/* input clock is ppm faster than in_rate: consume input that much faster */
+extern void modem_resample_set_ppm(struct modem_resampler *r, double ppm);
+/* returns number of samples written to out, which must have room for
+   count * out_rate / in_rate + 2 samples */
+extern int modem_resample_process(struct modem_resampler *r,
+				  const int16_t *in, int count, int16_t *out);
+
+#endif /* __MODEM_RESAMPLE_H__ */
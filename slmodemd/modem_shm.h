@@ -0,0 +1,146 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_shm.h  --  shared memory audio transport between slmodemd
+ *                     and the external audio application (d-modem).
+ *
+ *    The shared area holds two single producer/single consumer sample
+ *    rings.  It is used by both the 32-bit slmodemd and the native
+ *    d-modem, so only fixed size types are allowed in it.
+ *
+ */
+
+#ifndef __MODEM_SHM_H__
+#define __MODEM_SHM_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#define MODEM_SHM_MAGIC     0x4d53484d /* 'MSHM' */
+#define MODEM_SHM_VERSION   1
+#define MODEM_SHM_RING_SIZE 4096       /* samples, power of 2 */
+
+#define MODEM_SHM_RING_MASK (MODEM_SHM_RING_SIZE - 1)
+
+/* head and tail on separate cache lines */
+struct modem_shm_ring {
+	uint32_t head;      /* written by producer only */
+	uint32_t pad0[15];
+	uint32_t tail;      /* written by consumer only */
+	uint32_t pad1[15];
+	int16_t  buf[MODEM_SHM_RING_SIZE];
+};
+
+struct modem_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ring_size;
+	uint32_t pad[13];
+	struct modem_shm_ring rx;  /* d-modem -> slmodemd */
+	struct modem_shm_ring tx;  /* slmodemd -> d-modem */
+};
+
+
+static inline void modem_shm_init(struct modem_shm *shm)
+{
+	memset(shm, 0, sizeof(*shm));
+	shm->magic = MODEM_SHM_MAGIC;
+	shm->version = MODEM_SHM_VERSION;
+	shm->ring_size = MODEM_SHM_RING_SIZE;
+}
+
+static inline int modem_shm_check(const struct modem_shm *shm)
+{
+	return (shm->magic == MODEM_SHM_MAGIC &&
+		shm->version == MODEM_SHM_VERSION &&
+		shm->ring_size == MODEM_SHM_RING_SIZE) ? 0 : -1;
+}
+
+/* samples available to the consumer */
+static inline unsigned modem_shm_ring_count(struct modem_shm_ring *r)
+{
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	return head - tail;
+}
+
+/* free space for the producer */
+static inline unsigned modem_shm_ring_space(struct modem_shm_ring *r)
+{
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	return MODEM_SHM_RING_SIZE - (head - tail);
+}
+
+/* producer side: returns samples written (may be short) */
+static inline int modem_shm_ring_write(struct modem_shm_ring *r,
+				       const int16_t *buf, int count)
+{
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	unsigned space = modem_shm_ring_space(r);
+	unsigned pos, cnt;
+	if (count > space)
+		count = space;
+	pos = head & MODEM_SHM_RING_MASK;
+	cnt = MODEM_SHM_RING_SIZE - pos;
+	if (cnt > count)
+		cnt = count;
+	memcpy(r->buf + pos, buf, cnt*sizeof(*buf));
+	memcpy(r->buf, buf + cnt, (count - cnt)*sizeof(*buf));
+	__atomic_store_n(&r->head, head + count, __ATOMIC_RELEASE);
+	return count;
+}
+
+/* consumer side: returns samples read (may be short) */
+static inline int modem_shm_ring_read(struct modem_shm_ring *r,
+				      int16_t *buf, int count)
+{
+	uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	unsigned avail = modem_shm_ring_count(r);
+	unsigned pos, cnt;
+	if (count > avail)
+		count = avail;
+	pos = tail & MODEM_SHM_RING_MASK;
+	cnt = MODEM_SHM_RING_SIZE - pos;
+	if (cnt > count)
+		cnt = count;
+	memcpy(buf, r->buf + pos, cnt*sizeof(*buf));
+	memcpy(buf + cnt, r->buf, (count - cnt)*sizeof(*buf));
+	__atomic_store_n(&r->tail, tail + count, __ATOMIC_RELEASE);
+	return count;
+}
+
+#endif /* __MODEM_SHM_H__ */
@@ -0,0 +1,738 @@
+
+/*
+ *
+ *    Copyright (c) 2021, Aon plc
+ *    All rights reserved.
+ *
+ *    Redistribution and use in source and binary forms, with or without
+ *    modification, are permitted provided that the following conditions
+ *    are met:
+ *
+ *        1. Redistributions of source code must retain the above copyright
+ *           notice, this list of conditions and the following disclaimer.
+ *        2. Redistributions in binary form must reproduce the above
+ *           copyright notice, this list of conditions and the following
+ *           disclaimer in the documentation and/or other materials provided
+ *           with the distribution.
+ *        3. Neither the name of the copyright holder nor the names of its
+ *           contributors may be used to endorse or promote products derived
+ *           from this software without specific prior written permission.
+ *
+ *    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *    OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *
+ *    modem_slz.c  --  SLZ, slmodemd's own string compressor.
+ *
+ *    Modeled on V.44's LZJH (history references, string extension,
+ *    ordinals and codewords, parameter names as there) but not wire
+ *    compatible with it, and negotiated under a set id of its own, so
+ *    only another slmodemd runs it; everyone else gets V42bis.
+ *
+ *    Runs on the comp_state of modem_comp.c (mode, escape char, bit
+ *    buffer, output and test statistics), with the string state in
+ *    struct slz_state.  Every string lives in the history: an entry
+ *    is a (start, length) reference into it, and a new string is the
+ *    one just matched extended by the chars that followed it the last
+ *    time (string extension), or by the first char of the next string.
+ *
+ *    Compressed data is a bit stream, lsb first, of
+ *        0 + ordinal    (7 bits, 8 after STEPUP)
+ *        1 + codeword   (C2 bits, from 6 up as the dictionary grows)
+ *    where a string codeword is followed by its extension length.
+ *    Transparent mode and its commands are the V42bis ones.
+ *
+ */
+
+#include <modem.h>
+#include <modem_debug.h>
+
+//#define SLZ_DEBUG 1
+
+/* parameters limitation */
+#define MIN_DICT_SIZE  SLZ_MIN_CODEWORDS /* min codewords (P1) */
+#define MAX_DICT_SIZE  65535  /* max codewords (P1)      */
+#define MIN_STR_SIZE   SLZ_MIN_STRING    /* min string length (P2) */
+#define MAX_STR_SIZE   255    /* max string length (P2)  */
+#define MIN_HIST_SIZE  SLZ_MIN_HISTORY   /* min history size (P3) */
+#define MAX_HIST_SIZE  65535  /* max history size (P3)   */
+
+/* constants */
+#define FIRST_ENTRY      4   /* first string codeword   N5 */
+#define INIT_CW_SIZE     6   /* initial codeword size   C2 */
+#define INIT_ORD_SIZE    7   /* initial ordinal size    C5 */
+
+/* control codewords */
+#define CCW_ETM        0   /* Enter transparent mode  */
+#define CCW_FLUSH      1   /* Flush data              */
+#define CCW_STEPUP     2   /* Step up ordinal size    */
+#define CCW_REINIT     3   /* Reinitialize dictionary */
+/* command codes */
+#define CC_ECM         0   /* Enter compression mode    */
+#define CC_EID         1   /* Escape character in data  */
+#define CC_RESET       2   /* Force reinitialization    */
+
+#define ESCAPE_STEP    51   /* escape char value step */
+#define TEST_SLICE    256   /* compression test slice (chars) */
+#define PROBE_SLICE  2048   /* transparent chars before compression is
+				tried again anyway */
+#define GUESS_HIT       4   /* guessed bits per char in transparent */
+#define GUESS_MISS      9   /*   mode, pair in dictionary or not    */
+
+/* string states */
+#define STR_START      0   /* no string */
+#define STR_MATCH      1   /* walking the dictionary */
+#define STR_EXTEND     2   /* codeword sent, matching its extension */
+
+#define SLZ_ALLOC(size) malloc(size)
+#define SLZ_FREE(mem)   free(mem)
+
+#if SLZ_DEBUG
+#define SLZ_DBG(fmt,arg...) dprintf("slz %d/%d: " fmt , \
+				    c->cmp_bits , c->raw_bits , ##arg)
+#else
+#define SLZ_DBG(fmt,arg...)
+#endif
+#define SLZ_ERR(fmt,arg...) eprintf("slz err: " fmt , ##arg)
+
+#define HIST(v,p) ((v)->hist[(p)&(v)->hist_mask])
+
+
+/*
+ *  dictionary
+ *
+ */
+
+static void dict_reset(struct slz_state *v)
+{
+	memset(v->root,0,sizeof(v->root));
+	v->next_free = FIRST_ENTRY;
+	v->cw_size   = INIT_CW_SIZE;
+	v->full      = 0;
+	v->has_prev  = 0;
+}
+
+/* a string may be used while the history still holds it, whatever
+   is copied or appended meanwhile */
+static inline int usable(struct slz_state *v, u16 e)
+{
+	return v->str_start - v->dict[e].base <= v->hist_limit;
+}
+
+static inline u16 *children(struct slz_state *v, u16 e, u8 first)
+{
+	return e ? &v->dict[e].child : &v->root[first];
+}
+
+static inline u16 find_child(struct slz_state *v, u16 first, u8 ch)
+{
+	register u16 e;
+	for (e = first; e; e = v->dict[e].next)
+		if (v->dict[e].ch == ch)
+			return e;
+	return 0;
+}
+
+static void unlink_entry(struct slz_state *v, u16 e)
+{
+	u16 *p = children(v,v->dict[e].parent,v->dict[e].first);
+	for (; *p; p = &v->dict[*p].next)
+		if (*p == e) {
+			*p = v->dict[e].next;
+			return;
+		}
+}
+
+/* add string [base,base+slen) under parent: entries are reused in
+   the order they were made, which is also the order they age out
+   of the history, and the children of a reused entry are lost */
+static u16 add_string(struct slz_state *v, u16 parent, u32 base, int slen,
+		      int len)
+{
+	struct slz_entry *d;
+	u8 first = HIST(v,base);
+	u8 ch = HIST(v,base + slen - len);
+	u16 e, *list;
+	if (slen > v->max_string)
+		return 0;
+	list = children(v,parent,first);
+	for (e = *list; e; e = v->dict[e].next)
+		if (v->dict[e].ch == ch) {
+			if (usable(v,e))
+				return 0;
+			unlink_entry(v,e); /* aged out: replace it */
+			break;
+		}
+	e = v->next_free;
+	if (e == parent && ++e >= v->dict_size)
+		e = FIRST_ENTRY;
+	v->next_free = e + 1;
+	if (v->next_free >= v->dict_size) {
+		v->next_free = FIRST_ENTRY;
+		v->full = 1;
+	}
+	if (v->full)
+		unlink_entry(v,e);
+	else if (e>>v->cw_size)
+		v->cw_size++;
+	d = &v->dict[e];
+	d->base   = base;
+	d->slen   = slen;
+	d->len    = len;
+	d->ch     = ch;
+	d->first  = first;
+	d->parent = parent;
+	d->child  = 0;
+	d->next   = *list;
+	*list = e;
+	return e;
+}
+
+/* string done, same steps on both sides */
+static void end_string(struct comp_state *c, struct slz_state *v)
+{
+	u32 start = v->str_start;
+	int len = v->cur_len + v->ext;
+	int i;
+	u16 e = 0;
+	if (v->has_prev)
+		e = add_string(v,v->prev,v->prev_start,
+			       start - v->prev_start + 1,1);
+	if (e && e == v->cur) /* just reused */
+		v->has_prev = 0;
+	else if (v->ext) {
+		add_string(v,v->cur,start,len,v->ext);
+		v->has_prev = 0;
+	}
+	else {
+		v->has_prev   = 1;
+		v->prev       = v->cur;
+		v->prev_start = start;
+	}
+	for (i = 0; i < len; i++)
+		if (HIST(v,start+i) == c->escape_char)
+			c->escape_char += ESCAPE_STEP;
+	v->str_start = start + len;
+	v->scan  = v->str_start;
+	v->state = STR_START;
+	v->ext   = 0;
+}
+
+/* reset to the initial (compressed) state */
+static void slz_reset(struct comp_state *c, struct slz_state *v)
+{
+	dict_reset(v);
+	v->ord_size  = INIT_ORD_SIZE;
+	v->str_start = v->scan = v->hpos;
+	v->state     = STR_START;
+	v->ext       = 0;
+	v->probe     = 0;
+	v->dirty     = 0;
+	c->mode        = COMPRESSED;
+	c->escape      = 0;
+	c->escape_char = 0;
+	c->bit_len     = 0;
+	c->bit_data    = 0;
+	c->cmp_last    = (TEST_SLICE<<3) - (TEST_SLICE<<1);
+}
+
+
+/*
+ *  encoder
+ *
+ */
+
+static inline int put_bits(struct comp_state *c, u32 val, int bits)
+{
+	c->bit_data |= val << c->bit_len;
+	c->bit_len += bits;
+	while (c->bit_len >= 8) {
+		comp_out_byte(c,c->bit_data&0xff);
+		c->bit_data >>= 8;
+		c->bit_len -= 8;
+	}
+	return bits;
+}
+
+static inline int put_cw(struct comp_state *c, struct slz_state *v, u16 cw)
+{
+	return put_bits(c,1|(u32)cw<<1,1+v->cw_size);
+}
+
+static inline void align_bits(struct comp_state *c)
+{
+	if (c->bit_len)
+		put_bits(c,0,8 - c->bit_len);
+}
+
+/* string extension length: 0, 10, 110x, 1110xxx, 1111xxxxxxxx */
+static int put_ext(struct comp_state *c, int k)
+{
+	if (!k)
+		return put_bits(c,0,1);
+	if (k == 1)
+		return put_bits(c,0x1,2);
+	if (k < 4)
+		return put_bits(c,0x3|(k-2)<<3,4);
+	if (k < 12)
+		return put_bits(c,0x7|(k-4)<<4,7);
+	return put_bits(c,0xf|(k-12)<<4,12);
+}
+
+static inline void send_raw(struct comp_state *c, u8 ch)
+{
+	comp_out_byte(c,ch);
+	if (ch == c->escape_char) {
+		comp_out_byte(c,CC_EID);
+		c->escape_char += ESCAPE_STEP;
+	}
+}
+
+/* the string is over: send the extension and update the test info,
+   leave compression when it does not pay */
+static void finish_string(struct comp_state *c, struct slz_state *v)
+{
+	int len = v->cur_len + v->ext;
+	if (v->cur)
+		v->bits += put_ext(c,v->ext);
+	c->raw_bits += len<<3;
+	c->cmp_bits += v->bits;
+	c->cmp_last += v->bits - c->cmp_last*len/TEST_SLICE;
+	v->dirty = 1;
+	end_string(c,v);
+	if (c->cmp_last > (TEST_SLICE<<3)) {
+		SLZ_DBG("encoder %d: --> TRANSPARENT mode.\n",c->cmp_last);
+		put_cw(c,v,CCW_ETM);
+		align_bits(c);
+		c->mode = TRANSPARENT;
+		v->has_prev = 0;
+		v->probe = 0;
+		/* what was looked at already goes out as is */
+		for (; v->str_start != v->hpos; v->str_start++)
+			send_raw(c,HIST(v,v->str_start));
+		v->scan = v->str_start;
+	}
+}
+
+/* send the matched string, a codeword goes on with its extension */
+static void send_string(struct comp_state *c, struct slz_state *v)
+{
+	u8 ch;
+	v->seg = 0;
+	if (v->cur) {
+		v->bits  = put_cw(c,v,v->cur);
+		v->scan  = v->str_start + v->cur_len;
+		v->state = STR_EXTEND;
+		return;
+	}
+	ch = HIST(v,v->str_start);
+	v->bits = 0;
+	if (ch>>v->ord_size) {
+		v->bits += put_cw(c,v,CCW_STEPUP);
+		v->ord_size++;
+	}
+	v->bits += put_bits(c,(u32)ch<<1,1+v->ord_size);
+	finish_string(c,v);
+}
+
+/* match what is in the history past scan, with final set a string
+   which could still grow is sent */
+static void parse(struct comp_state *c, struct slz_state *v, int final)
+{
+	struct slz_entry *d;
+	u16 e;
+	u8 ch;
+	while (c->mode == COMPRESSED) {
+		if (v->scan == v->hpos) {
+			if (!final || v->state == STR_START)
+				return;
+			if (v->state == STR_MATCH)
+				send_string(c,v);
+			else
+				finish_string(c,v);
+			continue;
+		}
+		ch = HIST(v,v->scan);
+		switch (v->state) {
+		case STR_START:
+			v->cur = 0;
+			v->cur_len = 1;
+			v->seg = 0;
+			v->scan++;
+			v->state = STR_MATCH;
+			break;
+		case STR_MATCH:
+			if (v->seg) {
+				d = &v->dict[v->seg];
+				if (ch == HIST(v,d->base + d->slen - d->len +
+					       v->seg_off)) {
+					v->scan++;
+					if (++v->seg_off == d->len) {
+						v->cur = v->seg;
+						v->cur_len = d->slen;
+						v->seg = 0;
+					}
+					break;
+				}
+			}
+			else {
+				e = find_child(v,*children(v,v->cur,
+					       HIST(v,v->str_start)),ch);
+				if (e && usable(v,e)) {
+					v->scan++;
+					if (v->dict[e].len == 1) {
+						v->cur = e;
+						v->cur_len = v->dict[e].slen;
+					}
+					else {
+						v->seg = e;
+						v->seg_off = 1;
+					}
+					break;
+				}
+			}
+			send_string(c,v);
+			break;
+		case STR_EXTEND:
+			d = &v->dict[v->cur];
+			if (v->cur_len + v->ext < v->max_string &&
+			    ch == HIST(v,d->base + d->slen + v->ext)) {
+				v->scan++;
+				v->ext++;
+				break;
+			}
+			finish_string(c,v);
+			break;
+		}
+	}
+}
+
+/* encoder: returns number of input chars consumed, stops early when
+   the output buffer is full */
+int slz_encode(struct comp_state *c, const u8 *in, int n)
+{
+	struct slz_state *v = c->slz;
+	int i, bits;
+	u16 e;
+	for (i = 0; i < n && c->olen < c->osize; i++) {
+		HIST(v,v->hpos) = in[i];
+		v->hpos++;
+		if (c->mode == COMPRESSED) {
+			parse(c,v,0);
+			continue;
+		}
+		send_raw(c,in[i]);
+		v->str_start = v->scan = v->hpos;
+		/* guess: a pair the dictionary knows compresses well */
+		e = find_child(v,v->root[HIST(v,v->hpos-2)],in[i]);
+		bits = e && usable(v,e) ? GUESS_HIT : GUESS_MISS;
+		c->cmp_last += bits - c->cmp_last/TEST_SLICE;
+		if (c->cmp_last < 7*TEST_SLICE ||
+		    ++v->probe >= PROBE_SLICE) {
+			SLZ_DBG("encoder: --> COMPRESSED mode.\n");
+			comp_out_byte(c,c->escape_char);
+			comp_out_byte(c,CC_ECM);
+			c->bit_len  = 0;
+			c->bit_data = 0;
+			c->mode = COMPRESSED;
+			c->cmp_last = (TEST_SLICE<<3) - (TEST_SLICE<<1);
+		}
+	}
+	return i;
+}
+
+/* flush encoder data */
+int slz_flush_encoder(struct comp_state *c)
+{
+	struct slz_state *v = c->slz;
+	if (c->mode != COMPRESSED ||
+	    (!v->dirty && v->str_start == v->hpos))
+		return 0;
+	parse(c,v,1);
+	if (c->mode == COMPRESSED) {
+		put_cw(c,v,CCW_FLUSH);
+		align_bits(c);
+	}
+	v->dirty = 0;
+	return 0;
+}
+
+
+/*
+ *  decoder
+ *
+ */
+
+/* have at least bits in bit_data, taking input bytes only as needed:
+   what follows ETM or FLUSH is byte aligned */
+static inline int get_bits(struct comp_state *c, int bits,
+			   const u8 *in, int *i, int n)
+{
+	while (c->bit_len < bits && *i < n) {
+		c->bit_data |= (u32)in[(*i)++] << c->bit_len;
+		c->bit_len += 8;
+	}
+	return c->bit_len >= bits;
+}
+
+static inline void drop_bits(struct comp_state *c, int bits)
+{
+	c->bit_data >>= bits;
+	c->bit_len -= bits;
+}
+
+/* string extension length, -1 if the code is not complete yet */
+static int get_ext(struct comp_state *c, const u8 *in, int *i, int n)
+{
+	int k;
+	if (!get_bits(c,1,in,i,n))
+		return -1;
+	if (!(c->bit_data&0x1)) {
+		drop_bits(c,1);
+		return 0;
+	}
+	if (!get_bits(c,2,in,i,n))
+		return -1;
+	if (!(c->bit_data&0x2)) {
+		drop_bits(c,2);
+		return 1;
+	}
+	if (!get_bits(c,4,in,i,n))
+		return -1;
+	if (!(c->bit_data&0x4)) {
+		k = 2 + (c->bit_data>>3&0x1);
+		drop_bits(c,4);
+		return k;
+	}
+	if (!(c->bit_data&0x8)) {
+		if (!get_bits(c,7,in,i,n))
+			return -1;
+		k = 4 + (c->bit_data>>4&0x7);
+		drop_bits(c,7);
+		return k;
+	}
+	if (!get_bits(c,12,in,i,n))
+		return -1;
+	k = 12 + (c->bit_data>>4&0xff);
+	drop_bits(c,12);
+	return k;
+}
+
+/* append len chars from src to history and output */
+static void copy_string(struct comp_state *c, struct slz_state *v,
+			u32 src, int len)
+{
+	u8 ch;
+	while (len-- > 0) {
+		ch = HIST(v,src);
+		src++;
+		HIST(v,v->hpos) = ch;
+		v->hpos++;
+		comp_out_byte(c,ch);
+	}
+}
+
+/* decoder: returns number of input bytes consumed, stops early when
+   the output buffer is full */
+int slz_decode(struct comp_state *c, const u8 *in, int n)
+{
+	struct slz_state *v = c->slz;
+	struct slz_entry *d;
+	int i = 0, k;
+	u16 cw;
+	u8 ch;
+	while (c->olen < c->osize) {
+		if (c->mode == TRANSPARENT) {
+			if (i == n)
+				break;
+			ch = in[i++];
+			if (c->escape) {
+				c->escape = 0;
+				switch (ch) {
+				case CC_ECM:
+					SLZ_DBG("T decoder: ECM\n");
+					c->mode = COMPRESSED;
+					c->bit_len  = 0;
+					c->bit_data = 0;
+					v->state = STR_START;
+					continue;
+				case CC_EID:
+					ch = c->escape_char;
+					c->escape_char += ESCAPE_STEP;
+					break;
+				case CC_RESET:
+					SLZ_DBG("T decoder: RESET\n");
+					slz_reset(c,v);
+					continue;
+				default: /* C-ERROR */
+					SLZ_ERR("fatal: invalid cmd!\n");
+					return -1;
+				}
+			}
+			else if (ch == c->escape_char) {
+				c->escape = 1;
+				continue;
+			}
+			HIST(v,v->hpos) = ch;
+			v->hpos++;
+			v->str_start = v->hpos;
+			comp_out_byte(c,ch);
+			continue;
+		}
+		if (v->state == STR_EXTEND) {
+			if ((k = get_ext(c,in,&i,n)) < 0)
+				break;
+			if (v->cur_len + k > v->max_string) { /* C-ERROR */
+				SLZ_ERR("fatal: string too long!\n");
+				return -1;
+			}
+			d = &v->dict[v->cur];
+			copy_string(c,v,d->base + d->slen,k);
+			v->ext = k;
+			end_string(c,v);
+			continue;
+		}
+		if (!get_bits(c,1,in,&i,n))
+			break;
+		if (!(c->bit_data&0x1)) { /* ordinal */
+			if (!get_bits(c,1+v->ord_size,in,&i,n))
+				break;
+			ch = c->bit_data>>1&((1<<v->ord_size)-1);
+			drop_bits(c,1+v->ord_size);
+			HIST(v,v->hpos) = ch;
+			v->hpos++;
+			comp_out_byte(c,ch);
+			v->cur = 0;
+			v->cur_len = 1;
+			v->ext = 0;
+			end_string(c,v);
+			continue;
+		}
+		if (!get_bits(c,1+v->cw_size,in,&i,n))
+			break;
+		cw = c->bit_data>>1&((1<<v->cw_size)-1);
+		drop_bits(c,1+v->cw_size);
+		switch (cw) {
+		case CCW_ETM:
+			SLZ_DBG("C decoder: ETM\n");
+			c->bit_len  = 0;
+			c->bit_data = 0;
+			c->mode = TRANSPARENT;
+			v->has_prev = 0;
+			break;
+		case CCW_FLUSH:
+			c->bit_len  = 0;
+			c->bit_data = 0;
+			break;
+		case CCW_STEPUP:
+			if (v->ord_size >= 8) { /* C-ERROR */
+				SLZ_ERR("fatal: ordinal size too big!\n");
+				return -1;
+			}
+			v->ord_size++;
+			break;
+		case CCW_REINIT:
+			dict_reset(v);
+			v->ord_size = INIT_ORD_SIZE;
+			break;
+		default:
+			if ((!v->full && cw >= v->next_free) || cw >= v->dict_size ||
+			    !usable(v,cw)) { /* C-ERROR */
+				SLZ_ERR("fatal: bad codeword %d (%d)!\n",
+					cw,v->next_free);
+				return -1;
+			}
+			d = &v->dict[cw];
+			copy_string(c,v,d->base,d->slen);
+			v->cur = cw;
+			v->cur_len = d->slen;
+			v->state = STR_EXTEND;
+			break;
+		}
+	}
+	return i;
+}
+
+/* decoded strings are sent out whole */
+int slz_flush_decoder(struct comp_state *c)
+{
+	return 0;
+}
+
+
+/*
+ *  init procedures
+ *
+ */
+
+int slz_init(struct slz_state *v, int dict_size, int max_str, int hist_size)
+{
+	unsigned size;
+	memset(v,0,sizeof(*v));
+	if (dict_size < MIN_DICT_SIZE || dict_size > MAX_DICT_SIZE ||
+	    max_str < MIN_STR_SIZE || max_str > MAX_STR_SIZE ||
+	    hist_size < MIN_HIST_SIZE || hist_size > MAX_HIST_SIZE)
+		return -1;
+	for (size = 1; size < hist_size; size <<= 1)
+		;
+	v->dict = SLZ_ALLOC(dict_size*sizeof(*v->dict));
+	v->hist = SLZ_ALLOC(size);
+	if (!v->dict || !v->hist) {
+		if (v->dict)
+			SLZ_FREE(v->dict);
+		if (v->hist)
+			SLZ_FREE(v->hist);
+		v->dict = NULL;
+		v->hist = NULL;
+		return -1;
+	}
+	v->dict_alloc = v->dict_size = dict_size;
+	v->max_string = max_str;
+	v->hist_size  = hist_size;
+	v->hist_mask  = size - 1;
+	v->hist_limit = hist_size - 2*max_str - 2;
+	return 0;
+}
+
+/* set up negotiated params and make c run SLZ on v */
+int slz_config(struct comp_state *c, struct slz_state *v,
+	       int dict_size, int max_str, int hist_size)
+{
+	if (!v->dict ||
+	    dict_size < MIN_DICT_SIZE || dict_size > v->dict_alloc ||
+	    max_str < MIN_STR_SIZE || max_str > MAX_STR_SIZE ||
+	    hist_size < MIN_HIST_SIZE || hist_size > v->hist_mask + 1)
+		return -1;
+	v->dict_size  = dict_size;
+	v->max_string = max_str;
+	v->hist_size  = hist_size;
+	v->hist_limit = hist_size - 2*max_str - 2;
+	c->slz = v;
+	slz_reset(c,v);
+	return 0;
+}
+
+void slz_exit(struct slz_state *v)
+{
+	if (v->dict) {
+		SLZ_FREE(v->dict);
+		v->dict = NULL;
+	}
+	if (v->hist) {
+		SLZ_FREE(v->hist);
+		v->hist = NULL;
+	}
+	v->dict_alloc = 0;
+}
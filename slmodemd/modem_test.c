@@ -203,7 +203,8 @@ static int modem_test_run(struct modem_test *modems)
 #endif
                 FD_ZERO(&rset);
 		FD_ZERO(&eset);
-		max_fd = 0;
+		FD_SET(modem_timer_fd(),&rset);
+		max_fd = modem_timer_fd();
 
 		for( t = modems ; t->modem ; t++ ) {
 			FD_SET(t->in,&rset);
@@ -246,6 +247,9 @@ static int modem_test_run(struct modem_test *modems)
 			continue;
 		}
 
+		if(FD_ISSET(modem_timer_fd(),&rset))
+			modem_timer_run();
+
 		for( t = modems ; t->modem ; t++ ) {
 			if(FD_ISSET(t->in,&eset)) {
 				DBG("dev exception...\n");
@@ -437,7 +441,10 @@ int modem_test()
 	dp_dummy_init();
 	dp_sinus_init();
 	prop_dp_init();
-	modem_timer_init();
+	if(modem_timer_init() < 0) {
+		ERR("cannot create timer: %s\n",strerror(errno));
+		exit(-1);
+	}
 
 	ma = &modems[0];
 	mb = &modems[1];
@@ -465,6 +472,7 @@ int modem_test()
 	dp_dummy_exit();
 	dp_sinus_exit();
 	prop_dp_exit();
+	modem_timer_exit();
 
 	exit(ret);
 	return 0;
@@ -38,13 +38,22 @@
  *
  *    Author: Sasha K (sashak@smlink.com)
  *
+ *    Timers are kept in a binary min-heap ordered by expiration and a
+ *    single timerfd is armed for the earliest one. The main loop polls
+ *    modem_timer_fd() and calls modem_timer_run(), so callbacks run
+ *    synchronously with the rest of the modem code.
+ *    modem_timer_simulate() replaces the monotonic clock with one the
+ *    caller advances itself (used by modem_bench).
  *
  */
 
 #include <unistd.h>
-#include <signal.h>
-#include <sys/time.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 #include <limits.h>
+#include <sys/timerfd.h>
 
 #include <modem_timer.h>
 
@@ -55,76 +64,150 @@
 #define WARN(fmt...)
 #endif
 
-#define MAX_TIME LONG_MAX
+#define HEAP_MIN_SIZE 16
 
-static struct timeval tv_init;
+/* wrap safe compare of 'unsigned expires' values (also on LP64) */
+#define expires_before(t1,t2) ((int)((t1)-(t2)) < 0)
 
-static struct timer_list_struct {
-	struct timer *list;
-	unsigned long when;
-	struct sigaction old_act;
-} timer_list;
+static struct timespec ts_init;
+
+static struct timer_heap_struct {
+	struct timer **heap;
+	unsigned count;
+	unsigned size;
+	int fd;
+	unsigned long when; /* currently armed expiration, if any */
+	unsigned armed;
+	unsigned simulated; /* clock is driven by modem_timer_simulate() */
+	unsigned long now;
+} timer_heap = { .fd = -1 };
 
 
 
 unsigned long get_time()
 {
-	struct timeval tv_now,tv;
-	gettimeofday(&tv_now,NULL);
-	timersub(&tv_now,&tv_init,&tv);
-	return tv.tv_sec*MODEM_HZ + tv.tv_usec/(1000000/MODEM_HZ);
+	struct timespec ts_now;
+	long sec, nsec;
+	if(timer_heap.simulated)
+		return timer_heap.now;
+	clock_gettime(CLOCK_MONOTONIC,&ts_now);
+	sec  = ts_now.tv_sec  - ts_init.tv_sec;
+	nsec = ts_now.tv_nsec - ts_init.tv_nsec;
+	if (nsec < 0) {
+		sec--;
+		nsec += 1000000000L;
+	}
+	return sec*MODEM_HZ + nsec/(1000000000L/MODEM_HZ);
 }
 
-static void set_timer(unsigned long when)
+static void set_timer(void)
 {
-	struct itimerval it;
-	long t;
-	t = (long)(when - get_time());
-	if( t <= 0) t = 1;
-	it.it_interval.tv_usec = 0;
+	struct itimerspec it;
+	unsigned long when;
+	if(timer_heap.simulated)
+		return;
+	if(!timer_heap.count) {
+		if(timer_heap.armed) {
+			memset(&it,0,sizeof(it));
+			timerfd_settime(timer_heap.fd,0,&it,NULL);
+			timer_heap.armed = 0;
+		}
+		return;
+	}
+	when = timer_heap.heap[0]->expires;
+	if(timer_heap.armed && timer_heap.when == when)
+		return;
+	/* absolute CLOCK_MONOTONIC time of tick 'when' */
 	it.it_interval.tv_sec  = 0;
-	it.it_value.tv_usec = (t%MODEM_HZ)*(1000000/MODEM_HZ);
-	it.it_value.tv_sec  = t/MODEM_HZ;
-	setitimer(ITIMER_REAL,&it,NULL);
+	it.it_interval.tv_nsec = 0;
+	it.it_value.tv_sec  = ts_init.tv_sec + when/MODEM_HZ;
+	it.it_value.tv_nsec = ts_init.tv_nsec + (when%MODEM_HZ)*(1000000000L/MODEM_HZ);
+	if (it.it_value.tv_nsec >= 1000000000L) {
+		it.it_value.tv_sec++;
+		it.it_value.tv_nsec -= 1000000000L;
+	}
+	timerfd_settime(timer_heap.fd,TFD_TIMER_ABSTIME,&it,NULL);
+	timer_heap.when = when;
+	timer_heap.armed = 1;
+}
+
+
+/* heap helpers */
+
+static void heap_set(unsigned i, struct timer *t)
+{
+	timer_heap.heap[i] = t;
+	t->index = i;
+}
+
+static void heap_up(unsigned i)
+{
+	struct timer *t = timer_heap.heap[i];
+	while(i > 0) {
+		unsigned parent = (i - 1)/2;
+		if(!expires_before(t->expires,timer_heap.heap[parent]->expires))
+			break;
+		heap_set(i,timer_heap.heap[parent]);
+		i = parent;
+	}
+	heap_set(i,t);
 }
 
+static void heap_down(unsigned i)
+{
+	struct timer *t = timer_heap.heap[i];
+	unsigned child;
+	while((child = 2*i + 1) < timer_heap.count) {
+		if(child + 1 < timer_heap.count &&
+		   expires_before(timer_heap.heap[child+1]->expires,
+				  timer_heap.heap[child]->expires))
+			child++;
+		if(!expires_before(timer_heap.heap[child]->expires,t->expires))
+			break;
+		heap_set(i,timer_heap.heap[child]);
+		i = child;
+	}
+	heap_set(i,t);
+}
 
-static void timer_list_handler(int num)
+static void heap_remove(unsigned i)
 {
+	struct timer *last = timer_heap.heap[--timer_heap.count];
+	if(i == timer_heap.count)
+		return;
+	heap_set(i,last);
+	heap_down(i);
+	heap_up(last->index);
+}
+
+
+void modem_timer_run()
+{
+	uint64_t expirations;
 	unsigned long now;
-	struct timer *t,*next;
+	struct timer *t;
+	/* EAGAIN just means nothing fired yet: the heap is checked anyway */
+	if(read(timer_heap.fd,&expirations,sizeof(expirations)) < 0)
+		expirations = 0;
+	timer_heap.armed = 0;
 	now = get_time();
-	t = timer_list.list;
-	timer_list.list = NULL;
-	while(t) {
-		next = t->next;
-		t->next    = NULL;
-		if( (long)(t->expires - now) <= 0 ) {
-			t->added = 0;
-			if(t->func) {
-				t->func(t->data);
-			}
-		}
-		else {
-			t->next = timer_list.list;
-			timer_list.list = t;
+	while(timer_heap.count) {
+		t = timer_heap.heap[0];
+		if(expires_before((unsigned)now,t->expires))
+			break;
+		heap_remove(0);
+		t->added = 0;
+		if(t->func) {
+			t->func(t->data);
 		}
-		t = next;
 	}
-	timer_list.when = now + MAX_TIME;
-	t = timer_list.list;
-	while(t) {
-		if((long)(timer_list.when - t->expires) > 0)
-			timer_list.when = t->expires;
-		t = t->next;
-	}
-	set_timer(timer_list.when);
+	set_timer();
 }
 
 
 void timer_init(struct timer *t)
 {
-	t->next = 0;
+	t->index = 0;
 	t->added = 0;
 	t->expires = 0;
 	t->func = NULL;
@@ -133,73 +216,80 @@ void timer_init(struct timer *t)
 
 int timer_add(struct timer *t)
 {
-	sigset_t set, old_set;
-	sigemptyset(&set);
-	sigaddset(&set,SIGALRM);
-	sigprocmask(SIG_BLOCK,&set,&old_set);
 	if(t->added) {
 		WARN("timer_add: already.\n");
+		/* expiration may have been changed: restore heap order */
+		heap_up(t->index);
+		heap_down(t->index);
 	}
 	else {
+		if(timer_heap.count == timer_heap.size) {
+			unsigned size = timer_heap.size ? timer_heap.size*2 : HEAP_MIN_SIZE;
+			struct timer **heap = realloc(timer_heap.heap,size*sizeof(*heap));
+			if(!heap)
+				return -1;
+			timer_heap.heap = heap;
+			timer_heap.size = size;
+		}
 		t->added = 1;
-		t->next = timer_list.list;
-		timer_list.list = t;
-	}
-	if((long)(timer_list.when - t->expires) > 0) {
-		timer_list.when = t->expires;
-		set_timer(timer_list.when);
+		heap_set(timer_heap.count++,t);
+		heap_up(t->index);
 	}
-	sigprocmask(SIG_SETMASK,&old_set,NULL);
+	set_timer();
 	return 0;
 }
 
 int timer_del(struct timer *t)
 {
-	sigset_t set, old_set;
-	struct timer *p, **prev;
-	sigemptyset(&set);
-	sigaddset(&set,SIGALRM);
-	sigprocmask(SIG_BLOCK,&set,&old_set);
 	if(t->added) {
-		p = timer_list.list;
-		prev = &timer_list.list;
-		while(p) {
-			if(p == t) {
-				*prev = t->next;
-				t->next = NULL;
-				t->added = 0;
-				break;
-			}
-			prev = &((*prev)->next);
-			p = p->next;
-		}
+		heap_remove(t->index);
+		t->added = 0;
+		set_timer();
 	}
 	else {
 		WARN("timer_del: not added\n");
 	}
-	sigprocmask(SIG_SETMASK,&old_set,NULL);
 	return 0;
 }
 
 
+/* switch to simulated time: 'now' is in MODEM_HZ ticks and must not
+   go backwards. The caller runs modem_timer_run() when it advances. */
+void modem_timer_simulate(unsigned long now)
+{
+	if(!timer_heap.simulated && timer_heap.armed) {
+		struct itimerspec it;
+		memset(&it,0,sizeof(it));
+		timerfd_settime(timer_heap.fd,0,&it,NULL);
+		timer_heap.armed = 0;
+	}
+	timer_heap.simulated = 1;
+	timer_heap.now = now;
+}
+
+int modem_timer_fd()
+{
+	return timer_heap.fd;
+}
+
 int modem_timer_init()
 {
-	struct sigaction act;
-	gettimeofday(&tv_init,NULL);
-	timer_list.list = NULL;
-	timer_list.when = get_time() + MAX_TIME;
-	act.sa_handler = timer_list_handler;
-	sigemptyset(&act.sa_mask);
-	sigaddset(&act.sa_mask, SIGALRM);
-	act.sa_flags = SA_SIGINFO;
-	sigaction(SIGALRM,&act,&timer_list.old_act);
-	set_timer(timer_list.when);
+	clock_gettime(CLOCK_MONOTONIC,&ts_init);
+	timer_heap.count = 0;
+	timer_heap.armed = 0;
+	timer_heap.fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+	if(timer_heap.fd < 0)
+		return -1;
 	return 0;
 }
 
 void modem_timer_exit()
 {
-	sigaction(SIGALRM,&timer_list.old_act,NULL);
+	if(timer_heap.fd >= 0) {
+		close(timer_heap.fd);
+		timer_heap.fd = -1;
+	}
+	free(timer_heap.heap);
+	timer_heap.heap = NULL;
+	timer_heap.count = timer_heap.size = 0;
 }
-
-
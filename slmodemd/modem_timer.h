@@ -48,7 +48,7 @@
 #define MODEM_HZ 100
 
 struct timer {
-	struct timer *next;
+	unsigned index; /* heap slot */
 	unsigned added;
 	unsigned expires;
 	void (*func)(void *);
@@ -66,5 +66,9 @@ extern int timer_add(struct timer *t);
 extern int timer_del(struct timer *t);
 
 extern int modem_timer_init(void);
+extern void modem_timer_exit(void);
+extern int modem_timer_fd(void);
+extern void modem_timer_run(void);
+extern void modem_timer_simulate(unsigned long now);
 
 #endif /* __MODEM_TIMER_H__ */